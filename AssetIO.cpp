@@ -0,0 +1,389 @@
+#include "AssetIO.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+
+// io_uring is used through its raw system calls so there is no liburing dependency
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ASSETIO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+#endif
+
+namespace
+{
+    // the empty-file case still hands the callback a valid pointer, nullptr means failure
+    const unsigned char emptyFile[1] = { 0 };
+
+#ifdef ASSETIO_URING
+    // Minimal io_uring wrapper: one submission queue, one completion queue, nothing else.
+    class Uring
+    {
+    public:
+        ~Uring()
+        {
+            if (sqes) munmap(sqes, sqeBytes);
+            if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingBytes);
+            if (sqRing) munmap(sqRing, sqRingBytes);
+            if (ringFd >= 0) close(ringFd);
+        }
+
+        bool init(unsigned entries)
+        {
+            io_uring_params params{};
+            ringFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+            if (ringFd < 0)
+                return false;
+
+            sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            // newer kernels share one mapping between both rings
+            const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (singleMap)
+                sqRingBytes = cqRingBytes = std::max(sqRingBytes, cqRingBytes);
+
+            sqRing = mapRing(sqRingBytes, IORING_OFF_SQ_RING);
+            if (!sqRing)
+                return false;
+            cqRing = singleMap ? sqRing : mapRing(cqRingBytes, IORING_OFF_CQ_RING);
+            if (!cqRing)
+                return false;
+            sqeBytes = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = (io_uring_sqe*)mapRing(sqeBytes, IORING_OFF_SQES);
+            if (!sqes)
+                return false;
+
+            sqHead = (unsigned*)(sqRing + params.sq_off.head);
+            sqTail = (unsigned*)(sqRing + params.sq_off.tail);
+            sqMask = *(unsigned*)(sqRing + params.sq_off.ring_mask);
+            sqArray = (unsigned*)(sqRing + params.sq_off.array);
+            sqEntries = params.sq_entries;
+            cqHead = (unsigned*)(cqRing + params.cq_off.head);
+            cqTail = (unsigned*)(cqRing + params.cq_off.tail);
+            cqMask = *(unsigned*)(cqRing + params.cq_off.ring_mask);
+            cqes = (io_uring_cqe*)(cqRing + params.cq_off.cqes);
+            return true;
+        }
+
+        // queues a read into iov at the given file offset; false if the submission queue is full
+        bool queueRead(int fd, iovec* iov, unsigned long long offset, unsigned long long userData)
+        {
+            const unsigned tail = *sqTail;
+            if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+                return false;
+            const unsigned index = tail & sqMask;
+            io_uring_sqe& sqe = sqes[index];
+            sqe = io_uring_sqe{};
+            // READV is the oldest read opcode (5.1), plain READ would need 5.6
+            sqe.opcode = IORING_OP_READV;
+            sqe.fd = fd;
+            sqe.addr = (unsigned long long)iov;
+            sqe.len = 1;
+            sqe.off = offset;
+            sqe.user_data = userData;
+            sqArray[index] = index;
+            __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+            ++pending;
+            return true;
+        }
+
+        // submits everything queued and waits until at least one completion is available
+        bool submitAndWait()
+        {
+            for (;;)
+            {
+                const long submitted = syscall(__NR_io_uring_enter, ringFd, pending, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (submitted >= 0)
+                {
+                    pending -= (unsigned)submitted;
+                    everSubmitted = everSubmitted || submitted > 0;
+                    return true;
+                }
+                if (errno != EINTR && errno != EAGAIN)
+                    return false;
+            }
+        }
+
+        // whether the kernel ever accepted a request, i.e. may still be writing into our buffers
+        bool hasSubmitted() const { return everSubmitted; }
+
+        // pops one completion, if any
+        bool popCompletion(io_uring_cqe& cqe)
+        {
+            const unsigned head = *cqHead;
+            if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+                return false;
+            cqe = cqes[head & cqMask];
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+
+    private:
+        unsigned char* mapRing(size_t bytes, off_t offset)
+        {
+            void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, offset);
+            return ptr == MAP_FAILED ? nullptr : (unsigned char*)ptr;
+        }
+
+        int ringFd = -1;
+        unsigned char* sqRing = nullptr;
+        unsigned char* cqRing = nullptr;
+        io_uring_sqe* sqes = nullptr;
+        size_t sqRingBytes = 0, cqRingBytes = 0, sqeBytes = 0;
+        unsigned* sqHead = nullptr;
+        unsigned* sqTail = nullptr;
+        unsigned* sqArray = nullptr;
+        unsigned sqMask = 0, sqEntries = 0;
+        unsigned* cqHead = nullptr;
+        unsigned* cqTail = nullptr;
+        unsigned cqMask = 0;
+        io_uring_cqe* cqes = nullptr;
+        unsigned pending = 0;
+        bool everSubmitted = false;
+    };
+
+    struct UringFile
+    {
+        int fd = -1;
+        std::unique_ptr<unsigned char[]> data;
+        size_t size = 0;
+        size_t done = 0;
+        bool finished = false;
+        iovec iov{};
+
+        ~UringFile()
+        {
+            if (fd >= 0) close(fd);
+        }
+    };
+
+    bool readFile(const std::string& path, std::unique_ptr<unsigned char[]>& data, size_t& size);
+
+    // Returns false only if the ring can't be created, before any callback ran, so the caller can fall back.
+    bool readAllUring(const std::vector<std::string>& paths, const AssetIO::ReadCallback& onRead)
+    {
+        const size_t count = paths.size();
+        Uring ring;
+        if (!ring.init((unsigned)std::min<size_t>(count, 64)))
+            return false;
+
+        std::vector<UringFile> files(count);
+        size_t nextToOpen = 0, finished = 0, inFlight = 0;
+
+        auto finish = [&](size_t index, bool success)
+        {
+            UringFile& file = files[index];
+            if (success)
+                onRead(index, file.size ? file.data.get() : emptyFile, file.size);
+            else
+                onRead(index, nullptr, 0);
+            // give the memory back as soon as the decoder is done with it
+            file.data.reset();
+            if (file.fd >= 0)
+            {
+                close(file.fd);
+                file.fd = -1;
+            }
+            file.finished = true;
+            ++finished;
+        };
+
+        auto queueRemainder = [&](size_t index)
+        {
+            UringFile& file = files[index];
+            file.iov.iov_base = file.data.get() + file.done;
+            file.iov.iov_len = file.size - file.done;
+            return ring.queueRead(file.fd, &file.iov, file.done, index);
+        };
+
+        while (finished < count)
+        {
+            // Opening is still synchronous, only the reads go through the ring.
+            // Files beyond the queue depth are opened as earlier reads complete.
+            while (nextToOpen < count && inFlight < 64)
+            {
+                const size_t index = nextToOpen;
+                UringFile& file = files[index];
+                file.fd = open(paths[index].c_str(), O_RDONLY | O_CLOEXEC);
+                struct stat st;
+                if (file.fd < 0 || fstat(file.fd, &st) != 0 || !S_ISREG(st.st_mode))
+                {
+                    ++nextToOpen;
+                    finish(index, false);
+                    continue;
+                }
+                file.size = (size_t)st.st_size;
+                if (file.size == 0)
+                {
+                    ++nextToOpen;
+                    finish(index, true);
+                    continue;
+                }
+                file.data.reset(new (std::nothrow) unsigned char[file.size]);
+                if (!file.data)
+                {
+                    ++nextToOpen;
+                    finish(index, false);
+                    continue;
+                }
+                if (!queueRemainder(index))
+                {
+                    file.data.reset();
+                    close(file.fd);
+                    file.fd = -1;
+                    break;
+                }
+                ++nextToOpen;
+                ++inFlight;
+            }
+
+            if (inFlight == 0)
+                continue;
+
+            if (!ring.submitAndWait())
+            {
+                // The kernel refused the batch. If it never accepted anything, the rest is read the slow way.
+                // Otherwise reads may still be in flight, so those files fail and their buffers are leaked rather than freed.
+                const bool mayBeInFlight = ring.hasSubmitted();
+                for (size_t i = 0; i < count; ++i)
+                {
+                    UringFile& file = files[i];
+                    if (file.finished)
+                        continue;
+                    if (mayBeInFlight)
+                    {
+                        file.data.release();
+                        finish(i, false);
+                    }
+                    else
+                        finish(i, readFile(paths[i], file.data, file.size));
+                }
+                return true;
+            }
+
+            io_uring_cqe cqe;
+            while (ring.popCompletion(cqe))
+            {
+                const size_t index = (size_t)cqe.user_data;
+                UringFile& file = files[index];
+                if (cqe.res <= 0)
+                {
+                    // an error, or the file got shorter since fstat
+                    --inFlight;
+                    finish(index, false);
+                    continue;
+                }
+                file.done += (size_t)cqe.res;
+                // short reads happen, e.g. on huge files or when interrupted; ask for the rest
+                if (file.done < file.size && queueRemainder(index))
+                    continue;
+                --inFlight;
+                finish(index, file.done == file.size);
+            }
+        }
+        return true;
+    }
+#endif
+
+    // reads one file with ordinary blocking I/O
+    bool readFile(const std::string& path, std::unique_ptr<unsigned char[]>& data, size_t& size)
+    {
+        std::error_code error;
+        if (!std::filesystem::is_regular_file(path, error))
+            return false;
+        const std::uintmax_t length = std::filesystem::file_size(path, error);
+        if (error)
+            return false;
+
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        size = (size_t)length;
+        data.reset(new (std::nothrow) unsigned char[size ? size : 1]);
+        if (!data)
+            return false;
+        return size == 0 || (bool)file.read((char*)data.get(), (std::streamsize)size);
+    }
+
+    // Thread pool fallback: workers do blocking reads in parallel and hand finished files back to the caller's thread.
+    void readAllThreaded(const std::vector<std::string>& paths, const AssetIO::ReadCallback& onRead)
+    {
+        struct Result
+        {
+            size_t index;
+            bool success;
+            std::unique_ptr<unsigned char[]> data;
+            size_t size;
+        };
+
+        const size_t count = paths.size();
+        std::atomic<size_t> nextIndex{ 0 };
+        std::mutex mutex;
+        std::condition_variable resultReady;
+        std::deque<Result> results;
+
+        auto worker = [&]()
+        {
+            for (size_t index = nextIndex++; index < count; index = nextIndex++)
+            {
+                Result result{ index, false, nullptr, 0 };
+                result.success = readFile(paths[index], result.data, result.size);
+                std::lock_guard<std::mutex> lock(mutex);
+                results.push_back(std::move(result));
+                resultReady.notify_one();
+            }
+        };
+
+        // reads are latency bound rather than CPU bound, so a few more threads than cores is fine
+        const size_t threadCount = std::min<size_t>(count, std::max(4u, std::thread::hardware_concurrency()));
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < threadCount; ++i)
+            workers.emplace_back(worker);
+
+        for (size_t delivered = 0; delivered < count; ++delivered)
+        {
+            Result result;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                resultReady.wait(lock, [&] { return !results.empty(); });
+                result = std::move(results.front());
+                results.pop_front();
+            }
+            if (result.success)
+                onRead(result.index, result.data.get(), result.size);
+            else
+                onRead(result.index, nullptr, 0);
+        }
+
+        for (std::thread& thread : workers)
+            thread.join();
+    }
+}
+
+void AssetIO::readAll(const std::vector<std::string>& paths, const ReadCallback& onRead)
+{
+    if (paths.empty())
+        return;
+
+#ifdef ASSETIO_URING
+    if (readAllUring(paths, onRead))
+        return;
+#endif
+    readAllThreaded(paths, onRead);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+
+// Reads a whole batch of asset files at once instead of one blocking read after another.
+// On Linux all reads of the batch are queued through io_uring, so the kernel can overlap the disk latency of every file.
+// Elsewhere, or when io_uring can't be set up (old kernel, blocked by a sandbox), a few threads do blocking reads in parallel.
+class AssetIO
+{
+public:
+    // Called once per file, as soon as that file's read completes, always on the thread that called readAll.
+    // index is the file's position in the paths list. data is nullptr if the file couldn't be read.
+    // The buffer is only valid during the call, and the callback must not throw.
+    typedef std::function<void(size_t index, const unsigned char* data, size_t size)> ReadCallback;
+
+    // reads every file in paths and returns once the callback has run for each of them
+    static void readAll(const std::vector<std::string>& paths, const ReadCallback& onRead);
+};
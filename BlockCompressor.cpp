@@ -0,0 +1,446 @@
+#include "BlockCompressor.h"
+#include "CompressedTexture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLOCKCOMPRESSOR_SSE2
+#endif
+
+namespace
+{
+    const GLenum RGB_S3TC_DXT1 = 0x83F0, RGBA_S3TC_DXT1 = 0x83F1, RGBA_S3TC_DXT5 = 0x83F3;
+    const GLenum RED_RGTC1 = 0x8DBB, RG_RGTC2 = 0x8DBD;
+
+    // BC1 index of each step along the line from color0 to color1: color0, 2/3 color0 + 1/3 color1, 1/3 color0 + 2/3 color1, color1
+    const uint32_t indexOfStep[4] = { 0, 2, 3, 1 };
+
+    // Copies the 4x4 block at block column bx, row by into rgba as 16 RGBA pixels.
+    // Missing channels are 0, missing alpha 255, and pixels past the edge repeat the last column and row.
+    void loadBlock(const unsigned char* pixels, int width, int height, int channels, int bx, int by, unsigned char* rgba)
+    {
+        const int x0 = bx * 4, y0 = by * 4;
+        if (channels == 4 && x0 + 4 <= width && y0 + 4 <= height)
+        {
+            for (int y = 0; y < 4; ++y)
+                memcpy(rgba + y * 16, pixels + ((size_t)(y0 + y) * width + x0) * 4, 16);
+            return;
+        }
+
+        for (int y = 0; y < 4; ++y)
+        {
+            const int sy = std::min(y0 + y, height - 1);
+            for (int x = 0; x < 4; ++x)
+            {
+                const int sx = std::min(x0 + x, width - 1);
+                const unsigned char* p = pixels + ((size_t)sy * width + sx) * channels;
+                unsigned char* out = rgba + (y * 4 + x) * 4;
+                out[0] = p[0];
+                out[1] = channels > 1 ? p[1] : 0;
+                out[2] = channels > 2 ? p[2] : 0;
+                out[3] = channels > 3 ? p[3] : 255;
+            }
+        }
+    }
+
+    // per-channel minimum and maximum of the 16 pixels
+    void boundingBox(const unsigned char* rgba, unsigned char* lo, unsigned char* hi)
+    {
+#ifdef BLOCKCOMPRESSOR_SSE2
+        const __m128i r0 = _mm_loadu_si128((const __m128i*)rgba), r1 = _mm_loadu_si128((const __m128i*)(rgba + 16));
+        const __m128i r2 = _mm_loadu_si128((const __m128i*)(rgba + 32)), r3 = _mm_loadu_si128((const __m128i*)(rgba + 48));
+        __m128i mn = _mm_min_epu8(_mm_min_epu8(r0, r1), _mm_min_epu8(r2, r3));
+        __m128i mx = _mm_max_epu8(_mm_max_epu8(r0, r1), _mm_max_epu8(r2, r3));
+        // fold the four pixels of each register into one
+        mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+        mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+        mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+        mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+        const uint32_t packedLo = (uint32_t)_mm_cvtsi128_si32(mn), packedHi = (uint32_t)_mm_cvtsi128_si32(mx);
+        memcpy(lo, &packedLo, 4);
+        memcpy(hi, &packedHi, 4);
+#else
+        for (int c = 0; c < 4; ++c)
+        {
+            lo[c] = 255;
+            hi[c] = 0;
+        }
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                lo[c] = std::min(lo[c], rgba[i * 4 + c]);
+                hi[c] = std::max(hi[c], rgba[i * 4 + c]);
+            }
+        }
+#endif
+    }
+
+    uint16_t to565(const int* color)
+    {
+        const int r = (std::min(std::max(color[0], 0), 255) * 31 + 127) / 255;
+        const int g = (std::min(std::max(color[1], 0), 255) * 63 + 127) / 255;
+        const int b = (std::min(std::max(color[2], 0), 255) * 31 + 127) / 255;
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    void from565(uint16_t packed, int* color)
+    {
+        const int r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // Picks for every pixel the nearest of the four colors on the line from c0 to c1, by projecting it onto the line.
+    uint32_t selectIndices(const unsigned char* rgba, const int* c0, const int* c1)
+    {
+        const int dir[3] = { c1[0] - c0[0], c1[1] - c0[1], c1[2] - c0[2] };
+        const int length = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+        int steps[16];
+
+#ifdef BLOCKCOMPRESSOR_SSE2
+        // the pixels widened to 16 bits, two per register; alpha drops out because its direction component is 0
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i direction = _mm_set_epi16(0, (short)dir[2], (short)dir[1], (short)dir[0], 0, (short)dir[2], (short)dir[1], (short)dir[0]);
+        const __m128i origin = _mm_set_epi16(0, (short)c0[2], (short)c0[1], (short)c0[0], 0, (short)c0[2], (short)c0[1], (short)c0[0]);
+        const __m128i threshold1 = _mm_set1_epi32(length), threshold3 = _mm_set1_epi32(length * 3), threshold5 = _mm_set1_epi32(length * 5);
+        for (int i = 0; i < 16; i += 4)
+        {
+            const __m128i px = _mm_loadu_si128((const __m128i*)(rgba + i * 4));
+            // (r*dr + g*dg, b*db) per pixel, then the two halves added
+            const __m128i lo = _mm_madd_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(px, zero), origin), direction);
+            const __m128i hi = _mm_madd_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(px, zero), origin), direction);
+            const __m128 even = _mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0));
+            const __m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1));
+            const __m128i dot = _mm_add_epi32(_mm_castps_si128(even), _mm_castps_si128(odd));
+            // 6 * dot against length, 3 * length and 5 * length: the step is how many of the thresholds it reaches
+            const __m128i dot6 = _mm_add_epi32(_mm_slli_epi32(dot, 1), _mm_slli_epi32(dot, 2));
+            __m128i step = _mm_sub_epi32(zero, _mm_cmpgt_epi32(threshold1, dot6));
+            step = _mm_sub_epi32(step, _mm_cmpgt_epi32(threshold3, dot6));
+            step = _mm_sub_epi32(step, _mm_cmpgt_epi32(threshold5, dot6));
+            _mm_storeu_si128((__m128i*)(steps + i), _mm_sub_epi32(_mm_set1_epi32(3), step));
+        }
+#else
+        for (int i = 0; i < 16; ++i)
+        {
+            const unsigned char* p = rgba + i * 4;
+            const int dot6 = 6 * ((p[0] - c0[0]) * dir[0] + (p[1] - c0[1]) * dir[1] + (p[2] - c0[2]) * dir[2]);
+            steps[i] = (dot6 >= length) + (dot6 >= length * 3) + (dot6 >= length * 5);
+        }
+#endif
+
+        uint32_t indices = 0;
+        for (int i = 0; i < 16; ++i)
+            indices |= indexOfStep[steps[i]] << (i * 2);
+        return indices;
+    }
+
+    // squared RGB error of the block against the palette the endpoints and indices describe
+    int blockError(const unsigned char* rgba, const int* c0, const int* c1, uint32_t indices)
+    {
+        int palette[4][3];
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[0][c] = c0[c];
+            palette[1][c] = c1[c];
+            palette[2][c] = (2 * c0[c] + c1[c]) / 3;
+            palette[3][c] = (c0[c] + 2 * c1[c]) / 3;
+        }
+        int error = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            const int* color = palette[(indices >> (i * 2)) & 3];
+            for (int c = 0; c < 3; ++c)
+            {
+                const int d = rgba[i * 4 + c] - color[c];
+                error += d * d;
+            }
+        }
+        return error;
+    }
+
+    // Quantizes the endpoints and picks the indices, in four color mode. Returns the block's error.
+    int encodeEndpoints(const unsigned char* rgba, const int* e0, const int* e1, unsigned char* out)
+    {
+        uint16_t q0 = to565(e0), q1 = to565(e1);
+        // four color mode needs color0 > color1; swapping the endpoints mirrors the line, so the indices follow
+        if (q0 < q1)
+            std::swap(q0, q1);
+
+        int c0[3], c1[3];
+        from565(q0, c0);
+        from565(q1, c1);
+        // with equal endpoints the block is in three color mode, where index 3 would be black
+        const uint32_t indices = q0 == q1 ? 0 : selectIndices(rgba, c0, c1);
+
+        out[0] = (unsigned char)(q0 & 255);
+        out[1] = (unsigned char)(q0 >> 8);
+        out[2] = (unsigned char)(q1 & 255);
+        out[3] = (unsigned char)(q1 >> 8);
+        for (int i = 0; i < 4; ++i)
+            out[4 + i] = (unsigned char)(indices >> (i * 8));
+        return blockError(rgba, c0, c1, indices);
+    }
+
+    // Endpoints from the bounding box, flipped onto the diagonal the colors actually run along, and pulled in a little
+    // since the box corners are usually outliers.
+    void fastEndpoints(const unsigned char* rgba, const unsigned char* lo, const unsigned char* hi, int* e0, int* e1)
+    {
+        int pivot = 0;
+        for (int c = 1; c < 3; ++c)
+            if (hi[c] - lo[c] > hi[pivot] - lo[pivot])
+                pivot = c;
+
+        int center[3], covariance[3] = { 0, 0, 0 };
+        for (int c = 0; c < 3; ++c)
+            center[c] = (lo[c] + hi[c] + 1) / 2;
+        for (int i = 0; i < 16; ++i)
+        {
+            const int d = rgba[i * 4 + pivot] - center[pivot];
+            for (int c = 0; c < 3; ++c)
+                covariance[c] += d * (rgba[i * 4 + c] - center[c]);
+        }
+
+        for (int c = 0; c < 3; ++c)
+        {
+            const int inset = (hi[c] - lo[c]) >> 4;
+            e0[c] = hi[c] - inset;
+            e1[c] = lo[c] + inset;
+            if (covariance[c] < 0)
+                std::swap(e0[c], e1[c]);
+        }
+    }
+
+    // Endpoints from the principal axis of the colors: the two pixels that lie furthest apart along it.
+    void principalEndpoints(const unsigned char* rgba, const unsigned char* lo, const unsigned char* hi, int* e0, int* e1)
+    {
+        float mean[3] = { 0, 0, 0 };
+        for (int i = 0; i < 16; ++i)
+            for (int c = 0; c < 3; ++c)
+                mean[c] += rgba[i * 4 + c];
+        for (int c = 0; c < 3; ++c)
+            mean[c] /= 16.0f;
+
+        float cov[6] = { 0, 0, 0, 0, 0, 0 }; // rr, rg, rb, gg, gb, bb
+        for (int i = 0; i < 16; ++i)
+        {
+            const float r = rgba[i * 4] - mean[0], g = rgba[i * 4 + 1] - mean[1], b = rgba[i * 4 + 2] - mean[2];
+            cov[0] += r * r;
+            cov[1] += r * g;
+            cov[2] += r * b;
+            cov[3] += g * g;
+            cov[4] += g * b;
+            cov[5] += b * b;
+        }
+
+        // power iteration, starting from the bounding box diagonal
+        float axis[3] = { (float)(hi[0] - lo[0]), (float)(hi[1] - lo[1]), (float)(hi[2] - lo[2]) };
+        for (int iteration = 0; iteration < 4; ++iteration)
+        {
+            const float x = axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2];
+            const float y = axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4];
+            const float z = axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5];
+            const float largest = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+            if (largest < 1e-6f)
+                break; // flat block, keep the diagonal
+            axis[0] = x / largest;
+            axis[1] = y / largest;
+            axis[2] = z / largest;
+        }
+
+        int minIndex = 0, maxIndex = 0;
+        float minDot = 1e30f, maxDot = -1e30f;
+        for (int i = 0; i < 16; ++i)
+        {
+            const float dot = rgba[i * 4] * axis[0] + rgba[i * 4 + 1] * axis[1] + rgba[i * 4 + 2] * axis[2];
+            if (dot < minDot)
+            {
+                minDot = dot;
+                minIndex = i;
+            }
+            if (dot > maxDot)
+            {
+                maxDot = dot;
+                maxIndex = i;
+            }
+        }
+        for (int c = 0; c < 3; ++c)
+        {
+            e0[c] = rgba[maxIndex * 4 + c];
+            e1[c] = rgba[minIndex * 4 + c];
+        }
+    }
+
+    // Least squares endpoints for the indices of an encoded block: the pair that best reproduces the pixels with them.
+    // Returns false if the indices don't pin the endpoints down (every pixel on the same step).
+    bool refineEndpoints(const unsigned char* rgba, const unsigned char* block, int* e0, int* e1)
+    {
+        // weight of color1 for each index
+        const float weightOf[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+        uint32_t indices;
+        memcpy(&indices, block + 4, 4);
+
+        float aa = 0, ab = 0, bb = 0, ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+        for (int i = 0; i < 16; ++i)
+        {
+            const float b = weightOf[(indices >> (i * 2)) & 3], a = 1.0f - b;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int c = 0; c < 3; ++c)
+            {
+                ax[c] += a * rgba[i * 4 + c];
+                bx[c] += b * rgba[i * 4 + c];
+            }
+        }
+
+        const float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f)
+            return false;
+        for (int c = 0; c < 3; ++c)
+        {
+            e0[c] = (int)std::lround((ax[c] * bb - bx[c] * ab) / determinant);
+            e1[c] = (int)std::lround((bx[c] * aa - ax[c] * ab) / determinant);
+        }
+        return true;
+    }
+
+    void encodeBC1(const unsigned char* rgba, BlockCompressor::Preset preset, unsigned char* out)
+    {
+        unsigned char lo[4], hi[4];
+        boundingBox(rgba, lo, hi);
+
+        int e0[3], e1[3];
+        if (preset == BlockCompressor::Preset::Fast)
+        {
+            fastEndpoints(rgba, lo, hi, e0, e1);
+            encodeEndpoints(rgba, e0, e1, out);
+            return;
+        }
+
+        principalEndpoints(rgba, lo, hi, e0, e1);
+        int error = encodeEndpoints(rgba, e0, e1, out);
+        for (int iteration = 0; iteration < 2 && error > 0; ++iteration)
+        {
+            unsigned char candidate[8];
+            if (!refineEndpoints(rgba, out, e0, e1))
+                break;
+            const int candidateError = encodeEndpoints(rgba, e0, e1, candidate);
+            if (candidateError >= error)
+                break;
+            error = candidateError;
+            memcpy(out, candidate, 8);
+        }
+    }
+
+    // BC4 block of the channel at offset in the 16 RGBA pixels, in eight value mode from the block's minimum to maximum
+    void encodeBC4(const unsigned char* rgba, int offset, unsigned char* out)
+    {
+        int lo = 255, hi = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            lo = std::min(lo, (int)rgba[i * 4 + offset]);
+            hi = std::max(hi, (int)rgba[i * 4 + offset]);
+        }
+
+        out[0] = (unsigned char)hi;
+        out[1] = (unsigned char)lo;
+        uint64_t indices = 0;
+        const int range = hi - lo;
+        if (range > 0) // otherwise every index 0 gives the one value
+        {
+            for (int i = 0; i < 16; ++i)
+            {
+                // the nearest of the eight steps from lo to hi; index 0 is hi, 1 is lo and 2 to 7 run from hi down
+                const int step = ((rgba[i * 4 + offset] - lo) * 14 + range) / (2 * range);
+                const uint64_t index = step == 7 ? 0 : step == 0 ? 1 : 8 - step;
+                indices |= index << (i * 3);
+            }
+        }
+        for (int i = 0; i < 6; ++i)
+            out[2 + i] = (unsigned char)(indices >> (i * 8));
+    }
+
+    // compresses the block rows [firstRow, endRow)
+    void compressRows(const unsigned char* pixels, int width, int height, int channels, GLenum format,
+        unsigned char* out, BlockCompressor::Preset preset, int firstRow, int endRow)
+    {
+        const int blocksWide = (width + 3) / 4;
+        const size_t blockBytes = format == RGBA_S3TC_DXT5 || format == RG_RGTC2 ? 16 : 8;
+        unsigned char rgba[64];
+
+        for (int by = firstRow; by < endRow; ++by)
+        {
+            unsigned char* block = out + (size_t)by * blocksWide * blockBytes;
+            for (int bx = 0; bx < blocksWide; ++bx, block += blockBytes)
+            {
+                loadBlock(pixels, width, height, channels, bx, by, rgba);
+                switch (format)
+                {
+                case RED_RGTC1:
+                    encodeBC4(rgba, 0, block);
+                    break;
+                case RG_RGTC2:
+                    encodeBC4(rgba, 0, block);
+                    encodeBC4(rgba, 1, block + 8);
+                    break;
+                case RGBA_S3TC_DXT5:
+                    // the alpha block is a BC4 block, followed by the color block
+                    encodeBC4(rgba, 3, block);
+                    encodeBC1(rgba, preset, block + 8);
+                    break;
+                default:
+                    encodeBC1(rgba, preset, block);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+GLenum BlockCompressor::formatFor(int channels, bool opaque)
+{
+    switch (channels)
+    {
+    case 1:  return RED_RGTC1;
+    case 2:  return RG_RGTC2;
+    case 3:  return RGB_S3TC_DXT1;
+    default: return opaque ? RGBA_S3TC_DXT1 : RGBA_S3TC_DXT5;
+    }
+}
+
+bool BlockCompressor::isOpaque(const unsigned char* pixels, size_t pixelCount)
+{
+    unsigned char alpha = 255;
+    for (size_t i = 0; i < pixelCount; ++i)
+        alpha &= pixels[i * 4 + 3];
+    return alpha == 255;
+}
+
+void BlockCompressor::compress(const unsigned char* pixels, int width, int height, int channels, GLenum format,
+    unsigned char* out, Preset preset, unsigned int threadCount)
+{
+    const int blocksHigh = (height + 3) / 4;
+    const int parts = (int)std::min<unsigned int>(std::max(threadCount, 1u), (unsigned int)blocksHigh);
+    if (parts <= 1)
+    {
+        compressRows(pixels, width, height, channels, format, out, preset, 0, blocksHigh);
+        return;
+    }
+
+    // every block is independent, so each thread takes a band of block rows; the calling thread does the first
+    std::vector<std::thread> threads;
+    for (int part = 1; part < parts; ++part)
+        threads.emplace_back(compressRows, pixels, width, height, channels, format, out, preset,
+            blocksHigh * part / parts, blocksHigh * (part + 1) / parts);
+    compressRows(pixels, width, height, channels, format, out, preset, 0, blocksHigh / parts);
+    for (std::thread& thread : threads)
+        thread.join();
+}
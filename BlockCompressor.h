@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+
+#include <cstddef>
+
+
+
+// Compresses decoded images into BC1, BC3, BC4 or BC5 blocks at load time, for images that only exist as JPEG/PNG
+// and so can't be compressed offline into a KTX2 or DDS file. The blocks take a quarter (BC3, BC5) to an eighth
+// (BC1, BC4) of the GPU memory of the RGBA8 image.
+// The block search uses SSE2 where the compiler targets it, and one image can be split across several threads.
+class BlockCompressor
+{
+public:
+    enum class Preset
+    {
+        Fast,       // bounding box endpoints
+        Quality     // principal axis endpoints refined by least squares; BC1 takes three to four times as long, for about 1 dB more
+    };
+
+    // The format compress() should use for an image with channels bytes per pixel:
+    // BC4 for 1 channel, BC5 for 2, BC1 for 3 (or 4 when opaque) and BC3 for 4 channels with alpha.
+    static GLenum formatFor(int channels, bool opaque);
+    // true if no pixel of a 4 channel image has alpha below 255
+    static bool isOpaque(const unsigned char* pixels, size_t pixelCount);
+
+    // Compresses width x height pixels of channels bytes each, tightly packed, into out,
+    // which must hold CompressedTexture::levelSize(format, width, height) bytes.
+    // Partial blocks at the right and bottom edges repeat the last column and row.
+    static void compress(const unsigned char* pixels, int width, int height, int channels, GLenum format,
+        unsigned char* out, Preset preset = Preset::Quality, unsigned int threadCount = 1);
+};
@@ -0,0 +1,338 @@
+#include "CompressedTexture.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_set>
+
+namespace
+{
+    // The compressed formats, spelled out because glad only defines the ones from the extensions it was generated with.
+    // S3TC (EXT_texture_compression_s3tc, sRGB forms from EXT_texture_sRGB)
+    const GLenum RGB_S3TC_DXT1 = 0x83F0, RGBA_S3TC_DXT1 = 0x83F1, RGBA_S3TC_DXT3 = 0x83F2, RGBA_S3TC_DXT5 = 0x83F3;
+    const GLenum SRGB_S3TC_DXT1 = 0x8C4C, SRGB_ALPHA_S3TC_DXT1 = 0x8C4D, SRGB_ALPHA_S3TC_DXT3 = 0x8C4E, SRGB_ALPHA_S3TC_DXT5 = 0x8C4F;
+    // RGTC (core since 3.0)
+    const GLenum RED_RGTC1 = 0x8DBB, SIGNED_RED_RGTC1 = 0x8DBC, RG_RGTC2 = 0x8DBD, SIGNED_RG_RGTC2 = 0x8DBE;
+    // BPTC (core since 4.2, ARB_texture_compression_bptc)
+    const GLenum RGBA_BPTC_UNORM = 0x8E8C, SRGB_ALPHA_BPTC_UNORM = 0x8E8D, RGB_BPTC_SIGNED_FLOAT = 0x8E8E, RGB_BPTC_UNSIGNED_FLOAT = 0x8E8F;
+    // ETC2/EAC (core since 4.3, ARB_ES3_compatibility)
+    const GLenum R11_EAC = 0x9270, SIGNED_R11_EAC = 0x9271, RG11_EAC = 0x9272, SIGNED_RG11_EAC = 0x9273;
+    const GLenum RGB8_ETC2 = 0x9274, SRGB8_ETC2 = 0x9275, RGB8_PUNCHTHROUGH_ALPHA1_ETC2 = 0x9276, SRGB8_PUNCHTHROUGH_ALPHA1_ETC2 = 0x9277;
+    const GLenum RGBA8_ETC2_EAC = 0x9278, SRGB8_ALPHA8_ETC2_EAC = 0x9279;
+
+    const unsigned char ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    // bytes per 4x4 block
+    size_t blockSize(GLenum format)
+    {
+        switch (format)
+        {
+        case RGB_S3TC_DXT1: case RGBA_S3TC_DXT1: case SRGB_S3TC_DXT1: case SRGB_ALPHA_S3TC_DXT1:
+        case RED_RGTC1: case SIGNED_RED_RGTC1:
+        case R11_EAC: case SIGNED_R11_EAC:
+        case RGB8_ETC2: case SRGB8_ETC2: case RGB8_PUNCHTHROUGH_ALPHA1_ETC2: case SRGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+            return 8;
+        default:
+            return 16;
+        }
+    }
+
+    // the VkFormat values KTX2 uses for block-compressed data
+    GLenum formatFromVulkan(uint32_t vkFormat)
+    {
+        switch (vkFormat)
+        {
+        case 131: return RGB_S3TC_DXT1;          // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+        case 132: return SRGB_S3TC_DXT1;
+        case 133: return RGBA_S3TC_DXT1;         // VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+        case 134: return SRGB_ALPHA_S3TC_DXT1;
+        case 135: return RGBA_S3TC_DXT3;         // VK_FORMAT_BC2_UNORM_BLOCK
+        case 136: return SRGB_ALPHA_S3TC_DXT3;
+        case 137: return RGBA_S3TC_DXT5;         // VK_FORMAT_BC3_UNORM_BLOCK
+        case 138: return SRGB_ALPHA_S3TC_DXT5;
+        case 139: return RED_RGTC1;              // VK_FORMAT_BC4_UNORM_BLOCK
+        case 140: return SIGNED_RED_RGTC1;
+        case 141: return RG_RGTC2;               // VK_FORMAT_BC5_UNORM_BLOCK
+        case 142: return SIGNED_RG_RGTC2;
+        case 143: return RGB_BPTC_UNSIGNED_FLOAT; // VK_FORMAT_BC6H_UFLOAT_BLOCK
+        case 144: return RGB_BPTC_SIGNED_FLOAT;
+        case 145: return RGBA_BPTC_UNORM;        // VK_FORMAT_BC7_UNORM_BLOCK
+        case 146: return SRGB_ALPHA_BPTC_UNORM;
+        case 147: return RGB8_ETC2;              // VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK
+        case 148: return SRGB8_ETC2;
+        case 149: return RGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+        case 150: return SRGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+        case 151: return RGBA8_ETC2_EAC;
+        case 152: return SRGB8_ALPHA8_ETC2_EAC;
+        case 153: return R11_EAC;                // VK_FORMAT_EAC_R11_UNORM_BLOCK
+        case 154: return SIGNED_R11_EAC;
+        case 155: return RG11_EAC;
+        case 156: return SIGNED_RG11_EAC;
+        default:  return 0;
+        }
+    }
+
+    // the DXGI_FORMAT values a DDS file with a DX10 header uses
+    GLenum formatFromDxgi(uint32_t dxgiFormat)
+    {
+        switch (dxgiFormat)
+        {
+        case 71: return RGBA_S3TC_DXT1;          // DXGI_FORMAT_BC1_UNORM
+        case 72: return SRGB_ALPHA_S3TC_DXT1;
+        case 74: return RGBA_S3TC_DXT3;          // DXGI_FORMAT_BC2_UNORM
+        case 75: return SRGB_ALPHA_S3TC_DXT3;
+        case 77: return RGBA_S3TC_DXT5;          // DXGI_FORMAT_BC3_UNORM
+        case 78: return SRGB_ALPHA_S3TC_DXT5;
+        case 80: return RED_RGTC1;               // DXGI_FORMAT_BC4_UNORM
+        case 81: return SIGNED_RED_RGTC1;
+        case 83: return RG_RGTC2;                // DXGI_FORMAT_BC5_UNORM
+        case 84: return SIGNED_RG_RGTC2;
+        case 95: return RGB_BPTC_UNSIGNED_FLOAT; // DXGI_FORMAT_BC6H_UF16
+        case 96: return RGB_BPTC_SIGNED_FLOAT;
+        case 98: return RGBA_BPTC_UNORM;         // DXGI_FORMAT_BC7_UNORM
+        case 99: return SRGB_ALPHA_BPTC_UNORM;
+        default: return 0;
+        }
+    }
+
+    // the FourCC codes of DDS files without a DX10 header
+    GLenum formatFromFourCC(const unsigned char* fourCC)
+    {
+        const struct { const char* code; GLenum format; } codes[] = {
+            { "DXT1", RGBA_S3TC_DXT1 }, { "DXT2", RGBA_S3TC_DXT3 }, { "DXT3", RGBA_S3TC_DXT3 },
+            { "DXT4", RGBA_S3TC_DXT5 }, { "DXT5", RGBA_S3TC_DXT5 },
+            { "ATI1", RED_RGTC1 }, { "BC4U", RED_RGTC1 }, { "BC4S", SIGNED_RED_RGTC1 },
+            { "ATI2", RG_RGTC2 }, { "BC5U", RG_RGTC2 }, { "BC5S", SIGNED_RG_RGTC2 },
+        };
+        for (const auto& code : codes)
+            if (memcmp(fourCC, code.code, 4) == 0)
+                return code.format;
+        return 0;
+    }
+
+    uint32_t read32(const unsigned char* p)
+    {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    uint64_t read64(const unsigned char* p)
+    {
+        return (uint64_t)read32(p) | ((uint64_t)read32(p + 4) << 32);
+    }
+
+    // a texture can't have more levels than it takes to halve the larger side down to 1
+    unsigned int maxLevels(int width, int height)
+    {
+        unsigned int levels = 1;
+        for (int size = std::max(width, height); size > 1; size >>= 1)
+            ++levels;
+        return levels;
+    }
+
+    bool loadKtx2(const unsigned char* file, size_t size, CompressedTexture& texture, std::string& error)
+    {
+        if (size < 80)
+        {
+            error = "KTX2 file is truncated";
+            return false;
+        }
+
+        const uint32_t vkFormat = read32(file + 12);
+        const uint32_t width = read32(file + 20), height = read32(file + 24), depth = read32(file + 28);
+        const uint32_t layers = read32(file + 32), faces = read32(file + 36);
+        const uint32_t levelCount = std::max<uint32_t>(read32(file + 40), 1); // 0 means "generate the mips", we upload just the one
+        const uint32_t supercompression = read32(file + 44);
+
+        if (supercompression != 0)
+        {
+            error = "supercompressed KTX2 (Basis, zstd) is not supported";
+            return false;
+        }
+        if (depth > 1 || layers > 1 || faces != 1)
+        {
+            error = "only 2D KTX2 textures are supported, no arrays, cube maps or 3D textures";
+            return false;
+        }
+        texture.format = formatFromVulkan(vkFormat);
+        if (texture.format == 0)
+        {
+            error = "KTX2 format " + std::to_string(vkFormat) + " is not a supported block-compressed format";
+            return false;
+        }
+        if (width == 0 || height == 0 || width > 65536 || height > 65536 || levelCount > maxLevels(width, height))
+        {
+            error = "KTX2 file has bad dimensions";
+            return false;
+        }
+        if (size < 80 + (size_t)levelCount * 24)
+        {
+            error = "KTX2 file is truncated";
+            return false;
+        }
+
+        texture.width = (int)width;
+        texture.height = (int)height;
+        for (uint32_t i = 0; i < levelCount; ++i)
+        {
+            const unsigned char* index = file + 80 + (size_t)i * 24;
+            const uint64_t offset = read64(index), length = read64(index + 8);
+            const int levelWidth = std::max(1, texture.width >> i), levelHeight = std::max(1, texture.height >> i);
+            const size_t expected = CompressedTexture::levelSize(texture.format, levelWidth, levelHeight);
+            if (length != expected || offset > size || length > size - offset)
+            {
+                error = "KTX2 level " + std::to_string(i) + " is damaged";
+                return false;
+            }
+            texture.levels.push_back({ texture.data.size(), expected, levelWidth, levelHeight });
+            texture.data.insert(texture.data.end(), file + offset, file + offset + length);
+        }
+        return true;
+    }
+
+    bool loadDds(const unsigned char* file, size_t size, CompressedTexture& texture, std::string& error)
+    {
+        if (size < 128 || read32(file + 4) != 124)
+        {
+            error = "DDS file is truncated or has a bad header";
+            return false;
+        }
+
+        const uint32_t flags = read32(file + 8);
+        const uint32_t height = read32(file + 12), width = read32(file + 16);
+        const uint32_t mipMapCount = read32(file + 28);
+        const uint32_t pixelFormatFlags = read32(file + 80);
+        const uint32_t caps2 = read32(file + 112);
+        size_t dataOffset = 128;
+
+        if (!(pixelFormatFlags & 0x4)) // DDPF_FOURCC
+        {
+            error = "uncompressed DDS is not supported";
+            return false;
+        }
+        if (caps2 & (0x200 | 0x200000)) // DDSCAPS2_CUBEMAP, DDSCAPS2_VOLUME
+        {
+            error = "only 2D DDS textures are supported, no cube maps or 3D textures";
+            return false;
+        }
+
+        if (memcmp(file + 84, "DX10", 4) == 0)
+        {
+            if (size < 148)
+            {
+                error = "DDS file is truncated";
+                return false;
+            }
+            const uint32_t dxgiFormat = read32(file + 128), dimension = read32(file + 132), arraySize = read32(file + 140);
+            if (dimension != 3 || arraySize > 1) // D3D10_RESOURCE_DIMENSION_TEXTURE2D
+            {
+                error = "only 2D DDS textures are supported, no arrays";
+                return false;
+            }
+            texture.format = formatFromDxgi(dxgiFormat);
+            dataOffset = 148;
+            if (texture.format == 0)
+            {
+                error = "DDS format " + std::to_string(dxgiFormat) + " is not a supported block-compressed format";
+                return false;
+            }
+        }
+        else
+        {
+            texture.format = formatFromFourCC(file + 84);
+            if (texture.format == 0)
+            {
+                error = "DDS FourCC " + std::string((const char*)file + 84, 4) + " is not a supported block-compressed format";
+                return false;
+            }
+        }
+
+        const uint32_t levelCount = (flags & 0x20000) && mipMapCount > 0 ? mipMapCount : 1; // DDSD_MIPMAPCOUNT
+        if (width == 0 || height == 0 || width > 65536 || height > 65536 || levelCount > maxLevels(width, height))
+        {
+            error = "DDS file has bad dimensions";
+            return false;
+        }
+
+        // the levels follow the header back to back, largest first
+        texture.width = (int)width;
+        texture.height = (int)height;
+        size_t offset = dataOffset;
+        for (uint32_t i = 0; i < levelCount; ++i)
+        {
+            const int levelWidth = std::max(1, texture.width >> i), levelHeight = std::max(1, texture.height >> i);
+            const size_t length = CompressedTexture::levelSize(texture.format, levelWidth, levelHeight);
+            if (length > size - offset)
+            {
+                error = "DDS file is truncated";
+                return false;
+            }
+            offset += length;
+        }
+        texture.data.assign(file + dataOffset, file + offset);
+        offset = 0;
+        for (uint32_t i = 0; i < levelCount; ++i)
+        {
+            const int levelWidth = std::max(1, texture.width >> i), levelHeight = std::max(1, texture.height >> i);
+            const size_t length = CompressedTexture::levelSize(texture.format, levelWidth, levelHeight);
+            texture.levels.push_back({ offset, length, levelWidth, levelHeight });
+            offset += length;
+        }
+        return true;
+    }
+}
+
+size_t CompressedTexture::levelSize(GLenum format, int width, int height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockSize(format);
+}
+
+bool CompressedTexture::isContainer(const unsigned char* file, size_t size)
+{
+    return (size >= 12 && memcmp(file, ktx2Identifier, 12) == 0)
+        || (size >= 4 && memcmp(file, "DDS ", 4) == 0);
+}
+
+bool CompressedTexture::load(const unsigned char* file, size_t size, CompressedTexture& texture, std::string& error)
+{
+    texture = CompressedTexture();
+    if (size >= 12 && memcmp(file, ktx2Identifier, 12) == 0)
+        return loadKtx2(file, size, texture, error);
+    if (size >= 4 && memcmp(file, "DDS ", 4) == 0)
+        return loadDds(file, size, texture, error);
+    error = "not a KTX2 or DDS file";
+    return false;
+}
+
+bool CompressedTexture::isSupported(GLenum format)
+{
+    // what the context offers, looked up once
+    static bool queried = false;
+    static int version = 0;
+    static std::unordered_set<std::string> extensions;
+    if (!queried)
+    {
+        GLint major = 0, minor = 0, count = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        version = major * 10 + minor;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i)
+            extensions.insert((const char*)glGetStringi(GL_EXTENSIONS, i));
+        queried = true;
+    }
+    auto has = [](const char* extension) { return extensions.count(extension) != 0; };
+
+    switch (format)
+    {
+    case RGB_S3TC_DXT1: case RGBA_S3TC_DXT1: case RGBA_S3TC_DXT3: case RGBA_S3TC_DXT5:
+        return has("GL_EXT_texture_compression_s3tc");
+    case SRGB_S3TC_DXT1: case SRGB_ALPHA_S3TC_DXT1: case SRGB_ALPHA_S3TC_DXT3: case SRGB_ALPHA_S3TC_DXT5:
+        return has("GL_EXT_texture_compression_s3tc") && (has("GL_EXT_texture_sRGB") || has("GL_EXT_texture_compression_s3tc_srgb"));
+    case RED_RGTC1: case SIGNED_RED_RGTC1: case RG_RGTC2: case SIGNED_RG_RGTC2:
+        return true;
+    case RGBA_BPTC_UNORM: case SRGB_ALPHA_BPTC_UNORM: case RGB_BPTC_SIGNED_FLOAT: case RGB_BPTC_UNSIGNED_FLOAT:
+        return version >= 42 || has("GL_ARB_texture_compression_bptc");
+    default: // ETC2/EAC
+        return version >= 43 || has("GL_ARB_ES3_compatibility");
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+
+// Block-compressed texture data read from a KTX2 or DDS file, for glCompressedTexImage2D.
+// Only the container is parsed: the blocks are kept the way the file stores them, with the mip levels the file has,
+// so nothing is decoded on the CPU and the texture takes a quarter to an eighth of the memory of raw RGBA.
+// Supported are 2D textures in BC1 to BC7 (S3TC, RGTC, BPTC) and, from KTX2, ETC2/EAC.
+class CompressedTexture
+{
+public:
+    struct Level
+    {
+        size_t offset;       // into data
+        size_t size;
+        int width, height;
+    };
+
+    GLenum format = 0;           // compressed internal format
+    int width = 0, height = 0;
+    std::vector<Level> levels;   // level 0 first
+    std::vector<unsigned char> data;
+
+    // true if the file starts like a KTX2 or DDS file
+    static bool isContainer(const unsigned char* file, size_t size);
+
+    // Reads a KTX2 or DDS file into texture. Returns false, with the reason in error,
+    // if it's damaged or not a 2D texture in one of the supported formats.
+    static bool load(const unsigned char* file, size_t size, CompressedTexture& texture, std::string& error);
+
+    // whether the current context can use format; call it on the GL thread
+    static bool isSupported(GLenum format);
+
+    // bytes of one width x height level in format
+    static size_t levelSize(GLenum format, int width, int height);
+};
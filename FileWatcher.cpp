@@ -0,0 +1,132 @@
+#include "FileWatcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // how often the modification times are compared when there is no inotify
+    const double scanInterval = 0.25;
+
+    std::string normalize(const std::filesystem::path& path)
+    {
+        return path.lexically_normal().generic_string();
+    }
+
+    std::filesystem::file_time_type modified(const std::string& path)
+    {
+        std::error_code error;
+        const std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+        return error ? std::filesystem::file_time_type::min() : time;
+    }
+
+    double now()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+FileWatcher::FileWatcher()
+{
+#ifdef __linux__
+    inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify < 0)
+        std::cout << "inotify isn't available, checking file times for changes instead" << std::endl;
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+    if (inotify >= 0)
+        close(inotify);
+#endif
+}
+
+void FileWatcher::watch(const std::string& path)
+{
+    const std::string normalized = normalize(path);
+    if (!files.emplace(normalized, modified(normalized)).second)
+        return;
+
+#ifdef __linux__
+    if (inotify < 0)
+        return;
+
+    // The directory is watched rather than the file: saving by rename replaces the file, and a watch on the old one
+    // would never hear of the new one. Watching a directory twice hands back the same watch.
+    std::string directory = std::filesystem::path(normalized).parent_path().generic_string();
+    if (directory.empty())
+        directory = ".";
+    const int watch = inotify_add_watch(inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watch < 0)
+        std::cout << "Can't watch " << directory << " for changes" << std::endl;
+    else
+        directories[watch] = directory;
+#endif
+}
+
+std::vector<std::string> FileWatcher::poll()
+{
+    std::vector<std::string> changed;
+    auto add = [&changed](const std::string& path)
+    {
+        if (std::find(changed.begin(), changed.end(), path) == changed.end())
+            changed.push_back(path);
+    };
+
+#ifdef __linux__
+    if (inotify >= 0)
+    {
+        alignas(inotify_event) char buffer[4096];
+        for (;;)
+        {
+            const ssize_t length = read(inotify, buffer, sizeof(buffer));
+            if (length <= 0)
+                break; // EAGAIN: nothing more to read
+
+            for (const char* at = buffer; at < buffer + length; at += sizeof(inotify_event) + ((const inotify_event*)at)->len)
+            {
+                const inotify_event* event = (const inotify_event*)at;
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    // events were lost, so anything may have changed
+                    for (const auto& file : files)
+                        add(file.first);
+                    continue;
+                }
+
+                auto directory = directories.find(event->wd);
+                if (event->len == 0 || directory == directories.end())
+                    continue;
+                const std::string path = normalize(std::filesystem::path(directory->second) / event->name);
+                if (files.count(path))
+                    add(path);
+            }
+        }
+        return changed;
+    }
+#endif
+
+    const double time = now();
+    if (time - lastScan < scanInterval)
+        return changed;
+    lastScan = time;
+
+    for (auto& file : files)
+    {
+        const std::filesystem::file_time_type written = modified(file.first);
+        if (written != file.second)
+        {
+            file.second = written;
+            add(file.first);
+        }
+    }
+    return changed;
+}
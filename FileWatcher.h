@@ -0,0 +1,36 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+
+// Tells which of a set of files changed on disk, for reloading assets while the app runs instead of restarting it.
+// On Linux it asks inotify to report writes to the files' directories, so checking costs one read() that usually
+// returns nothing. Editors that save by writing a new file and renaming it over the old one are caught as well.
+// Elsewhere, or when inotify can't be set up, it compares the files' modification times a few times a second.
+class FileWatcher
+{
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // starts watching the file at path; watching it twice does nothing
+    void watch(const std::string& path);
+
+    // Returns the watched files written to since the last call, each once, as they were passed to watch() but normalized.
+    // Never blocks.
+    std::vector<std::string> poll();
+
+private:
+    // normalized path -> modification time, for when there is no inotify
+    std::unordered_map<std::string, std::filesystem::file_time_type> files;
+    std::unordered_map<int, std::string> directories; // inotify watch -> the directory it watches
+    int inotify = -1;
+    double lastScan = 0.0;
+};
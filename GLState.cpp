@@ -0,0 +1,179 @@
+#include "GLState.h"
+
+namespace
+{
+    // a binding that isn't known, after invalidate(); no object has this name, so the next bind always goes through
+    const GLuint unknown = 0xFFFFFFFFu;
+
+    // units past this are rare, their binds are passed straight through
+    const GLuint maxUnits = 32;
+
+    const GLenum textureTargets[] = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_3D, GL_TEXTURE_1D };
+    const GLenum bufferTargets[] = {
+        GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_PIXEL_PACK_BUFFER,
+        GL_UNIFORM_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_TEXTURE_BUFFER,
+    };
+    const size_t textureTargetCount = sizeof(textureTargets) / sizeof(textureTargets[0]);
+    const size_t bufferTargetCount = sizeof(bufferTargets) / sizeof(bufferTargets[0]);
+
+    struct Shadow
+    {
+        GLuint program = unknown;
+        GLuint vertexArray = unknown;
+        GLuint activeUnit = unknown;
+        GLuint buffers[bufferTargetCount];
+        GLuint textures[maxUnits][textureTargetCount];
+        GLuint samplers[maxUnits];
+        GLState::Stats stats;
+
+        Shadow() { reset(); }
+
+        void reset()
+        {
+            program = vertexArray = activeUnit = unknown;
+            for (GLuint& buffer : buffers)
+                buffer = unknown;
+            for (auto& unit : textures)
+                for (GLuint& texture : unit)
+                    texture = unknown;
+            for (GLuint& sampler : samplers)
+                sampler = unknown;
+        }
+    };
+
+    Shadow shadow;
+
+    // index of target in the list, or -1 if it isn't tracked
+    template <size_t N>
+    int indexOf(const GLenum (&targets)[N], GLenum target)
+    {
+        for (size_t i = 0; i < N; ++i)
+            if (targets[i] == target)
+                return (int)i;
+        return -1;
+    }
+
+    // counts the call and tells whether it has to reach the driver, updating the shadow copy if so
+    bool change(GLuint& bound, GLuint object)
+    {
+        ++shadow.stats.calls;
+        if (bound == object)
+        {
+            ++shadow.stats.elided;
+            return false;
+        }
+        bound = object;
+        return true;
+    }
+
+    void forget(GLuint& bound, GLuint object)
+    {
+        // Deleting unbinds most objects, but a program stays in use until another one replaces it,
+        // so the binding becomes unknown rather than 0.
+        if (bound == object)
+            bound = unknown;
+    }
+}
+
+void GLState::useProgram(GLuint program)
+{
+    if (change(shadow.program, program))
+        glUseProgram(program);
+}
+
+void GLState::bindVertexArray(GLuint vertexArray)
+{
+    if (change(shadow.vertexArray, vertexArray))
+    {
+        glBindVertexArray(vertexArray);
+        // the element array buffer binding belongs to the vertex array, so it changed with it
+        shadow.buffers[indexOf(bufferTargets, GL_ELEMENT_ARRAY_BUFFER)] = unknown;
+    }
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+    const int index = indexOf(bufferTargets, target);
+    if (index < 0 || change(shadow.buffers[index], buffer))
+        glBindBuffer(target, buffer);
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+    const int index = indexOf(textureTargets, target);
+    if (unit >= maxUnits || index < 0)
+    {
+        activeTexture(unit);
+        glBindTexture(target, texture);
+        return;
+    }
+
+    if (change(shadow.textures[unit][index], texture))
+    {
+        activeTexture(unit);
+        glBindTexture(target, texture);
+    }
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture)
+{
+    if (shadow.activeUnit == unknown)
+        activeTexture(0);
+    bindTexture(shadow.activeUnit, target, texture);
+}
+
+void GLState::bindSampler(GLuint unit, GLuint sampler)
+{
+    if (unit >= maxUnits || change(shadow.samplers[unit], sampler))
+        glBindSampler(unit, sampler);
+}
+
+void GLState::activeTexture(GLuint unit)
+{
+    if (change(shadow.activeUnit, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLState::forgetProgram(GLuint program)
+{
+    forget(shadow.program, program);
+}
+
+void GLState::forgetVertexArray(GLuint vertexArray)
+{
+    forget(shadow.vertexArray, vertexArray);
+}
+
+void GLState::forgetBuffer(GLuint buffer)
+{
+    for (GLuint& bound : shadow.buffers)
+        forget(bound, buffer);
+}
+
+void GLState::forgetTexture(GLuint texture)
+{
+    for (auto& unit : shadow.textures)
+        for (GLuint& bound : unit)
+            forget(bound, texture);
+}
+
+void GLState::forgetSampler(GLuint sampler)
+{
+    for (GLuint& bound : shadow.samplers)
+        forget(bound, sampler);
+}
+
+void GLState::invalidate()
+{
+    shadow.reset();
+}
+
+GLState::Stats GLState::stats()
+{
+    return shadow.stats;
+}
+
+void GLState::resetStats()
+{
+    shadow.stats = Stats();
+}
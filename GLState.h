@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+
+#include <cstddef>
+
+
+
+// Shadows the OpenGL bindings that change most often (program, vertex array, buffers, texture units, samplers)
+// and skips the driver call when the object asked for is already bound. With many objects per frame the redundant
+// binds add up to a real share of the CPU frame time, since every GL call goes through the driver's validation.
+//
+// For the shadow copy to stay right, every bind of these kinds has to go through here, and objects have to be
+// forgotten when they're deleted, since a deleted name can be handed out again by the next glGen* call.
+// Code that binds behind its back (a library, for example) must call invalidate() afterwards.
+// There is one shadow copy, for the one context the app uses, and it may only be used on the GL thread.
+class GLState
+{
+public:
+    struct Stats
+    {
+        size_t calls = 0;      // binds asked for, active texture unit switches included
+        size_t elided = 0;     // of those, already bound, so never sent to the driver
+    };
+
+    static void useProgram(GLuint program);
+    static void bindVertexArray(GLuint vertexArray);
+    static void bindBuffer(GLenum target, GLuint buffer);
+    // binds texture to target on the given texture unit (GL_TEXTURE0 + unit), switching the active unit only when needed
+    static void bindTexture(GLuint unit, GLenum target, GLuint texture);
+    // binds texture to target on whatever unit is active, for setting it up rather than for drawing with it
+    static void bindTexture(GLenum target, GLuint texture);
+    static void bindSampler(GLuint unit, GLuint sampler);
+    static void activeTexture(GLuint unit);
+
+    // drop a deleted object from the shadow copy, so binding an object that gets its name later isn't skipped
+    static void forgetProgram(GLuint program);
+    static void forgetVertexArray(GLuint vertexArray);
+    static void forgetBuffer(GLuint buffer);
+    static void forgetTexture(GLuint texture);
+    static void forgetSampler(GLuint sampler);
+
+    // forgets every binding, so the next bind of each kind is sent to the driver whatever it is
+    static void invalidate();
+
+    static Stats stats();
+    static void resetStats();
+};
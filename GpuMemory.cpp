@@ -0,0 +1,65 @@
+#include "GpuMemory.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+namespace
+{
+    const size_t kindCount = 3;
+
+    struct Table
+    {
+        std::unordered_map<uint64_t, size_t> sizes; // kind and object name -> bytes
+        size_t totals[kindCount] = {};
+    };
+
+    Table table;
+
+    uint64_t keyOf(GpuMemory::Kind kind, GLuint object)
+    {
+        return (uint64_t)kind << 32 | object;
+    }
+}
+
+void GpuMemory::track(Kind kind, GLuint object, size_t bytes)
+{
+    size_t& size = table.sizes[keyOf(kind, object)];
+    table.totals[(size_t)kind] += bytes - size;
+    size = bytes;
+}
+
+void GpuMemory::forget(Kind kind, GLuint object)
+{
+    auto found = table.sizes.find(keyOf(kind, object));
+    if (found == table.sizes.end())
+        return;
+    table.totals[(size_t)kind] -= found->second;
+    table.sizes.erase(found);
+}
+
+size_t GpuMemory::usage()
+{
+    size_t total = 0;
+    for (size_t bytes : table.totals)
+        total += bytes;
+    return total;
+}
+
+size_t GpuMemory::usage(Kind kind)
+{
+    return table.totals[(size_t)kind];
+}
+
+size_t GpuMemory::textureBytes(int width, int height, int channels, bool mipmapped)
+{
+    const size_t texel = channels == 3 ? 4 : (size_t)channels;
+    size_t total = 0;
+    for (int w = width, h = height;; w = std::max(1, w / 2), h = std::max(1, h / 2))
+    {
+        total += (size_t)w * h * texel;
+        if (!mipmapped || (w == 1 && h == 1))
+            break;
+    }
+    return total;
+}
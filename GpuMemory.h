@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+
+#include <cstddef>
+
+
+
+// Keeps an estimate of the GPU memory held by the app's textures, buffers and renderbuffers.
+// OpenGL has no portable way to ask how much memory an object takes, so whoever allocates an object's storage
+// reports its size here (width x height x bytes per texel over every mip level, or the buffer size), and forgets the
+// object when it's deleted. The driver adds its own padding and alignment, so the real figure is somewhat higher.
+//
+// TextureManager compares the total with its memory budget to decide when to evict textures.
+// Like GLState, this is one global table for the app's one context, used on the GL thread only.
+class GpuMemory
+{
+public:
+    enum class Kind
+    {
+        Texture,
+        Buffer,
+        Renderbuffer
+    };
+
+    // records that object now holds bytes, replacing whatever was recorded for it before
+    static void track(Kind kind, GLuint object, size_t bytes);
+    // drops a deleted object
+    static void forget(Kind kind, GLuint object);
+
+    // bytes held by every tracked object, or by those of one kind
+    static size_t usage();
+    static size_t usage(Kind kind);
+
+    // The bytes of an uncompressed 8-bit texture with channels channels and every mip level from width x height down to 1x1,
+    // or only the first level if mipmapped is false. Three channel textures count as four, since that's how drivers store them.
+    static size_t textureBytes(int width, int height, int channels, bool mipmapped = true);
+};
@@ -0,0 +1,90 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    // the mapping keeps the file open by itself
+    CloseHandle(file);
+    if (!mapping)
+        return nullptr;
+
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view)
+    {
+        CloseHandle(mapping);
+        return nullptr;
+    }
+
+    // read the whole file in now, on this thread
+    WIN32_MEMORY_RANGE_ENTRY range = { (void*)view, (SIZE_T)size.QuadPart };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+
+    std::shared_ptr<MappedFile> mapped(new MappedFile());
+    mapped->bytes = (const unsigned char*)view;
+    mapped->length = (size_t)size.QuadPart;
+    mapped->mapping = mapping;
+    return mapped;
+}
+
+MappedFile::~MappedFile()
+{
+    UnmapViewOfFile(bytes);
+    CloseHandle(mapping);
+}
+
+#else
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat status;
+    void* view = MAP_FAILED;
+    if (fstat(fd, &status) == 0 && status.st_size > 0)
+    {
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        // read the whole file in now, on this thread
+        flags |= MAP_POPULATE;
+#endif
+        view = mmap(nullptr, (size_t)status.st_size, PROT_READ, flags, fd, 0);
+    }
+    // the mapping keeps the file open by itself
+    close(fd);
+    if (view == MAP_FAILED)
+        return nullptr;
+
+    std::shared_ptr<MappedFile> mapped(new MappedFile());
+    mapped->bytes = (const unsigned char*)view;
+    mapped->length = (size_t)status.st_size;
+    return mapped;
+}
+
+MappedFile::~MappedFile()
+{
+    munmap((void*)bytes, length);
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+
+
+// A whole file mapped read-only into memory, unmapped when the last reference goes.
+// The pages are read in when the file is opened (MAP_POPULATE, or a read-ahead hint on Windows), so the thread that opens it
+// pays for the disk and whoever reads the memory afterwards doesn't stall on page faults.
+class MappedFile
+{
+public:
+    // nullptr if the file doesn't exist, is empty or can't be mapped
+    static std::shared_ptr<MappedFile> open(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    MappedFile() = default;
+
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* mapping = nullptr;
+#endif
+};
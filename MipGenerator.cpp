@@ -0,0 +1,334 @@
+#include "MipGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPGENERATOR_SSE2
+#endif
+
+namespace
+{
+    const float pi = 3.14159265358979f;
+    const float kaiserRadius = 3.0f;   // in texels of the smaller level
+    const float kaiserAlpha = 4.0f;
+    const int linearToSrgbSize = 4096;
+
+    // Pixels are filtered as four floats, whatever the image's channel count, so one pixel is one SSE register.
+#ifdef MIPGENERATOR_SSE2
+    typedef __m128 Vec4;
+    inline Vec4 zero4() { return _mm_setzero_ps(); }
+    inline Vec4 load4(const float* p) { return _mm_loadu_ps(p); }
+    inline void store4(float* p, Vec4 v) { _mm_storeu_ps(p, v); }
+    inline Vec4 multiplyAdd(Vec4 sum, float weight, Vec4 v) { return _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weight), v)); }
+#else
+    struct Vec4 { float v[4]; };
+    inline Vec4 zero4() { return Vec4{ { 0.0f, 0.0f, 0.0f, 0.0f } }; }
+    inline Vec4 load4(const float* p) { return Vec4{ { p[0], p[1], p[2], p[3] } }; }
+    inline void store4(float* p, Vec4 v) { memcpy(p, v.v, sizeof(v.v)); }
+    inline Vec4 multiplyAdd(Vec4 sum, float weight, Vec4 v)
+    {
+        for (int i = 0; i < 4; ++i)
+            sum.v[i] += weight * v.v[i];
+        return sum;
+    }
+#endif
+
+    // which source texels, with which weights, make up each texel of the smaller level along one axis
+    struct Kernel
+    {
+        std::vector<int> first;     // per output texel, into index and weight
+        std::vector<int> count;
+        std::vector<int> index;     // source texel, edge handling already applied
+        std::vector<float> weight;
+        int widest = 0;
+    };
+
+    float sinc(float x)
+    {
+        return std::fabs(x) < 1e-6f ? 1.0f : std::sin(pi * x) / (pi * x);
+    }
+
+    // modified Bessel function of the first kind, order 0, by its series
+    float besselI0(float x)
+    {
+        float sum = 1.0f, term = 1.0f;
+        for (int k = 1; k < 20; ++k)
+        {
+            term *= (x / (2.0f * k)) * (x / (2.0f * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    float kaiser(float x)
+    {
+        const float t = x / kaiserRadius;
+        if (std::fabs(t) >= 1.0f)
+            return 0.0f;
+        return sinc(x) * besselI0(kaiserAlpha * std::sqrt(1.0f - t * t)) / besselI0(kaiserAlpha);
+    }
+
+    Kernel makeKernel(int sourceSize, int size, MipGenerator::Filter filter, bool wrap)
+    {
+        Kernel kernel;
+        const float scale = (float)sourceSize / size;
+        for (int x = 0; x < size; ++x)
+        {
+            const float center = (x + 0.5f) * scale;
+            const float radius = filter == MipGenerator::Filter::Box ? scale * 0.5f : kaiserRadius * scale;
+            const int begin = (int)std::floor(center - radius), end = (int)std::ceil(center + radius);
+
+            const size_t first = kernel.weight.size();
+            float total = 0.0f;
+            for (int i = begin; i < end; ++i)
+            {
+                float weight;
+                if (filter == MipGenerator::Filter::Box)
+                    weight = std::min((float)i + 1.0f, center + radius) - std::max((float)i, center - radius); // overlap with the footprint
+                else
+                    weight = kaiser((i + 0.5f - center) / scale);
+                if (weight == 0.0f)
+                    continue;
+
+                int source = i;
+                if (wrap)
+                    source = ((source % sourceSize) + sourceSize) % sourceSize;
+                else
+                    source = std::min(std::max(source, 0), sourceSize - 1);
+                kernel.index.push_back(source);
+                kernel.weight.push_back(weight);
+                total += weight;
+            }
+            for (size_t i = first; i < kernel.weight.size(); ++i)
+                kernel.weight[i] /= total;
+
+            kernel.first.push_back((int)first);
+            kernel.count.push_back((int)(kernel.weight.size() - first));
+            kernel.widest = std::max(kernel.widest, kernel.count.back());
+        }
+        return kernel;
+    }
+
+    struct Tables
+    {
+        float byteToFloat[256];
+        float srgbToLinear[256];
+        unsigned char linearToSrgb[linearToSrgbSize + 1];
+
+        Tables()
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                const float c = i / 255.0f;
+                byteToFloat[i] = c;
+                srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            for (int i = 0; i <= linearToSrgbSize; ++i)
+            {
+                const float c = (float)i / linearToSrgbSize;
+                const float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+                linearToSrgb[i] = (unsigned char)std::lround(s * 255.0f);
+            }
+        }
+    };
+
+    const Tables& tables()
+    {
+        static const Tables instance;
+        return instance;
+    }
+
+    // one row of 8-bit pixels to four floats each, linear and premultiplied
+    void decodeRow(const unsigned char* row, int width, int channels, bool srgb, float* out)
+    {
+        const Tables& t = tables();
+        const float* color = srgb ? t.srgbToLinear : t.byteToFloat;
+        switch (channels)
+        {
+        case 1:
+            for (int x = 0; x < width; ++x, row += 1, out += 4)
+            {
+                out[0] = t.byteToFloat[row[0]];
+                out[1] = out[2] = 0.0f;
+                out[3] = 1.0f;
+            }
+            break;
+        case 2:
+            for (int x = 0; x < width; ++x, row += 2, out += 4)
+            {
+                out[0] = t.byteToFloat[row[0]];
+                out[1] = t.byteToFloat[row[1]];
+                out[2] = 0.0f;
+                out[3] = 1.0f;
+            }
+            break;
+        case 3:
+            for (int x = 0; x < width; ++x, row += 3, out += 4)
+            {
+                out[0] = color[row[0]];
+                out[1] = color[row[1]];
+                out[2] = color[row[2]];
+                out[3] = 1.0f;
+            }
+            break;
+        default:
+            for (int x = 0; x < width; ++x, row += 4, out += 4)
+            {
+                const float alpha = t.byteToFloat[row[3]];
+                out[0] = color[row[0]] * alpha;
+                out[1] = color[row[1]] * alpha;
+                out[2] = color[row[2]] * alpha;
+                out[3] = alpha;
+            }
+            break;
+        }
+    }
+
+    unsigned char toByte(float v)
+    {
+        // the Kaiser filter's negative lobes can overshoot
+        return (unsigned char)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+
+    unsigned char toSrgb(float v)
+    {
+        return tables().linearToSrgb[(int)(std::min(std::max(v, 0.0f), 1.0f) * linearToSrgbSize + 0.5f)];
+    }
+
+    void encodeRow(const float* row, int width, int channels, bool srgb, unsigned char* out)
+    {
+        for (int x = 0; x < width; ++x, row += 4, out += channels)
+        {
+            if (channels < 3)
+            {
+                out[0] = toByte(row[0]);
+                if (channels == 2)
+                    out[1] = toByte(row[1]);
+                continue;
+            }
+
+            float scale = 1.0f;
+            if (channels == 4)
+            {
+                const float alpha = row[3];
+                out[3] = toByte(alpha);
+                scale = alpha > 0.0f ? 1.0f / alpha : 0.0f;
+            }
+            for (int c = 0; c < 3; ++c)
+                out[c] = srgb ? toSrgb(row[c] * scale) : toByte(row[c] * scale);
+        }
+    }
+
+    // filters source down to width x height, horizontally into a ring of rows and then vertically out of it
+    void downsample(const unsigned char* source, int sourceWidth, int sourceHeight, int channels, const MipGenerator::Options& options,
+        unsigned char* out, int width, int height)
+    {
+        const Kernel horizontal = makeKernel(sourceWidth, width, options.filter, options.wrap);
+        const Kernel vertical = makeKernel(sourceHeight, height, options.filter, options.wrap);
+        const bool srgb = options.srgb && channels >= 3;
+
+        // neighbouring output rows share most of their source rows, so each filtered row is kept while it's needed
+        const int ringSize = vertical.widest;
+        std::vector<float> ring((size_t)ringSize * width * 4);
+        std::vector<int> ringRow(ringSize, -1);
+        std::vector<float> decoded((size_t)sourceWidth * 4);
+        std::vector<float> row((size_t)width * 4);
+
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+                store4(&row[(size_t)x * 4], zero4());
+
+            for (int tap = 0; tap < vertical.count[y]; ++tap)
+            {
+                const int sourceRow = vertical.index[vertical.first[y] + tap];
+                const float rowWeight = vertical.weight[vertical.first[y] + tap];
+                float* filtered = &ring[(size_t)(sourceRow % ringSize) * width * 4];
+                if (ringRow[sourceRow % ringSize] != sourceRow)
+                {
+                    decodeRow(source + (size_t)sourceRow * sourceWidth * channels, sourceWidth, channels, srgb, decoded.data());
+                    for (int x = 0; x < width; ++x)
+                    {
+                        Vec4 sum = zero4();
+                        for (int i = horizontal.first[x], end = i + horizontal.count[x]; i < end; ++i)
+                            sum = multiplyAdd(sum, horizontal.weight[i], load4(&decoded[(size_t)horizontal.index[i] * 4]));
+                        store4(filtered + (size_t)x * 4, sum);
+                    }
+                    ringRow[sourceRow % ringSize] = sourceRow;
+                }
+
+                for (int x = 0; x < width; ++x)
+                    store4(&row[(size_t)x * 4], multiplyAdd(load4(&row[(size_t)x * 4]), rowWeight, load4(filtered + (size_t)x * 4)));
+            }
+
+            encodeRow(row.data(), width, channels, srgb, out + (size_t)y * width * channels);
+        }
+    }
+
+    // share of the texels whose alpha, times scale, passes the cutoff
+    float coverage(const unsigned char* pixels, size_t count, float scale, float cutoff)
+    {
+        size_t passing = 0;
+        for (size_t i = 0; i < count; ++i)
+            passing += pixels[i * 4 + 3] * scale > cutoff * 255.0f;
+        return (float)passing / count;
+    }
+
+    // scales the level's alpha so its coverage matches target, found by bisection since coverage only grows with the scale
+    void preserveCoverage(unsigned char* pixels, size_t count, float cutoff, float target)
+    {
+        float low = 0.0f, high = 4.0f;
+        for (int step = 0; step < 12; ++step)
+        {
+            const float middle = (low + high) * 0.5f;
+            if (coverage(pixels, count, middle, cutoff) < target)
+                low = middle;
+            else
+                high = middle;
+        }
+        const float scale = high;
+        for (size_t i = 0; i < count; ++i)
+            pixels[i * 4 + 3] = (unsigned char)std::min(pixels[i * 4 + 3] * scale + 0.5f, 255.0f);
+    }
+}
+
+void MipGenerator::generate(const unsigned char* pixels, int width, int height, int channels, const Options& options, MipChain& chain)
+{
+    chain = MipChain();
+    chain.channels = channels;
+
+    // every level's size first, so the data is allocated once
+    size_t total = 0;
+    for (int w = width, h = height;; w = std::max(1, w / 2), h = std::max(1, h / 2))
+    {
+        const size_t size = (size_t)w * h * channels;
+        chain.levels.push_back({ total, size, w, h });
+        total += size;
+        if (w == 1 && h == 1)
+            break;
+    }
+    chain.data.resize(total);
+    memcpy(chain.data.data(), pixels, chain.levels[0].size);
+
+    const bool keepCoverage = channels == 4 && options.alphaCutoff > 0.0f && options.alphaCutoff < 1.0f;
+    const float target = keepCoverage ? coverage(pixels, (size_t)width * height, 1.0f, options.alphaCutoff) : 0.0f;
+
+    for (size_t i = 1; i < chain.levels.size(); ++i)
+    {
+        const MipChain::Level& above = chain.levels[i - 1];
+        const MipChain::Level& level = chain.levels[i];
+        downsample(chain.data.data() + above.offset, above.width, above.height, channels, options,
+            chain.data.data() + level.offset, level.width, level.height);
+        // the level above is scaled only now, so each level is filtered from unscaled alpha and the scales don't compound
+        if (keepCoverage && i > 1)
+            preserveCoverage(chain.data.data() + above.offset, (size_t)above.width * above.height, options.alphaCutoff, target);
+    }
+    if (keepCoverage && chain.levels.size() > 1)
+    {
+        const MipChain::Level& last = chain.levels.back();
+        preserveCoverage(chain.data.data() + last.offset, (size_t)last.width * last.height, options.alphaCutoff, target);
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+
+// A texture's mip levels, level 0 first, each tightly packed with channels bytes per pixel.
+struct MipChain
+{
+    struct Level
+    {
+        size_t offset;       // into data
+        size_t size;
+        int width, height;
+    };
+
+    int channels = 4;
+    std::vector<Level> levels;
+    std::vector<unsigned char> data;
+};
+
+// Builds mip chains on the CPU, so the loader threads can make them instead of glGenerateMipmap on the GL thread,
+// whose filter quality and cost depend on the driver.
+// Each level is filtered from the one above it in floating point: separable, with SSE2 where the compiler targets it.
+// 4 channel images are filtered with premultiplied alpha, so fully transparent texels don't bleed their color into the smaller levels.
+class MipGenerator
+{
+public:
+    enum class Filter
+    {
+        Box,        // average of the texels each smaller texel covers; fast, a bit blurry and a bit aliased
+        Kaiser      // Kaiser windowed sinc; keeps the smaller levels sharper, in about twice the time of Box
+    };
+
+    struct Options
+    {
+        Filter filter = Filter::Box;
+        // The color channels of 3 and 4 channel images are sRGB encoded, as photos and painted textures are,
+        // so they're averaged in linear light. Otherwise dark and bright detail changes the brightness of distant surfaces.
+        bool srgb = false;
+        // Alpha tested textures (foliage, fences) thin out in the smaller levels, because averaging pulls alpha below the test.
+        // With a cutoff in (0, 1), each level's alpha is scaled so the same share of texels passes alpha > cutoff as in level 0.
+        float alphaCutoff = 0.0f;
+        // sample across the edges as if the image repeats, for GL_REPEAT textures; otherwise the edge texels repeat
+        bool wrap = true;
+    };
+
+    // Builds the whole chain for a width x height image with channels (1 to 4) bytes per pixel, from level 0 down to 1x1.
+    static void generate(const unsigned char* pixels, int width, int height, int channels, const Options& options, MipChain& chain);
+};
@@ -1,10 +1,222 @@
 #include "Shader.h"
+#include "GLState.h"
+
+#include <cstdio>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+// glGetProgramBinary and glProgramBinary are only declared when glad was generated with GL 4.1 or ARB_get_program_binary
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+#define SHADER_PROGRAM_BINARY
+#endif
+
+// likewise for glMaxShaderCompilerThreadsKHR and GL_COMPLETION_STATUS_KHR
+#if defined(GL_KHR_parallel_shader_compile) || defined(GL_ARB_parallel_shader_compile)
+#define SHADER_PARALLEL_COMPILE
+#endif
+
+namespace
+{
+    // "SPB1" followed by the format version, bumped whenever what a file holds changes
+    const uint32_t magic = 0x31425053u;
+    const uint32_t version = 1;
+
+    // magic, version, key (8 bytes), binary format, binary length
+    const size_t headerSize = 24;
+
+    // 64-bit FNV-1a, continuing from hash
+    uint64_t hashOf(const std::string& text, uint64_t hash)
+    {
+        for (unsigned char c : text)
+            hash = (hash ^ c) * 1099511628211ull;
+        // the length too, so "ab" + "c" and "a" + "bc" differ
+        return (hash ^ text.size()) * 1099511628211ull;
+    }
+
+#ifdef SHADER_PROGRAM_BINARY
+    bool hasProgramBinary()
+    {
+        bool available = false;
+#ifdef GL_VERSION_4_1
+        available = available || GLAD_GL_VERSION_4_1;
+#endif
+#ifdef GL_ARB_get_program_binary
+        available = available || GLAD_GL_ARB_get_program_binary;
+#endif
+        // a driver may have the functions and still offer no format to save in
+        GLint formats = 0;
+        if (available)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+#endif
+
+    // the KHR and ARB extensions give it the same value
+#ifdef GL_KHR_parallel_shader_compile
+    const GLenum completionStatus = GL_COMPLETION_STATUS_KHR;
+#elif defined(GL_ARB_parallel_shader_compile)
+    const GLenum completionStatus = GL_COMPLETION_STATUS_ARB;
+#endif
+
+#ifdef SHADER_PARALLEL_COMPILE
+    bool hasParallelCompile()
+    {
+#ifdef GL_KHR_parallel_shader_compile
+        if (GLAD_GL_KHR_parallel_shader_compile)
+            return true;
+#endif
+#ifdef GL_ARB_parallel_shader_compile
+        if (GLAD_GL_ARB_parallel_shader_compile)
+            return true;
+#endif
+        return false;
+    }
+#endif
+
+    // lets the driver use as many compiler threads as it likes (0xFFFFFFFF asks for its own maximum)
+    void allowCompilerThreads()
+    {
+#ifdef GL_KHR_parallel_shader_compile
+        if (GLAD_GL_KHR_parallel_shader_compile)
+        {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+            return;
+        }
+#endif
+#ifdef GL_ARB_parallel_shader_compile
+        if (GLAD_GL_ARB_parallel_shader_compile)
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+#endif
+    }
+
+    // whether the driver has finished linking program, asked without waiting for it
+    bool isComplete(unsigned int program)
+    {
+#ifdef SHADER_PARALLEL_COMPILE
+        if (hasParallelCompile())
+        {
+            GLint complete;
+            glGetProgramiv(program, completionStatus, &complete);
+            return complete == GL_TRUE;
+        }
+#else
+        (void)program;
+#endif
+        // without the extension there is no asking; the status queries afterwards wait instead
+        return true;
+    }
+}
+
+std::string Shader::cacheDirectory;
 
 Shader::Shader(const char* vertexPath, const char* fragmentPath)
+    : vertexPath(vertexPath), fragmentPath(fragmentPath)
 {
     // 1. retrieve the vertex/fragment source code from filePath
     std::string vertexCode;
     std::string fragmentCode;
+    readSources(vertexCode, fragmentCode);
+
+    // a program linked from these sources before, on this driver, needs no compiling
+    const uint64_t key = keyOf(vertexCode, fragmentCode);
+    ID = loadBinary(key);
+    if (ID != 0)
+    {
+        cacheLocations();
+        return;
+    }
+
+    // 2. compile shaders and link them into the program
+    unsigned int vertex, fragment;
+    ID = build(vertexCode, fragmentCode, vertex, fragment);
+
+    finishBuild(vertex, fragment, key);
+}
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath, Unbuilt)
+    : ID(0), vertexPath(vertexPath), fragmentPath(fragmentPath)
+{
+}
+
+std::vector<Shader> Shader::buildAll(const std::vector<Sources>& programs)
+{
+    allowCompilerThreads();
+    std::vector<Shader> shaders;
+    shaders.reserve(programs.size());
+    // each program's shaders, 0 for a program that came from the binary cache
+    std::vector<unsigned int> vertices(programs.size(), 0), fragments(programs.size(), 0);
+    std::vector<uint64_t> keys(programs.size());
+
+    // 1. hand every program to the driver without asking about any of them
+    for (size_t i = 0; i < programs.size(); ++i)
+    {
+        shaders.push_back(Shader(programs[i].vertexPath, programs[i].fragmentPath, Unbuilt()));
+        Shader& shader = shaders.back();
+        std::string vertexCode;
+        std::string fragmentCode;
+        shader.readSources(vertexCode, fragmentCode);
+        keys[i] = keyOf(vertexCode, fragmentCode);
+        shader.ID = loadBinary(keys[i]);
+        if (shader.ID == 0)
+            shader.ID = build(vertexCode, fragmentCode, vertices[i], fragments[i]);
+    }
+
+    // 2. wait until the compiler threads are through with all of them
+    for (;;)
+    {
+        bool complete = true;
+        for (size_t i = 0; i < shaders.size() && complete; ++i)
+            complete = vertices[i] == 0 || isComplete(shaders[i].ID);
+        if (complete)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // 3. only now collect the logs, which no longer waits on anything
+    for (size_t i = 0; i < shaders.size(); ++i)
+    {
+        if (vertices[i] == 0)
+            shaders[i].cacheLocations();
+        else
+            shaders[i].finishBuild(vertices[i], fragments[i], keys[i]);
+    }
+    return shaders;
+}
+
+// Reports how compiling and linking went, and caches what there is to cache of the program.
+void Shader::finishBuild(unsigned int vertex, unsigned int fragment, uint64_t key)
+{
+    // Error checking of the compilation and linking.
+    checkError(vertex, GL_VERTEX_SHADER);
+    checkError(fragment, GL_FRAGMENT_SHADER);
+    checkError(ID, GL_LINK_STATUS);
+    cacheLocations();
+    saveBinary(ID, key);
+
+    // Delete the shaders as they're linked into our program now and no longer necessary
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+}
+
+void Shader::setCacheDirectory(const std::string& directory)
+{
+    cacheDirectory.clear();
+    if (directory.empty())
+        return;
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+        std::cout << "ERROR::SHADER::CACHE_DIRECTORY_UNUSABLE " << directory << ": " << error.message() << std::endl;
+    else
+        cacheDirectory = directory;
+}
+
+bool Shader::readSources(std::string& vertexCode, std::string& fragmentCode) const
+{
     std::ifstream vShaderFile;
     std::ifstream fShaderFile;
     // ensure ifstream objects can throw exceptions:
@@ -30,62 +242,193 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
     catch (std::ifstream::failure e)
     {
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+        return false;
     }
+    return true;
+}
 
+// Compiles both shaders and links the program without asking how it went, so nothing here waits for the compiler.
+unsigned int Shader::build(const std::string& vertexCode, const std::string& fragmentCode, unsigned int& vertex, unsigned int& fragment)
+{
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
 
-    // 2. compile shaders
-    unsigned int vertex, fragment;
-
     // vertex Shader
     vertex = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertex, 1, &vShaderCode, NULL);
     glCompileShader(vertex);
 
-    // Error checking of the vertex shader compilation.
-    checkError(vertex, GL_VERTEX_SHADER);
-
     //Fragment Shader
     fragment = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fragment, 1, &fShaderCode, NULL);
     glCompileShader(fragment);
 
-    // Error checking of the fragment shader compilation.
-    checkError(fragment, GL_FRAGMENT_SHADER);
-
     // shader Program
-    ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
-    glLinkProgram(ID);
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+#ifdef SHADER_PROGRAM_BINARY
+    // asked for before linking, so the driver keeps what glGetProgramBinary needs
+    if (!cacheDirectory.empty() && hasProgramBinary())
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+    glLinkProgram(program);
+    return program;
+}
 
-    // Error checking for the linking process of the shader program.
-    checkError(ID, GL_LINK_STATUS);
+void Shader::watch()
+{
+    if (watcher)
+        return;
+    watcher.reset(new FileWatcher());
+    watcher->watch(vertexPath);
+    watcher->watch(fragmentPath);
+}
 
-    // Delete the shaders as they're linked into our program now and no longer necessary
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+bool Shader::update()
+{
+    if (!watcher)
+        return false;
+
+    if (!watcher->poll().empty())
+    {
+        // a newer save replaces a rebuild that hasn't been checked yet
+        discardPending();
+        std::string vertexCode;
+        std::string fragmentCode;
+        if (readSources(vertexCode, fragmentCode))
+        {
+            pendingKey = keyOf(vertexCode, fragmentCode);
+            pendingID = build(vertexCode, fragmentCode, pendingVertex, pendingFragment);
+        }
+        return false;
+    }
+    // with KHR_parallel_shader_compile the driver can tell whether it's done, so a slow build isn't waited for
+    if (pendingID == 0 || !isComplete(pendingID))
+        return false;
+
+    GLint linked;
+    glGetProgramiv(pendingID, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        checkError(pendingVertex, GL_VERTEX_SHADER);
+        checkError(pendingFragment, GL_FRAGMENT_SHADER);
+        checkError(pendingID, GL_LINK_STATUS);
+        std::cout << "Keeping the last working shader program" << std::endl;
+        discardPending();
+        return false;
+    }
+
+    // swap between frames, so no draw ever sees half of the change
+    glDeleteProgram(ID);
+    GLState::forgetProgram(ID);
+    ID = pendingID;
+    pendingID = 0;
+    discardPending();
+    cacheLocations();
+    saveBinary(ID, pendingKey);
+    std::cout << "Reloaded shader program " << vertexPath << ", " << fragmentPath << std::endl;
+    return true;
+}
+
+void Shader::discardPending()
+{
+    glDeleteShader(pendingVertex);
+    glDeleteShader(pendingFragment);
+    glDeleteProgram(pendingID);
+    pendingVertex = pendingFragment = pendingID = 0;
 }
 
 void Shader::use() const
 {
-    glUseProgram(ID);
+    GLState::useProgram(ID);
 }
 
 void Shader::setBool(const std::string& name, bool value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    setBool(uniformID(name.c_str()), value);
 }
 
 void Shader::setInt(const std::string& name, int value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    setInt(uniformID(name.c_str()), value);
 }
 
 void Shader::setFloat(const std::string& name, float value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    setFloat(uniformID(name.c_str()), value);
+}
+
+// a location of -1 is silently ignored by glUniform*, so a missing uniform is no error, as with glGetUniformLocation
+void Shader::setBool(UniformID id, bool value) const
+{
+    glUniform1i(location(id), (int)value);
+}
+
+void Shader::setInt(UniformID id, int value) const
+{
+    glUniform1i(location(id), value);
+}
+
+void Shader::setFloat(UniformID id, float value) const
+{
+    glUniform1f(location(id), value);
+}
+
+GLint Shader::location(UniformID id) const
+{
+    auto found = locations.find(id.hash);
+    return found == locations.end() ? -1 : found->second;
+}
+
+// Asks the linked program for every active uniform once, so the setters never have to.
+void Shader::cacheLocations()
+{
+    locations.clear();
+    GLint linked, count, maxLength;
+    glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+    if (!linked)
+        return;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::unordered_map<uint32_t, std::string> names; // to catch two names with the same hash
+    std::string name(maxLength > 0 ? maxLength : 1, '\0');
+    for (GLint i = 0; i < count; ++i)
+    {
+        GLsizei length;
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(ID, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+        const std::string uniform = name.substr(0, length);
+        // members of uniform blocks have no location
+        const GLint at = glGetUniformLocation(ID, uniform.c_str());
+        if (at < 0)
+            continue;
+
+        // arrays are listed once, as "name[0]", and are set through "name" just as well; every other element gets
+        // its own entry too, asked for by name since GL doesn't promise the elements consecutive locations
+        std::vector<std::pair<std::string, GLint>> aliases = { { uniform, at } };
+        if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0)
+        {
+            const std::string array = uniform.substr(0, uniform.size() - 3);
+            aliases.push_back({ array, at });
+            for (GLint element = 1; element < size; ++element)
+            {
+                const std::string elementName = array + "[" + std::to_string(element) + "]";
+                aliases.push_back({ elementName, glGetUniformLocation(ID, elementName.c_str()) });
+            }
+        }
+        for (const auto& alias : aliases)
+        {
+            const uint32_t hash = uniformID(alias.first.c_str()).hash;
+            auto clash = names.find(hash);
+            if (clash != names.end() && clash->second != alias.first)
+                std::cout << "ERROR::SHADER::UNIFORM_ID_CLASH " << alias.first << " and " << clash->second << " hash alike, rename one" << std::endl;
+            names[hash] = alias.first;
+            locations[hash] = alias.second;
+        }
+    }
 }
 
 void Shader::checkError(unsigned int ID, GLenum type)
@@ -121,3 +464,112 @@ void Shader::checkError(unsigned int ID, GLenum type)
         }
     }
 }
+
+// The sources, and the driver, since a binary only loads on the driver version that wrote it.
+uint64_t Shader::keyOf(const std::string& vertexCode, const std::string& fragmentCode)
+{
+    uint64_t key = 14695981039346656037ull;
+    key = hashOf(vertexCode, key);
+    key = hashOf(fragmentCode, key);
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+    {
+        const GLubyte* value = glGetString(name);
+        key = hashOf(value ? (const char*)value : "", key);
+    }
+    return key;
+}
+
+std::string Shader::pathOf(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.program", (unsigned long long)key);
+    return (std::filesystem::path(cacheDirectory) / name).generic_string();
+}
+
+// Returns the cached program for key, linked and ready, or 0 if there is none or the driver won't take it.
+unsigned int Shader::loadBinary(uint64_t key)
+{
+#ifdef SHADER_PROGRAM_BINARY
+    if (cacheDirectory.empty() || !hasProgramBinary())
+        return 0;
+
+    std::ifstream file(pathOf(key), std::ios::binary);
+    unsigned char header[headerSize];
+    if (!file.read((char*)header, sizeof(header)))
+        return 0;
+    uint32_t fileMagic, fileVersion, format, length;
+    uint64_t fileKey;
+    memcpy(&fileMagic, header, 4);
+    memcpy(&fileVersion, header + 4, 4);
+    memcpy(&fileKey, header + 8, 8);
+    memcpy(&format, header + 16, 4);
+    memcpy(&length, header + 20, 4);
+    if (fileMagic != magic || fileVersion != version || fileKey != key || length == 0)
+        return 0;
+    std::vector<char> binary(length);
+    if (!file.read(binary.data(), length))
+        return 0;
+
+    unsigned int program = glCreateProgram();
+    glProgramBinary(program, format, binary.data(), (GLsizei)length);
+    GLint linked;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        // the driver changed in a way the key can't see; compiling again overwrites the file
+        std::cout << "Cached shader program " << pathOf(key) << " was rejected, compiling it again" << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+#else
+    (void)key;
+    return 0;
+#endif
+}
+
+// Writes the linked program's binary for later runs, under a temporary name first so a reader never sees half of it.
+void Shader::saveBinary(unsigned int program, uint64_t key)
+{
+#ifdef SHADER_PROGRAM_BINARY
+    if (cacheDirectory.empty() || !hasProgramBinary())
+        return;
+
+    GLint linked, length = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked)
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector<char> binary(headerSize + length);
+    GLenum format;
+    glGetProgramBinary(program, length, &length, &format, binary.data() + headerSize);
+    const uint32_t format32 = format, length32 = (uint32_t)length;
+    memcpy(binary.data(), &magic, 4);
+    memcpy(binary.data() + 4, &version, 4);
+    memcpy(binary.data() + 8, &key, 8);
+    memcpy(binary.data() + 16, &format32, 4);
+    memcpy(binary.data() + 20, &length32, 4);
+
+    const std::string path = pathOf(key);
+    std::ostringstream temporary;
+    temporary << path << "." << std::this_thread::get_id() << ".tmp";
+    {
+        std::ofstream file(temporary.str(), std::ios::binary | std::ios::trunc);
+        if (!file.write(binary.data(), (std::streamsize)(headerSize + length)))
+        {
+            file.close();
+            std::remove(temporary.str().c_str());
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary.str(), path, error);
+    if (error)
+        std::filesystem::remove(temporary.str(), error);
+#else
+    (void)program;
+    (void)key;
+#endif
+}
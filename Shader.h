@@ -1,11 +1,34 @@
 #pragma once
 
 #include <glad/glad.h> // include glad to get all the required OpenGL headers
+#include "FileWatcher.h"
 
+#include <cstdint>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+
+
+// A uniform's name hashed with 32-bit FNV-1a, so the shader finds its location without a string or a driver call.
+// uniformID is constexpr: write constexpr UniformID textureID = uniformID("texture1"); and the hash is computed
+// by the compiler.
+struct UniformID
+{
+    uint32_t hash;
+};
+
+constexpr UniformID uniformID(const char* name)
+{
+    uint32_t hash = 2166136261u;
+    for (; *name; ++name)
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    return UniformID{ hash };
+}
 
 
 
@@ -17,12 +40,73 @@ public:
 
     // constructor reads and builds the shader
     Shader(const char* vertexPath, const char* fragmentPath);
+
+    // one program's source files, for buildAll
+    struct Sources
+    {
+        const char* vertexPath;
+        const char* fragmentPath;
+    };
+    // Builds several programs at once, returned in the same order. Every shader is compiled and every program linked
+    // before any of them is asked how it went, since asking makes the driver finish that one first. With
+    // KHR_parallel_shader_compile the driver's compiler threads build them side by side while this polls
+    // GL_COMPLETION_STATUS_KHR; without it, drivers that compile on threads of their own still overlap them.
+    // Errors are reported the way the constructor reports them.
+    static std::vector<Shader> buildAll(const std::vector<Sources>& programs);
+
+    // Where linked programs are cached, created if needed; empty, the default, turns the cache off.
+    // A shader built later with the same sources, on the same driver, loads the program from there with glProgramBinary
+    // instead of compiling it. A cached program the driver rejects (after an update, say) is simply compiled again.
+    static void setCacheDirectory(const std::string& directory);
     // use/activate the shader
     void use() const;
-    // utility uniform functions
+    // utility uniform functions, for the program in use
+    // The locations of the active uniforms are looked up once, when the program links, so these never ask the driver.
+    // The ones taking a UniformID don't touch a string at all; use them for uniforms set every frame.
     void setBool(const std::string& name, bool value) const;
     void setInt(const std::string& name, int value) const;
     void setFloat(const std::string& name, float value) const;
+    void setBool(UniformID id, bool value) const;
+    void setInt(UniformID id, int value) const;
+    void setFloat(UniformID id, float value) const;
+    // -1 if the program has no such active uniform, like glGetUniformLocation. An array is found by its plain name
+    // as well as by "name[0]", and its other elements by "name[i]".
+    GLint location(UniformID id) const;
     void checkError(unsigned int ID, GLenum type);
+
+    // hot reload: watch the source files, so update() rebuilds the program when one of them is saved
+    void watch();
+    // Call once per frame while watching. A changed source is compiled and linked right away, but its result is only
+    // checked on the next frame, so a driver that compiles on its own threads doesn't hold up this one.
+    // Returns true when the new program has replaced ID, which drops every uniform set so far: set them again.
+    // A program that fails to build is reported and thrown away, and the old one stays in use.
+    bool update();
+
+private:
+    // for buildAll: keeps the paths and builds nothing
+    struct Unbuilt {};
+    Shader(const char* vertexPath, const char* fragmentPath, Unbuilt);
+
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::unique_ptr<FileWatcher> watcher;
+    std::unordered_map<uint32_t, GLint> locations; // UniformID hash -> location in ID
+    // the program being rebuilt, and its shaders, until it's checked
+    unsigned int pendingID = 0;
+    unsigned int pendingVertex = 0;
+    unsigned int pendingFragment = 0;
+    uint64_t pendingKey = 0;
+
+    static std::string cacheDirectory;
+
+    bool readSources(std::string& vertexCode, std::string& fragmentCode) const;
+    static unsigned int build(const std::string& vertexCode, const std::string& fragmentCode, unsigned int& vertex, unsigned int& fragment);
+    void finishBuild(unsigned int vertex, unsigned int fragment, uint64_t key);
+    void discardPending();
+    void cacheLocations();
+    static uint64_t keyOf(const std::string& vertexCode, const std::string& fragmentCode);
+    static unsigned int loadBinary(uint64_t key);
+    static void saveBinary(unsigned int program, uint64_t key);
+    static std::string pathOf(uint64_t key);
 };
 
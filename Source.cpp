@@ -1,7 +1,9 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include "GLState.h"
+#include "GpuMemory.h"
 #include "Shader.h"
-#include "stb_image.h"
+#include "TextureManager.h"
 #include <iostream>
 #include <filesystem>
 
@@ -95,7 +97,11 @@ int main()
 #pragma endregion
 
 #pragma region Build and Compile the Shader Program
+     // linked programs are kept here, so later runs load them instead of compiling
+     Shader::setCacheDirectory("ShaderCache");
      Shader ourShader("vs.vert", "fs.frag");
+     // rebuild the program whenever vs.vert or fs.frag is saved, without restarting
+     ourShader.watch();
 #pragma endregion
 
 #pragma region Vertex Manipulation
@@ -121,11 +127,13 @@ int main()
      glGenBuffers(1, &VBO);
      glGenBuffers(1, &EBO);
 
-     glBindVertexArray(VAO);
-     glBindBuffer(GL_ARRAY_BUFFER, VBO);
+     GLState::bindVertexArray(VAO);
+     GLState::bindBuffer(GL_ARRAY_BUFFER, VBO);
      glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+     GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
      glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+     GpuMemory::track(GpuMemory::Kind::Buffer, VBO, sizeof(vertices));
+     GpuMemory::track(GpuMemory::Kind::Buffer, EBO, sizeof(indices));
      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
      glEnableVertexAttribArray(0);
      glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
@@ -136,61 +144,36 @@ int main()
 #pragma endregion
 #pragma region Texture Manipulation
 
-    unsigned int textures[2];
-    // First Texture 
-    //---------------
-    glGenTextures(2, textures);
-    glBindTexture(GL_TEXTURE_2D, textures[0]);
-
-    // set the texture wrapping/filtering options (on the currently bound texture object)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // load and generate the texture
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load("C:\\Users\\mailt\\OneDrive\\Resimler\\Textures\\container.jpg", &width, &height, &nrChannels, 0);
-    if (data)
-    {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    else
-    {
-        std::cout << "Failed to load texture" << std::endl;
-    }
-    stbi_image_free(data);
-
-    // Second Texture
-    //---------------
-    glBindTexture(GL_TEXTURE_2D, textures[1]);
-
-    // set the texture wrapping/filtering options (on the currently bound texture object)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // load and generate the texture
-    stbi_set_flip_vertically_on_load(true);
-    data = stbi_load("C:\\Users\\mailt\\OneDrive\\Resimler\\Textures\\awesomeface.png", &width, &height, &nrChannels, 0);
-    if (data)
-    {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    else
-    {
-        std::cout << "Failed to load texture" << std::endl;
-    }
-    stbi_image_free(data);
-
+    // Every texture the scene needs, by its name in the texture directory.
+    // The files are read and decoded on worker threads, and an image that's listed twice is only loaded once.
+    // Until its image is uploaded in the render loop a texture shows a 1x1 placeholder, so the first frame doesn't wait for them.
+    TextureManager textureManager("Textures");
+    // the first run writes what it decodes here, later runs upload from it without decoding
+    textureManager.setCacheDirectory("TextureCache");
+    // and an image saved while the app runs shows up in its texture a moment later
+    textureManager.setHotReload(true);
+    TextureManager::Settings containerSettings;
+    containerSettings.channels = 3;
+    containerSettings.compression = TextureManager::Compression::Quality; // BC1, 4 bits per texel instead of 24
+    containerSettings.srgb = true; // both are color images, so their mip levels are averaged in linear light
+    TextureManager::Settings faceSettings;
+    faceSettings.flip = true;
+    faceSettings.srgb = true;
+
+    const std::vector<unsigned int> textures = textureManager.acquire({
+        { "container.jpg", containerSettings },
+        { "awesomeface.png", faceSettings },
+    });
+
+
+    // the sampler names hashed at compile time, so setting them goes straight to the cached locations
+    constexpr UniformID texture1 = uniformID("texture1");
+    constexpr UniformID texture2 = uniformID("texture2");
 
     ourShader.use(); // don't forget to activate the shader before setting uniforms!  
     // We also have to tell OpenGL to which texture unit each shader sampler belongs to
-    ourShader.setInt("texture1", 0); 
-    ourShader.setInt("texture2", 1);
+    ourShader.setInt(texture1, 0); 
+    ourShader.setInt(texture2, 1);
 
 
 #pragma endregion
@@ -206,13 +189,21 @@ int main()
         glClear(GL_COLOR_BUFFER_BIT);
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textures[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, textures[1]);
+        // upload the textures that finished decoding since the last frame
+        textureManager.update();
+        textureManager.bind(0, textures[0]);
+        textureManager.bind(1, textures[1]);
+
+        // an edited shader replaced the program, which starts without the old one's uniforms
+        if (ourShader.update())
+        {
+            ourShader.use();
+            ourShader.setInt(texture1, 0);
+            ourShader.setInt(texture2, 1);
+        }
 
         ourShader.use();
-        glBindVertexArray(VAO);
+        GLState::bindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
         // check and call events and swap the buffers
@@ -227,8 +218,17 @@ int main()
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
+    GLState::forgetVertexArray(VAO);
+    GLState::forgetBuffer(VBO);
+    GLState::forgetBuffer(EBO);
+    GpuMemory::forget(GpuMemory::Kind::Buffer, VBO);
+    GpuMemory::forget(GpuMemory::Kind::Buffer, EBO);
+
+    // textures and upload buffers have to go while the context still exists, not when textureManager goes out of scope
+    textureManager.clear();
 
     glDeleteProgram(ourShader.ID);
+    GLState::forgetProgram(ourShader.ID);
 
     //Although every non-destroyed windows will be closed when glfwTerminate called, I will call destroy window for clarification.
     glfwDestroyWindow(window);
@@ -0,0 +1,228 @@
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // "TXC1" followed by the format version, bumped whenever what a file holds changes
+    const uint32_t magic = 0x31435854u;
+    const uint32_t version = 1;
+
+    const size_t maxLevels = 32;
+
+    // magic, version, key (8 bytes), compressed, format, channels, width, height, level count
+    const size_t headerSize = 40;
+    // offset and size (8 bytes each), width, height
+    const size_t levelRecordSize = 24;
+    // level data starts on this boundary, which suits the copies into the upload buffers
+    const size_t dataAlignment = 16;
+
+    template <typename T>
+    T get(const unsigned char* bytes)
+    {
+        T value;
+        memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    void put(std::vector<unsigned char>& bytes, T value)
+    {
+        const size_t at = bytes.size();
+        bytes.resize(at + sizeof(T));
+        memcpy(bytes.data() + at, &value, sizeof(T));
+    }
+
+    const uint64_t multiplier = 0xc6a4a7935bd1e995ull;
+
+    uint64_t mix(uint64_t value)
+    {
+        value *= multiplier;
+        value ^= value >> 47;
+        return value * multiplier;
+    }
+}
+
+// MurmurHash64A's mixing over four independent lanes, so the multiplies of one lane overlap with those of the others
+// instead of every 8 bytes waiting for the last ones.
+uint64_t TextureCache::hash(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t lanes[4] = { seed ^ (size * multiplier), seed + 1, seed + 2, seed + 3 };
+
+    const unsigned char* end = bytes + size / 32 * 32;
+    for (; bytes != end; bytes += 32)
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            lanes[lane] ^= mix(get<uint64_t>(bytes + lane * 8));
+            lanes[lane] *= multiplier;
+        }
+
+    uint64_t h = lanes[0];
+    for (int lane = 1; lane < 4; ++lane)
+        h = (h ^ mix(lanes[lane])) * multiplier;
+
+    // the last bytes that don't fill a 32-byte block
+    for (; bytes + 8 <= (const unsigned char*)data + size; bytes += 8)
+        h = (h ^ mix(get<uint64_t>(bytes))) * multiplier;
+    uint64_t tail = 0;
+    for (int shift = 0; bytes != (const unsigned char*)data + size; ++bytes, shift += 8)
+        tail |= (uint64_t)*bytes << shift;
+    h = (h ^ mix(tail)) * multiplier;
+
+    h ^= h >> 47;
+    h *= multiplier;
+    h ^= h >> 47;
+    return h;
+}
+
+std::string TextureCache::pathOf(const std::string& directory, uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.texcache", (unsigned long long)key);
+    return (std::filesystem::path(directory) / name).generic_string();
+}
+
+std::shared_ptr<MappedFile> TextureCache::read(const std::string& path, uint64_t key, bool& compressed, MipChain& mips, CompressedTexture& blocks)
+{
+    std::shared_ptr<MappedFile> file = MappedFile::open(path);
+    if (!file || file->size() < headerSize)
+        return nullptr;
+
+    const unsigned char* bytes = file->data();
+    const size_t levelCount = get<uint32_t>(bytes + 36);
+    if (get<uint32_t>(bytes) != magic || get<uint32_t>(bytes + 4) != version || get<uint64_t>(bytes + 8) != key
+        || levelCount == 0 || levelCount > maxLevels || file->size() < headerSize + levelCount * levelRecordSize)
+        return nullptr;
+
+    // Filled in locally and only handed over once every record checks out, so a bad file leaves no half-read levels.
+    // Each level must have the size its dimensions call for, since the upload hands GL those dimensions and the
+    // mapped bytes as they are: a stale or damaged file has to miss the cache, not make GL read past a level.
+    const bool isCompressed = get<uint32_t>(bytes + 16) != 0;
+    MipChain chain;
+    CompressedTexture texture;
+    chain.channels = (int)get<uint32_t>(bytes + 24);
+    texture.format = get<uint32_t>(bytes + 20);
+    texture.width = (int)get<uint32_t>(bytes + 28);
+    texture.height = (int)get<uint32_t>(bytes + 32);
+    if (!isCompressed && (chain.channels < 1 || chain.channels > 4))
+        return nullptr;
+
+    int levelWidth = 0, levelHeight = 0;
+    for (size_t i = 0; i < levelCount; ++i)
+    {
+        const unsigned char* record = bytes + headerSize + i * levelRecordSize;
+        const uint64_t offset = get<uint64_t>(record), size = get<uint64_t>(record + 8);
+        const uint32_t width = get<uint32_t>(record + 16), height = get<uint32_t>(record + 20);
+        if (i == 0)
+        {
+            if (width == 0 || height == 0 || width > 65536 || height > 65536)
+                return nullptr;
+            levelWidth = (int)width;
+            levelHeight = (int)height;
+        }
+        else
+        {
+            // every level halves the one before, down to 1
+            levelWidth = std::max(1, levelWidth / 2);
+            levelHeight = std::max(1, levelHeight / 2);
+            if ((int)width != levelWidth || (int)height != levelHeight)
+                return nullptr;
+        }
+
+        const size_t expected = isCompressed ? CompressedTexture::levelSize(texture.format, levelWidth, levelHeight)
+                                             : (size_t)levelWidth * levelHeight * chain.channels;
+        if (size != expected || offset > file->size() || size > file->size() - offset)
+            return nullptr;
+        if (isCompressed)
+            texture.levels.push_back({ (size_t)offset, (size_t)size, levelWidth, levelHeight });
+        else
+            chain.levels.push_back({ (size_t)offset, (size_t)size, levelWidth, levelHeight });
+    }
+    // the header repeats level 0's size
+    const int firstWidth = isCompressed ? texture.levels[0].width : chain.levels[0].width;
+    const int firstHeight = isCompressed ? texture.levels[0].height : chain.levels[0].height;
+    if (texture.width != firstWidth || texture.height != firstHeight)
+        return nullptr;
+
+    compressed = isCompressed;
+    mips = std::move(chain);
+    blocks = std::move(texture);
+    return file;
+}
+
+bool TextureCache::write(const std::string& path, uint64_t key, bool compressed, const MipChain& mips, const CompressedTexture& blocks)
+{
+    const size_t levelCount = compressed ? blocks.levels.size() : mips.levels.size();
+    if (levelCount == 0 || levelCount > maxLevels)
+        return false;
+    const unsigned char* data = compressed ? blocks.data.data() : mips.data.data();
+
+    std::vector<unsigned char> header;
+    put<uint32_t>(header, magic);
+    put<uint32_t>(header, version);
+    put<uint64_t>(header, key);
+    put<uint32_t>(header, compressed ? 1 : 0);
+    put<uint32_t>(header, compressed ? blocks.format : 0);
+    put<uint32_t>(header, (uint32_t)mips.channels);
+    put<uint32_t>(header, (uint32_t)(compressed ? blocks.width : mips.levels[0].width));
+    put<uint32_t>(header, (uint32_t)(compressed ? blocks.height : mips.levels[0].height));
+    put<uint32_t>(header, (uint32_t)levelCount);
+
+    // the levels one after the other, each starting aligned
+    size_t offset = (headerSize + levelCount * levelRecordSize + dataAlignment - 1) / dataAlignment * dataAlignment;
+    std::vector<size_t> sources;
+    for (size_t i = 0; i < levelCount; ++i)
+    {
+        const size_t size = compressed ? blocks.levels[i].size : mips.levels[i].size;
+        put<uint64_t>(header, offset);
+        put<uint64_t>(header, size);
+        put<uint32_t>(header, (uint32_t)(compressed ? blocks.levels[i].width : mips.levels[i].width));
+        put<uint32_t>(header, (uint32_t)(compressed ? blocks.levels[i].height : mips.levels[i].height));
+        sources.push_back(compressed ? blocks.levels[i].offset : mips.levels[i].offset);
+        offset = (offset + size + dataAlignment - 1) / dataAlignment * dataAlignment;
+    }
+
+    // named after the thread as well, since two workers can be writing the same image loaded by two requests
+    std::ostringstream temporary;
+    temporary << path << "." << std::this_thread::get_id() << ".tmp";
+    {
+        std::ofstream file(temporary.str(), std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        file.write((const char*)header.data(), (std::streamsize)header.size());
+        const char padding[dataAlignment] = {};
+        size_t written = header.size();
+        for (size_t i = 0; i < levelCount; ++i)
+        {
+            const uint64_t start = get<uint64_t>(header.data() + headerSize + i * levelRecordSize);
+            const uint64_t size = get<uint64_t>(header.data() + headerSize + i * levelRecordSize + 8);
+            file.write(padding, (std::streamsize)(start - written));
+            file.write((const char*)data + sources[i], (std::streamsize)size);
+            written = (size_t)(start + size);
+        }
+        if (!file)
+        {
+            file.close();
+            std::remove(temporary.str().c_str());
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary.str(), path, error);
+    if (error)
+    {
+        // another writer got there first, which is just as good
+        std::filesystem::remove(temporary.str(), error);
+        return false;
+    }
+    return true;
+}
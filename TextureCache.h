@@ -0,0 +1,37 @@
+#pragma once
+
+#include "CompressedTexture.h"
+#include "MappedFile.h"
+#include "MipGenerator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+
+
+// Files holding a decoded texture the way it goes to the GPU: flipped, converted to its channel count, with its mip chain,
+// or its compressed blocks. A later run maps the file and uploads straight from it, with no decoding, mip generation or
+// compression at all, so loading costs little more than reading the file.
+//
+// A file is found by a key: the hash of the source file's contents, seeded with the decode settings, so editing the
+// image or changing how it's loaded picks a different file. Files are written in this machine's byte order, for its own use.
+class TextureCache
+{
+public:
+    // A 64-bit hash of size bytes, fast enough to be a small part of reading the file. For telling files apart, not for security.
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = 0);
+
+    // the file the cache keeps key in
+    static std::string pathOf(const std::string& directory, uint64_t key);
+
+    // Maps the file written for key. On success it returns the mapping, and fills mips or blocks (whichever compressed says)
+    // with the levels, their offsets pointing into the mapping's data and their own data left empty.
+    // Returns nullptr if there is no such file or it isn't one for key.
+    static std::shared_ptr<MappedFile> read(const std::string& path, uint64_t key, bool& compressed, MipChain& mips, CompressedTexture& blocks);
+
+    // Writes mips, or blocks if compressed is true, as the file for key. The file is written under a temporary name and
+    // renamed into place, so a reader in another thread or process never sees half of one.
+    static bool write(const std::string& path, uint64_t key, bool compressed, const MipChain& mips, const CompressedTexture& blocks);
+};
@@ -0,0 +1,760 @@
+#include "TextureManager.h"
+#include "AssetIO.h"
+#include "GLState.h"
+#include "GpuMemory.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+// glTexStorage2D is only declared when glad was generated with GL 4.2 or ARB_texture_storage
+#if defined(GL_VERSION_4_2) || defined(GL_ARB_texture_storage)
+#define TEXTUREMANAGER_TEXTURE_STORAGE
+#endif
+
+namespace
+{
+    // how many files a worker takes off the queue at once; they're read as one AssetIO batch
+    const size_t maxWorkerBatch = 8;
+
+    GLenum formatOf(int channels)
+    {
+        switch (channels)
+        {
+        case 1:  return GL_RED;
+        case 2:  return GL_RG;
+        case 3:  return GL_RGB;
+        default: return GL_RGBA;
+        }
+    }
+
+    // The sized internal format for 8-bit images with channels channels. An unsized one (GL_RGB) lets the driver pick
+    // the storage, and it may pick one that needs converting on upload.
+    GLenum internalFormatOf(int channels)
+    {
+        switch (channels)
+        {
+        case 1:  return GL_R8;
+        case 2:  return GL_RG8;
+        case 3:  return GL_RGB8;
+        default: return GL_RGBA8;
+        }
+    }
+
+    // the largest unpack alignment that rows of rowBytes bytes meet, so they stay tightly packed and the driver
+    // can copy them with the widest loads it has
+    GLint alignmentOf(size_t rowBytes)
+    {
+        if (rowBytes % 8 == 0)
+            return 8;
+        if (rowBytes % 4 == 0)
+            return 4;
+        return rowBytes % 2 == 0 ? 2 : 1;
+    }
+
+#ifdef TEXTUREMANAGER_TEXTURE_STORAGE
+    bool hasTextureStorage()
+    {
+#ifdef GL_VERSION_4_2
+        if (GLAD_GL_VERSION_4_2)
+            return true;
+#endif
+#ifdef GL_ARB_texture_storage
+        if (GLAD_GL_ARB_texture_storage)
+            return true;
+#endif
+        return false;
+    }
+#endif
+
+    // set the texture wrapping/filtering options (on the currently bound texture object)
+    void setParameters(const TextureManager::Settings& settings)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, settings.wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, settings.wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, settings.minFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, settings.magFilter);
+    }
+
+    // what a texture shows until its image is uploaded: a single opaque mid-grey texel
+    void setPlaceholder()
+    {
+        const unsigned char texel[4] = { 128, 128, 128, 255 };
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    }
+    const size_t placeholderBytes = 4;
+
+    // frees levels from to to - 1 of the bound texture, left over from a bigger image, by making them empty
+    void releaseLevels(int from, int to)
+    {
+        for (int level = from; level < to; ++level)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+
+    // leaves out the first count levels of a chain, but never the last one, for a demoted texture;
+    // the others keep their offsets, the data before them is just not uploaded
+    template <typename Level>
+    void dropLevels(std::vector<Level>& levels, int count)
+    {
+        count = std::min(count, (int)levels.size() - 1);
+        if (count > 0)
+            levels.erase(levels.begin(), levels.begin() + count);
+    }
+
+    // bytes from the start of the first level to the end of the last, what an upload copies
+    template <typename Level>
+    size_t spanOf(const std::vector<Level>& levels)
+    {
+        return levels.empty() ? 0 : levels.back().offset + levels.back().size - levels.front().offset;
+    }
+
+    // everything that changes what the workers make of a file, for the texture cache key
+    std::string decodeKeyOf(const TextureManager::Settings& settings, bool compress)
+    {
+        return std::to_string(settings.channels) + (settings.flip ? "f" : "") + "c" + std::to_string(compress ? (int)settings.compression : 0)
+            + "m" + std::to_string((int)settings.mipFilter) + (settings.srgb ? "s" : "") + "a" + std::to_string(settings.alphaCutoff)
+            + (settings.wrap == GL_REPEAT ? "w" : "") + (settings.padRGB ? "p" : "");
+    }
+}
+
+TextureManager::TextureManager(const std::string& directory, unsigned int workerCount)
+    : directory(directory), workerCount(workerCount)
+{
+    if (this->workerCount == 0)
+    {
+        const unsigned int cores = std::thread::hardware_concurrency(); // 0 if it can't tell
+        this->workerCount = cores > 1 ? cores - 1 : 1;
+    }
+    for (unsigned int i = 0; i < this->workerCount; ++i)
+        workers.emplace_back(&TextureManager::work, this);
+}
+
+TextureManager::~TextureManager()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobQueued.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+
+    clear();
+}
+
+std::vector<unsigned int> TextureManager::acquire(const std::vector<Request>& requests)
+{
+    std::vector<unsigned int> textures(requests.size());
+    std::vector<Job> newJobs;
+
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        const std::string path = pathOf(requests[i].name);
+        const std::string key = keyOf(path, requests[i].settings);
+
+        // already loaded, or already queued by an earlier request
+        auto found = cache.find(key);
+        if (found != cache.end())
+        {
+            ++found->second.references;
+            textures[i] = found->second.handle;
+            continue;
+        }
+
+        const unsigned int texture = newTexture();
+        GLState::bindTexture(GL_TEXTURE_2D, texture);
+        const Settings& settings = requests[i].settings;
+        setParameters(settings);
+        setPlaceholder();
+
+        // BC1 and BC3 need the same extension, so checking one covers whatever alpha the image turns out to have
+        const bool compress = settings.compression != Compression::None
+            && CompressedTexture::isSupported(BlockCompressor::formatFor(settings.channels, true));
+
+        const uint64_t load = nextLoad++;
+        Entry& entry = cache[key];
+        entry = { texture, texture, 1, load, path, settings, compress };
+        entry.bytes = placeholderBytes;
+        GpuMemory::track(GpuMemory::Kind::Texture, texture, placeholderBytes);
+        keys[texture] = key;
+        textures[i] = texture;
+        if (watcher)
+            watcher->watch(path);
+        newJobs.push_back({ key, path, settings, load, compress, 0 });
+    }
+
+    if (!newJobs.empty())
+    {
+        inFlight += newJobs.size();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (Job& job : newJobs)
+                jobs.push_back(std::move(job));
+        }
+        jobQueued.notify_all();
+    }
+
+    return textures;
+}
+
+unsigned int TextureManager::acquire(const std::string& name, const Settings& settings)
+{
+    return acquire(std::vector<Request>{ { name, settings } })[0];
+}
+
+unsigned int TextureManager::acquire(const std::string& name)
+{
+    return acquire(name, Settings());
+}
+
+void TextureManager::release(unsigned int texture)
+{
+    auto key = keys.find(texture);
+    if (key == keys.end())
+        return;
+
+    auto entry = cache.find(key->second);
+    if (--entry->second.references == 0)
+    {
+        // a load that hasn't started yet isn't needed anymore; one that has is dropped when its image arrives
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const uint64_t load = entry->second.load;
+            auto job = std::find_if(jobs.begin(), jobs.end(), [load](const Job& job) { return job.load == load; });
+            if (job != jobs.end())
+            {
+                jobs.erase(job);
+                --inFlight;
+            }
+        }
+
+        glDeleteTextures(1, &entry->second.texture);
+        GLState::forgetTexture(entry->second.texture);
+        GpuMemory::forget(GpuMemory::Kind::Texture, entry->second.texture);
+        cache.erase(entry);
+        keys.erase(key);
+    }
+}
+
+void TextureManager::bind(unsigned int unit, unsigned int texture)
+{
+    auto key = keys.find(texture);
+    if (key == keys.end())
+    {
+        GLState::bindTexture(unit, GL_TEXTURE_2D, texture);
+        return;
+    }
+    // the handle's image may have moved to another texture object, see upload()
+    Entry& entry = cache.find(key->second)->second;
+    GLState::bindTexture(unit, GL_TEXTURE_2D, entry.texture);
+    entry.lastBound = frame;
+    if (entry.evicted && !entry.loading)
+        load(entry, key->second);
+}
+
+void TextureManager::setHotReload(bool enabled)
+{
+    if (!enabled)
+    {
+        watcher.reset();
+        return;
+    }
+    if (watcher)
+        return;
+
+    watcher.reset(new FileWatcher());
+    for (const auto& item : cache)
+        watcher->watch(item.second.path);
+}
+
+void TextureManager::setCacheDirectory(const std::string& directory)
+{
+    cacheDirectory.clear();
+    if (directory.empty())
+        return;
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+        std::cout << "Can't use texture cache directory " << directory << ": " << error.message() << std::endl;
+    else
+        cacheDirectory = directory;
+}
+
+void TextureManager::update()
+{
+    ++frame;
+    if (watcher)
+        reloadChanged();
+    upload(uploadBudget);
+    enforceBudget();
+}
+
+void TextureManager::finish()
+{
+    while (inFlight > 0)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            imageDecoded.wait(lock, [this] { return !images.empty(); });
+        }
+        upload(SIZE_MAX);
+    }
+}
+
+void TextureManager::clear()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight -= jobs.size();
+        jobs.clear();
+    }
+
+    for (const auto& entry : cache)
+    {
+        glDeleteTextures(1, &entry.second.texture);
+        GLState::forgetTexture(entry.second.texture);
+        GpuMemory::forget(GpuMemory::Kind::Texture, entry.second.texture);
+    }
+    cache.clear();
+    keys.clear();
+    if (!reservedNames.empty())
+        glDeleteTextures((GLsizei)reservedNames.size(), reservedNames.data());
+    reservedNames.clear();
+    uploadRing.release();
+}
+
+// Worker thread: takes a few queued files at a time, reads them as one batch and decodes each one as soon as it arrives.
+void TextureManager::work()
+{
+    for (;;)
+    {
+        std::vector<Job> batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobQueued.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+
+            // only a share of the queue, so the other workers have files to decode at the same time
+            const size_t count = std::min(maxWorkerBatch, std::max<size_t>(1, jobs.size() / workerCount));
+            for (size_t i = 0; i < count; ++i)
+            {
+                batch.push_back(std::move(jobs.front()));
+                jobs.pop_front();
+            }
+        }
+
+        std::vector<std::string> paths;
+        for (const Job& job : batch)
+            paths.push_back(job.path);
+
+        AssetIO::readAll(paths, [&](size_t index, const unsigned char* data, size_t size)
+        {
+            const Job& job = batch[index];
+            Image image;
+            image.key = job.key;
+            image.path = job.path;
+            image.load = job.load;
+            if (data && CompressedTexture::isContainer(data, size))
+            {
+                // already in a GPU format, only the container needs reading
+                image.compressed = CompressedTexture::load(data, size, image.blocks, image.error);
+            }
+            else if (data && size <= INT_MAX)
+            {
+                // when the cache has what this file decodes to, it's uploaded straight from the mapped cache file
+                uint64_t cacheKey = 0;
+                std::string cachePath;
+                if (!cacheDirectory.empty())
+                {
+                    const std::string decodeKey = decodeKeyOf(job.settings, job.compress);
+                    cacheKey = TextureCache::hash(data, size, TextureCache::hash(decodeKey.data(), decodeKey.size()));
+                    cachePath = TextureCache::pathOf(cacheDirectory, cacheKey);
+                    image.mapped = TextureCache::read(cachePath, cacheKey, image.compressed, image.mips, image.blocks);
+                }
+                if (!image.mapped)
+                    decode(image, job, data, size);
+                if (!image.mapped && !cachePath.empty() && (image.compressed || !image.mips.levels.empty()))
+                    TextureCache::write(cachePath, cacheKey, image.compressed, image.mips, image.blocks);
+            }
+
+            if (image.compressed)
+            {
+                dropLevels(image.blocks.levels, job.dropLevels);
+                image.blocks.width = image.blocks.levels[0].width;
+                image.blocks.height = image.blocks.levels[0].height;
+            }
+            else
+                dropLevels(image.mips.levels, job.dropLevels);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            images.push_back(std::move(image));
+            imageDecoded.notify_all();
+        });
+    }
+}
+
+// Decodes a file into its mip chain, or its blocks if the job says to compress. Runs on a worker thread.
+void TextureManager::decode(Image& image, const Job& job, const unsigned char* data, size_t size)
+{
+    // RGB padded to RGBA by stb_image itself, with opaque alpha; compressed textures don't need it
+    const bool pad = job.settings.channels == 3 && job.settings.padRGB && !job.compress;
+    const int channels = pad ? 4 : job.settings.channels;
+
+    // the flip flag is per thread here, so workers with different settings don't race on it
+    int width, height, nrChannels;
+    stbi_set_flip_vertically_on_load_thread(job.settings.flip);
+    unsigned char* pixels = stbi_load_from_memory(data, (int)size, &width, &height, &nrChannels, channels);
+    if (!pixels)
+    {
+        image.error = stbi_failure_reason();
+        return;
+    }
+
+    MipGenerator::Options options;
+    options.filter = job.settings.mipFilter;
+    options.srgb = job.settings.srgb;
+    options.alphaCutoff = pad ? 0.0f : job.settings.alphaCutoff;
+    options.wrap = job.settings.wrap == GL_REPEAT;
+    MipGenerator::generate(pixels, width, height, channels, options, image.mips);
+    stbi_image_free(pixels);
+    if (job.compress)
+        compress(image, job.settings.compression);
+}
+
+// Uploads decoded images until budget bytes have gone up (but at least one), replacing each texture's placeholder.
+void TextureManager::upload(size_t budget)
+{
+    std::vector<Image> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t bytes = 0;
+        while (!images.empty())
+        {
+            const Image& image = images.front();
+            const size_t size = image.compressed ? spanOf(image.blocks.levels) : spanOf(image.mips.levels);
+            if (!ready.empty() && bytes + size > budget)
+                break;
+            bytes += size;
+            ready.push_back(std::move(images.front()));
+            images.pop_front();
+        }
+    }
+
+    for (Image& image : ready)
+    {
+        --inFlight;
+
+        // the texture may have been released, or released and requested again, while its file was decoding
+        auto found = cache.find(image.key);
+        if (found == cache.end() || found->second.load != image.load)
+            continue;
+        Entry& entry = found->second;
+        entry.loading = false;
+        entry.evicted = false;
+
+        if (!image.compressed && image.mips.levels.empty())
+        {
+            std::cout << "Failed to load texture " << image.path;
+            if (!image.error.empty())
+                std::cout << ": " << image.error;
+            std::cout << std::endl;
+            continue;
+        }
+
+        if (image.compressed && !CompressedTexture::isSupported(image.blocks.format))
+        {
+            // nothing went wrong with the upload, the placeholder just stays
+            std::cout << "Texture " << image.path << " is in a compressed format this GPU doesn't support" << std::endl;
+            continue;
+        }
+
+        // the decoded channel count, which padRGB makes 4 for a 3 channel request
+        const GLenum internalFormat = image.compressed ? image.blocks.format : internalFormatOf(image.mips.channels);
+        const int levels = (int)(image.compressed ? image.blocks.levels.size() : image.mips.levels.size());
+        const int width = image.compressed ? image.blocks.levels[0].width : image.mips.levels[0].width;
+        const int height = image.compressed ? image.blocks.levels[0].height : image.mips.levels[0].height;
+        // a reloaded image the same size as the one before is written into the levels the texture has, not redefined
+        const bool sameSize = internalFormat == entry.internalFormat && width == entry.width && height == entry.height && levels == entry.levels;
+        if (entry.immutable && !sameSize)
+        {
+            // Immutable storage can't be redefined, so the reloaded image goes into a new texture object that takes
+            // the old one's place. The handle acquire() gave out stays the same, bind() binds the new object.
+            const unsigned int texture = newTexture();
+            GLState::bindTexture(GL_TEXTURE_2D, texture);
+            setParameters(entry.settings);
+            glDeleteTextures(1, &entry.texture);
+            GLState::forgetTexture(entry.texture);
+            GpuMemory::forget(GpuMemory::Kind::Texture, entry.texture);
+            entry.texture = texture;
+            entry.immutable = false;
+            entry.levels = 0;
+        }
+
+        GLState::bindTexture(GL_TEXTURE_2D, entry.texture);
+#ifdef TEXTUREMANAGER_TEXTURE_STORAGE
+        // Immutable storage is allocated once with every level, so the driver never has to check whether a level was
+        // redefined with another size or format and can lay the texture out for good. It can't shrink though,
+        // so textures loaded under a memory budget, which may be evicted or demoted, keep mutable storage.
+        if (!entry.immutable && memoryBudget == 0 && hasTextureStorage())
+        {
+            glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, width, height);
+            entry.immutable = true;
+        }
+#endif
+        const bool existing = entry.immutable || sameSize;
+        if (!(image.compressed ? uploadCompressed(image, existing) : uploadMips(image, internalFormat, existing)))
+        {
+            std::cout << "Failed to upload texture " << image.path << std::endl;
+            continue;
+        }
+
+        // a demoted image has fewer levels than the one it replaces
+        if (!entry.immutable)
+            releaseLevels(levels, entry.levels);
+        entry.levels = levels;
+        entry.internalFormat = internalFormat;
+        entry.width = width;
+        entry.height = height;
+        if (image.compressed)
+        {
+            entry.bytes = 0;
+            for (const CompressedTexture::Level& level : image.blocks.levels)
+                entry.bytes += level.size;
+        }
+        else
+            entry.bytes = GpuMemory::textureBytes(image.mips.levels[0].width, image.mips.levels[0].height, image.mips.channels);
+        GpuMemory::track(GpuMemory::Kind::Texture, entry.texture, entry.bytes);
+    }
+}
+
+// glGenTextures, except that it never returns the name of a texture object that was replaced while its name is still
+// handed out as a handle: GL may give a deleted name out again, and keys would then mix up the two.
+unsigned int TextureManager::newTexture()
+{
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    while (keys.count(texture))
+    {
+        reservedNames.push_back(texture); // kept generated, so GL doesn't offer it again, until clear()
+        glGenTextures(1, &texture);
+    }
+    return texture;
+}
+
+// Queues a new load of the entry's file; whatever load was under way before is dropped when it arrives.
+void TextureManager::load(Entry& entry, const std::string& key)
+{
+    entry.load = nextLoad++;
+    entry.loading = true;
+    ++inFlight;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back({ key, entry.path, entry.settings, entry.load, entry.compress, entry.dropLevels });
+    }
+    jobQueued.notify_one();
+}
+
+// Puts the placeholder back in place of the texture's image, freeing every level it had.
+void TextureManager::evict(Entry& entry)
+{
+    GLState::bindTexture(GL_TEXTURE_2D, entry.texture);
+    releaseLevels(1, entry.levels);
+    setPlaceholder();
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    entry.levels = 0;
+    entry.evicted = true;
+    entry.bytes = placeholderBytes;
+    GpuMemory::track(GpuMemory::Kind::Texture, entry.texture, placeholderBytes);
+}
+
+// Brings GPU memory back under the budget: first by evicting the textures bound least recently, as long as they weren't
+// bound this frame or the last one, then by demoting the biggest of those that were.
+void TextureManager::enforceBudget()
+{
+    size_t usage = GpuMemory::usage();
+    if (memoryBudget == 0 || usage <= memoryBudget)
+        return;
+
+    std::vector<Entry*> loaded;
+    for (auto& item : cache)
+    {
+        Entry& entry = item.second;
+        if (entry.levels == 0 || entry.immutable)
+            continue;
+        // an in-use texture already being demoted will give back about three quarters of its memory
+        if (entry.loading && entry.dropLevels > 0)
+            usage -= std::min(usage, entry.bytes / 4 * 3);
+        else
+            loaded.push_back(&entry);
+    }
+
+    std::sort(loaded.begin(), loaded.end(), [](const Entry* a, const Entry* b) { return a->lastBound < b->lastBound; });
+    size_t inUse = 0;
+    for (; inUse < loaded.size() && usage > memoryBudget; ++inUse)
+    {
+        Entry& entry = *loaded[inUse];
+        if (entry.lastBound + 1 >= frame)
+            break;
+        usage -= entry.bytes - placeholderBytes;
+        evict(entry);
+    }
+    if (usage <= memoryBudget)
+        return;
+
+    // each level left out takes three quarters off the texture
+    std::sort(loaded.begin() + inUse, loaded.end(), [](const Entry* a, const Entry* b) { return a->bytes > b->bytes; });
+    for (size_t i = inUse; i < loaded.size() && usage > memoryBudget; ++i)
+    {
+        Entry& entry = *loaded[i];
+        if (entry.levels < 2 || entry.loading)
+            continue;
+        ++entry.dropLevels;
+        load(entry, keys[entry.handle]);
+        usage -= entry.bytes / 4 * 3;
+    }
+}
+
+// Uploads an image's mip levels to the bound texture, all staged in one upload ring slot.
+// glTexImage2D then only queues copies out of the buffer object, instead of copying client memory before it returns.
+// With existing set the texture already has levels of these sizes, from immutable storage or the image before a reload,
+// and they're only written to.
+bool TextureManager::uploadMips(const Image& image, GLenum internalFormat, bool existing)
+{
+    const MipChain& mips = image.mips;
+    const GLenum format = formatOf(mips.channels);
+    const unsigned char* data = image.mapped ? image.mapped->data() : mips.data.data();
+    const size_t first = mips.levels[0].offset;
+    unsigned char* staging = uploadRing.map(spanOf(mips.levels));
+    bool staged = staging != nullptr;
+    if (staged)
+    {
+        memcpy(staging, data + first, spanOf(mips.levels));
+        staged = uploadRing.unmap();
+    }
+    if (staged)
+    {
+        for (size_t level = 0; level < mips.levels.size(); ++level)
+        {
+            // the levels are tightly packed, while OpenGL expects rows 4-byte aligned by default
+            const MipChain::Level& mip = mips.levels[level];
+            glPixelStorei(GL_UNPACK_ALIGNMENT, alignmentOf((size_t)mip.width * mips.channels));
+            // with a buffer bound to GL_PIXEL_UNPACK_BUFFER the data pointer is an offset into that buffer
+            void* offset = (void*)(mip.offset - first);
+            if (existing)
+                glTexSubImage2D(GL_TEXTURE_2D, (GLint)level, 0, 0, mip.width, mip.height, format, GL_UNSIGNED_BYTE, offset);
+            else
+                glTexImage2D(GL_TEXTURE_2D, (GLint)level, internalFormat, mip.width, mip.height, 0, format, GL_UNSIGNED_BYTE, offset);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)mips.levels.size() - 1);
+    }
+    uploadRing.fence();
+    return staged;
+}
+
+// Uploads a compressed texture's stored mip levels to the bound texture, all staged in one upload ring slot.
+bool TextureManager::uploadCompressed(const Image& image, bool existing)
+{
+    const CompressedTexture& blocks = image.blocks;
+
+    const unsigned char* data = image.mapped ? image.mapped->data() : blocks.data.data();
+    const size_t first = blocks.levels[0].offset;
+    unsigned char* staging = uploadRing.map(spanOf(blocks.levels));
+    bool staged = staging != nullptr;
+    if (staged)
+    {
+        memcpy(staging, data + first, spanOf(blocks.levels));
+        staged = uploadRing.unmap();
+    }
+    if (staged)
+    {
+        for (size_t level = 0; level < blocks.levels.size(); ++level)
+        {
+            const CompressedTexture::Level& mip = blocks.levels[level];
+            void* offset = (void*)(mip.offset - first);
+            if (existing)
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)level, 0, 0, mip.width, mip.height, blocks.format, (GLsizei)mip.size, offset);
+            else
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, blocks.format, mip.width, mip.height, 0, (GLsizei)mip.size, offset);
+        }
+        // only the levels the file has, instead of glGenerateMipmap, which can't work on compressed data anyway;
+        // without this a mipmapping filter would find the texture incomplete if the chain doesn't go down to 1x1
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)blocks.levels.size() - 1);
+    }
+    uploadRing.fence();
+    return staged;
+}
+
+// Replaces an image's mip levels by their blocks. Runs on a worker thread.
+void TextureManager::compress(Image& image, Compression compression)
+{
+    const BlockCompressor::Preset preset = compression == Compression::Fast ? BlockCompressor::Preset::Fast : BlockCompressor::Preset::Quality;
+    const MipChain& mips = image.mips;
+    const bool opaque = mips.channels != 4 || BlockCompressor::isOpaque(mips.data.data(), (size_t)mips.levels[0].width * mips.levels[0].height);
+    CompressedTexture& blocks = image.blocks;
+    blocks.format = BlockCompressor::formatFor(mips.channels, opaque);
+    blocks.width = mips.levels[0].width;
+    blocks.height = mips.levels[0].height;
+
+    for (const MipChain::Level& level : mips.levels)
+    {
+        const size_t size = CompressedTexture::levelSize(blocks.format, level.width, level.height);
+        blocks.levels.push_back({ blocks.data.size(), size, level.width, level.height });
+        blocks.data.resize(blocks.data.size() + size);
+    }
+    for (size_t i = 0; i < mips.levels.size(); ++i)
+    {
+        const MipChain::Level& level = mips.levels[i];
+        BlockCompressor::compress(mips.data.data() + level.offset, level.width, level.height, mips.channels, blocks.format,
+            blocks.data.data() + blocks.levels[i].offset, preset);
+    }
+
+    image.mips = MipChain();
+    image.compressed = true;
+}
+
+// Queues a new load of every texture whose file changed. The old image stays until the new one is uploaded,
+// and stays for good if the new file can't be decoded (half written, say), until it's saved again.
+void TextureManager::reloadChanged()
+{
+    const std::vector<std::string> changed = watcher->poll();
+    if (changed.empty())
+        return;
+
+    for (auto& item : cache)
+    {
+        Entry& entry = item.second;
+        // an evicted texture reads its file again anyway, once it's bound
+        if (entry.evicted || std::find(changed.begin(), changed.end(), entry.path) == changed.end())
+            continue;
+
+        // a load still waiting in the queue hasn't read the file yet, so it gets the new one
+        bool queued = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const uint64_t load = entry.load;
+            queued = std::find_if(jobs.begin(), jobs.end(), [load](const Job& job) { return job.load == load; }) != jobs.end();
+        }
+        if (!queued)
+            load(entry, item.first);
+    }
+}
+
+std::string TextureManager::pathOf(const std::string& name) const
+{
+    // normalized, so "./wall.png" and "wall.png" share one cache entry
+    return (std::filesystem::path(directory) / name).lexically_normal().generic_string();
+}
+
+std::string TextureManager::keyOf(const std::string& path, const Settings& settings)
+{
+    return path + "|" + std::to_string(settings.channels) + (settings.flip ? "f" : "") + "c" + std::to_string((int)settings.compression)
+        + "|m" + std::to_string((int)settings.mipFilter) + (settings.srgb ? "s" : "") + "a" + std::to_string(settings.alphaCutoff)
+        + "|" + std::to_string(settings.wrap) + "," + std::to_string(settings.minFilter) + "," + std::to_string(settings.magFilter)
+        + (settings.padRGB ? "|p" : "");
+}
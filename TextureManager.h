@@ -0,0 +1,219 @@
+#pragma once
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+#include "BlockCompressor.h"
+#include "CompressedTexture.h"
+#include "FileWatcher.h"
+#include "MipGenerator.h"
+#include "TextureCache.h"
+#include "UploadRing.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+
+// Owns the OpenGL textures loaded from image files.
+// Textures are asked for by a logical name, a path relative to the texture directory given to the constructor,
+// so no absolute paths end up in the scene code.
+// Each texture is cached under its normalized path and decode settings: asking for an image that is already loaded
+// hands back the same texture object and bumps its reference count instead of reading and decoding the file again.
+// The texture is deleted once every user has released it.
+//
+// Loading is asynchronous. acquire() returns right away with textures that hold a 1x1 placeholder,
+// worker threads read and decode the files and build their mip chains (see MipGenerator), and update() uploads them on the GL thread,
+// a limited amount per frame, so a scene with many textures can start drawing immediately.
+// The uploads are staged through an UploadRing of pixel unpack buffers, so they don't stall the render thread either.
+//
+// KTX2 and DDS files holding block-compressed data (see CompressedTexture) aren't decoded at all: their blocks and
+// stored mip levels go straight to glCompressedTexImage2D. channels and flip don't apply to them, the file decides both.
+// Other images can be block-compressed by the workers after decoding, see Settings::compression.
+// With a cache directory set, what the workers make of each file is also written to a TextureCache file, and later loads
+// of the same file with the same settings upload from that instead of decoding again.
+//
+// With a memory budget set, the textures are kept under it (counting everything GpuMemory tracks, not only textures):
+// the ones bound least recently are evicted back to their placeholder, and load again the next time they're bound.
+// If the textures in use don't fit on their own, the biggest of them are demoted, loaded again without their top mip level.
+//
+// With hot reload on, an image file that's saved while the app runs is decoded again by the workers and replaces the
+// texture's image in place; the texture object stays the same, so the scene code doesn't notice.
+class TextureManager
+{
+public:
+    // Block compression of decoded images, to BC4 (1 channel), BC5 (2), BC1 (3, or 4 when opaque) or BC3 (4 with alpha).
+    // Takes a quarter to an eighth of the GPU memory of the raw pixels, for some loss of detail and the compression time.
+    // Falls back to raw pixels if the GPU lacks the format.
+    enum class Compression
+    {
+        None,
+        Fast,
+        Quality
+    };
+
+    // how an image file is decoded and sampled
+    struct Settings
+    {
+        int channels = 4;              // 1 to 4, stored as GL_R8, GL_RG8, GL_RGB8 or GL_RGBA8
+        bool flip = false;             // flip vertically so the first row is the bottom of the texture, like OpenGL expects
+        Compression compression = Compression::None;
+        MipGenerator::Filter mipFilter = MipGenerator::Filter::Box;
+        bool srgb = false;             // the colors are sRGB encoded, so the mip levels are averaged in linear light
+        float alphaCutoff = 0.0f;      // for alpha tested textures: the cutoff their shader uses, so the mip levels keep its coverage
+        // With 3 channels, decode to RGBA on the workers and store the texture as GL_RGBA8 with an opaque alpha. Drivers
+        // keep RGB8 as RGBX anyway, so RGB rows have to be repacked on upload while RGBA ones are copied as they are.
+        // Costs a third more memory on the CPU side only.
+        bool padRGB = false;
+        GLint wrap = GL_REPEAT;
+        GLint minFilter = GL_LINEAR;
+        GLint magFilter = GL_LINEAR;
+    };
+
+    struct Request
+    {
+        std::string name;
+        Settings settings;
+    };
+
+    // workerCount 0 uses one thread less than the number of cores, but at least one
+    explicit TextureManager(const std::string& directory, unsigned int workerCount = 0);
+    // stops the workers and deletes whatever is still loaded, so it must run while the GL context is alive (or after clear())
+    ~TextureManager();
+
+    TextureManager(const TextureManager&) = delete;
+    TextureManager& operator=(const TextureManager&) = delete;
+
+    // Returns the texture for every request, in the same order, each holding one reference.
+    // Textures that aren't cached yet start out as a 1x1 placeholder and get their image from a later update().
+    // A file that can't be loaded keeps the placeholder, so the returned handles are always safe to bind.
+    // Bind them with bind(): a hot reload can move a texture's image to another texture object behind the same handle.
+    std::vector<unsigned int> acquire(const std::vector<Request>& requests);
+    unsigned int acquire(const std::string& name, const Settings& settings);
+    unsigned int acquire(const std::string& name); // with the default Settings
+
+    // drops one reference; the texture is deleted when the last one goes
+    void release(unsigned int texture);
+
+    // Binds texture to the given texture unit (GL_TEXTURE0 + unit) and marks it as used this frame.
+    // An evicted texture starts loading again, and shows its placeholder until it's back.
+    void bind(unsigned int unit, unsigned int texture);
+
+    // Uploads the images the workers have decoded so far. Call it once per frame on the GL thread.
+    // It stops once the upload budget is used up, but always uploads at least one image so large ones still get through.
+    void update();
+    // blocks until every requested texture has its image (or has failed to load)
+    void finish();
+
+    // bytes of pixel data a single update() may upload
+    void setUploadBudget(size_t bytes) { uploadBudget = bytes; }
+    // GPU memory (as GpuMemory counts it) that update() keeps the textures within; 0, the default, means no limit.
+    // Without a budget textures get immutable storage (glTexStorage2D) where the GPU has it, and those can't be evicted
+    // or demoted later, so set the budget before acquiring the textures it should cover.
+    void setMemoryBudget(size_t bytes) { memoryBudget = bytes; }
+    // Watches the files of the loaded textures and reloads the ones that change on disk, from update().
+    // A reloaded image the size of the old one is written into the texture's existing levels. One with another size or
+    // format redefines mutable storage, and moves to a new texture object if the old one has immutable storage.
+    void setHotReload(bool enabled);
+    // Where decoded textures are cached, created if needed; empty, the default, turns the cache off.
+    // The workers read it without locking, so set it before the first acquire().
+    void setCacheDirectory(const std::string& directory);
+
+    // deletes every texture regardless of its reference count, and the upload buffers
+    void clear();
+
+    // number of distinct textures currently loaded
+    size_t size() const { return cache.size(); }
+    // number of requested textures still waiting for their image
+    size_t pending() const { return inFlight; }
+
+private:
+    struct Entry
+    {
+        unsigned int handle;       // the name acquire() handed out
+        unsigned int texture;      // the texture object with the image; starts out as handle, see upload()
+        unsigned int references;
+        uint64_t load;             // which load fills the texture, so results for a deleted texture are recognized
+        std::string path;
+        Settings settings;
+        bool compress;             // settings.compression, if the GPU supports the formats
+        bool loading = true;       // a load is queued or decoding
+        bool evicted = false;      // holds its placeholder until it's bound again
+        int levels = 0;            // mip levels it holds, 0 for the placeholder
+        int width = 0, height = 0;
+        GLenum internalFormat = 0;
+        bool immutable = false;    // allocated with glTexStorage2D, so its size and format are fixed
+        int dropLevels = 0;        // top mip levels left out to save memory
+        size_t bytes = 0;
+        uint64_t lastBound = 0;    // frame it was last bound in
+    };
+
+    // a file for the workers to read and decode
+    struct Job
+    {
+        std::string key;
+        std::string path;
+        Settings settings;
+        uint64_t load;
+        bool compress;             // settings.compression, if the GPU supports the formats
+        int dropLevels;            // top mip levels to leave out
+    };
+
+    // a decoded image waiting for its upload, as its mip levels, or blocks for a compressed texture;
+    // mips has no levels if the file couldn't be loaded
+    struct Image
+    {
+        std::string key;
+        std::string path;
+        uint64_t load;
+        MipChain mips;
+        bool compressed = false;
+        CompressedTexture blocks;
+        std::shared_ptr<MappedFile> mapped;  // the cache file the levels point into, instead of mips.data or blocks.data
+        std::string error;         // why the file couldn't be loaded, if known
+    };
+
+    std::string directory;
+    std::string cacheDirectory;
+    // key is the normalized file path plus the decode settings, since the same file can be loaded in different ways
+    std::unordered_map<std::string, Entry> cache;
+    std::unordered_map<unsigned int, std::string> keys; // handle -> its key in cache, for release
+    std::vector<unsigned int> reservedNames;            // see newTexture()
+    uint64_t nextLoad = 1;
+    size_t inFlight = 0;       // loads that were queued and haven't been uploaded or dropped yet
+    size_t uploadBudget = 16 << 20;
+    size_t memoryBudget = 0;
+    uint64_t frame = 1;
+    UploadRing uploadRing;
+    std::unique_ptr<FileWatcher> watcher; // set while hot reload is on
+
+    // shared with the workers, guarded by mutex
+    std::mutex mutex;
+    std::condition_variable jobQueued;
+    std::condition_variable imageDecoded;
+    std::deque<Job> jobs;
+    std::deque<Image> images;
+    bool stopping = false;
+
+    unsigned int workerCount;
+    std::vector<std::thread> workers;
+
+    void work();
+    void decode(Image& image, const Job& job, const unsigned char* data, size_t size);
+    unsigned int newTexture();
+    void load(Entry& entry, const std::string& key);
+    void evict(Entry& entry);
+    void enforceBudget();
+    void reloadChanged();
+    void upload(size_t budget);
+    bool uploadMips(const Image& image, GLenum internalFormat, bool existing);
+    bool uploadCompressed(const Image& image, bool existing);
+    static void compress(Image& image, Compression compression);
+    std::string pathOf(const std::string& name) const;
+    static std::string keyOf(const std::string& path, const Settings& settings);
+};
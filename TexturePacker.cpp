@@ -0,0 +1,240 @@
+#include "TexturePacker.h"
+#include "GLState.h"
+#include "GpuMemory.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <tuple>
+
+namespace
+{
+    GLenum formatOf(int channels)
+    {
+        switch (channels)
+        {
+        case 1:  return GL_RED;
+        case 2:  return GL_RG;
+        case 3:  return GL_RGB;
+        default: return GL_RGBA;
+        }
+    }
+
+    int nextPowerOfTwo(int value)
+    {
+        int power = 1;
+        while (power < value)
+            power *= 2;
+        return power;
+    }
+
+    int roundUp(int value, int multiple)
+    {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+
+    // one pixel from channels to outChannels bytes, the way stb_image converts: grey spreads to RGB, alpha defaults to opaque
+    void convertPixel(const unsigned char* in, int channels, unsigned char* out, int outChannels)
+    {
+        unsigned char rgba[4];
+        switch (channels)
+        {
+        case 1:  rgba[0] = rgba[1] = rgba[2] = in[0]; rgba[3] = 255; break;
+        case 2:  rgba[0] = rgba[1] = rgba[2] = in[0]; rgba[3] = in[1]; break;
+        case 3:  rgba[0] = in[0]; rgba[1] = in[1]; rgba[2] = in[2]; rgba[3] = 255; break;
+        default: memcpy(rgba, in, 4); break;
+        }
+        switch (outChannels)
+        {
+        case 1:  out[0] = rgba[0]; break;
+        case 2:  out[0] = rgba[0]; out[1] = rgba[3]; break;
+        default: memcpy(out, rgba, outChannels); break;
+        }
+    }
+
+    // drops the levels past count from a chain
+    void truncate(MipChain& chain, size_t count)
+    {
+        if (chain.levels.size() <= count)
+            return;
+        chain.levels.resize(count);
+        chain.data.resize(chain.levels.back().offset + chain.levels.back().size);
+    }
+}
+
+std::vector<TexturePacker::Pack> TexturePacker::packArrays(const std::vector<Image>& images, const MipGenerator::Options& mipOptions,
+    std::vector<Placement>& placements)
+{
+    std::vector<Pack> packs;
+    std::map<std::tuple<int, int, int>, int> packOf; // width, height, channels -> index in packs
+    placements.assign(images.size(), Placement());
+
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        const Image& image = images[i];
+        const auto key = std::make_tuple(image.width, image.height, image.channels);
+        auto found = packOf.find(key);
+        if (found == packOf.end())
+        {
+            found = packOf.emplace(key, (int)packs.size()).first;
+            packs.emplace_back();
+            packs.back().width = image.width;
+            packs.back().height = image.height;
+            packs.back().channels = image.channels;
+        }
+
+        Pack& pack = packs[found->second];
+        placements[i].pack = found->second;
+        placements[i].layer = (int)pack.layers.size();
+        pack.layers.emplace_back();
+        MipGenerator::generate(image.pixels, image.width, image.height, image.channels, mipOptions, pack.layers.back());
+    }
+    return packs;
+}
+
+TexturePacker::Pack TexturePacker::packAtlas(const std::vector<Image>& images, const AtlasOptions& options, std::vector<Placement>& placements)
+{
+    Pack pack;
+    placements.assign(images.size(), Placement());
+    const int padding = nextPowerOfTwo(std::max(options.padding, 1));
+    pack.channels = 1;
+    for (const Image& image : images)
+        pack.channels = std::max(pack.channels, image.channels);
+
+    // Shelf packing, tallest images first: each shelf is as tall as its first image and fills left to right.
+    // Every padded rectangle is a multiple of the padding, so the images stay aligned to it.
+    std::vector<size_t> order(images.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return images[a].height > images[b].height; });
+
+    struct Rect { int page, x, y; };
+    std::vector<Rect> rects(images.size(), Rect{ -1, 0, 0 });
+    int pages = 0, shelfX = 0, shelfY = 0, shelfHeight = 0;
+    int usedWidth = 0, usedHeight = 0;
+    for (size_t i : order)
+    {
+        const int width = roundUp(images[i].width + 2 * padding, padding), height = roundUp(images[i].height + 2 * padding, padding);
+        if (width > options.size || height > options.size)
+        {
+            std::cout << "Image " << i << " (" << images[i].width << "x" << images[i].height << ") doesn't fit an atlas page of " << options.size << std::endl;
+            continue;
+        }
+
+        if (pages == 0)
+            pages = 1;
+        if (shelfX + width > options.size)
+        {
+            // next shelf
+            shelfY += shelfHeight;
+            shelfX = 0;
+            shelfHeight = 0;
+        }
+        if (shelfY + height > options.size)
+        {
+            // next page
+            ++pages;
+            shelfX = shelfY = shelfHeight = 0;
+        }
+
+        rects[i] = { pages - 1, shelfX, shelfY };
+        shelfX += width;
+        shelfHeight = std::max(shelfHeight, height);
+        usedWidth = std::max(usedWidth, shelfX);
+        usedHeight = std::max(usedHeight, shelfY + shelfHeight);
+    }
+    if (pages == 0)
+        return pack;
+
+    // a single page only needs to be as big as what's on it
+    pack.width = pages == 1 ? usedWidth : options.size;
+    pack.height = pages == 1 ? usedHeight : options.size;
+
+    // compose the pages, each image surrounded by copies of its edge texels
+    std::vector<std::vector<unsigned char>> pixels(pages, std::vector<unsigned char>((size_t)pack.width * pack.height * pack.channels, 0));
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        const Image& image = images[i];
+        const Rect& rect = rects[i];
+        if (rect.page < 0)
+            continue;
+
+        unsigned char* page = pixels[rect.page].data();
+        const int paddedWidth = roundUp(image.width + 2 * padding, padding), paddedHeight = roundUp(image.height + 2 * padding, padding);
+        for (int y = 0; y < paddedHeight; ++y)
+        {
+            const int sy = std::min(std::max(y - padding, 0), image.height - 1);
+            unsigned char* out = page + ((size_t)(rect.y + y) * pack.width + rect.x) * pack.channels;
+            for (int x = 0; x < paddedWidth; ++x, out += pack.channels)
+            {
+                const int sx = std::min(std::max(x - padding, 0), image.width - 1);
+                convertPixel(image.pixels + ((size_t)sy * image.width + sx) * image.channels, image.channels, out, pack.channels);
+            }
+        }
+
+        Placement& placement = placements[i];
+        placement.pack = 0;
+        placement.layer = rect.page;
+        placement.scale[0] = (float)image.width / pack.width;
+        placement.scale[1] = (float)image.height / pack.height;
+        placement.offset[0] = (float)(rect.x + padding) / pack.width;
+        placement.offset[1] = (float)(rect.y + padding) / pack.height;
+    }
+
+    // Mip levels by box filter only, whose footprint stays inside the aligned rectangles (a wider filter would reach
+    // across), and only as many as the padding covers.
+    MipGenerator::Options mipOptions;
+    mipOptions.filter = MipGenerator::Filter::Box;
+    mipOptions.srgb = options.srgb;
+    mipOptions.wrap = false;
+    size_t levels = 1;
+    for (int texels = padding; texels > 1; texels /= 2)
+        ++levels;
+
+    pack.layers.resize(pages);
+    for (int page = 0; page < pages; ++page)
+    {
+        MipGenerator::generate(pixels[page].data(), pack.width, pack.height, pack.channels, mipOptions, pack.layers[page]);
+        truncate(pack.layers[page], levels);
+    }
+    return pack;
+}
+
+unsigned int TexturePacker::upload(const Pack& pack, GLint wrap, GLint minFilter, GLint magFilter)
+{
+    if (pack.layers.empty())
+        return 0;
+
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    GLState::bindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, minFilter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, magFilter);
+
+    const GLenum format = formatOf(pack.channels);
+    const std::vector<MipChain::Level>& levels = pack.layers[0].levels;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t level = 0; level < levels.size(); ++level)
+    {
+        // allocate the level for every layer, then fill the layers one by one
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, format, levels[level].width, levels[level].height, (GLsizei)pack.layers.size(),
+            0, format, GL_UNSIGNED_BYTE, NULL);
+        for (size_t layer = 0; layer < pack.layers.size(); ++layer)
+        {
+            const MipChain& chain = pack.layers[layer];
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, (GLint)layer, levels[level].width, levels[level].height, 1,
+                format, GL_UNSIGNED_BYTE, chain.data.data() + chain.levels[level].offset);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+
+    size_t bytes = 0;
+    for (const MipChain::Level& level : levels)
+        bytes += GpuMemory::textureBytes(level.width, level.height, pack.channels, false);
+    GpuMemory::track(GpuMemory::Kind::Texture, texture, bytes * pack.layers.size());
+    return texture;
+}
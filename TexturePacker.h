@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+#include "MipGenerator.h"
+
+#include <cstddef>
+#include <vector>
+
+
+
+// Packs many images into GL_TEXTURE_2D_ARRAY textures, so a whole scene can draw with one texture binding
+// instead of rebinding a texture per material.
+// Either images of the same size and channel count become the layers of one array texture each (packArrays),
+// or images of any size are packed into atlas pages, which are the layers of a single array texture (packAtlas).
+// Every image gets a Placement telling the shader where it ended up:
+//     texture(textures, vec3(uv * placement.scale + placement.offset, placement.layer))
+//
+// Packing only touches the CPU, so it can run on a loader thread; upload() then makes the texture on the GL thread.
+class TexturePacker
+{
+public:
+    // a decoded image, tightly packed, with channels (1 to 4) bytes per pixel
+    struct Image
+    {
+        const unsigned char* pixels;
+        int width, height, channels;
+    };
+
+    struct Placement
+    {
+        int pack = -1;               // which Pack the image is in; -1 if it couldn't be placed
+        int layer = 0;
+        float scale[2] = { 1.0f, 1.0f };
+        float offset[2] = { 0.0f, 0.0f };
+    };
+
+    // the contents of one array texture: a mip chain per layer, all layers the same size and channel count
+    struct Pack
+    {
+        int width = 0, height = 0, channels = 4;
+        std::vector<MipChain> layers;
+    };
+
+    struct AtlasOptions
+    {
+        int size = 2048;             // width and height of an atlas page
+        // Texels around each image, filled by repeating its edges, so bilinear filtering and the mip levels
+        // don't pull in the neighbours. Rounded up to a power of two; the images are aligned to it, and the atlas only
+        // gets the mip levels down to where the padding shrinks to one texel (a padding of 8 gives 4 levels).
+        int padding = 8;
+        bool srgb = false;           // average the mip levels in linear light, see MipGenerator::Options
+    };
+
+    // One pack per distinct size and channel count, each image a layer with its full mip chain.
+    // Returns the packs and fills placements with one entry per image.
+    static std::vector<Pack> packArrays(const std::vector<Image>& images, const MipGenerator::Options& mipOptions,
+        std::vector<Placement>& placements);
+
+    // Packs every image into the pages of a single pack, converted to the largest channel count among them
+    // (grey is spread to RGB, missing alpha is opaque). An image bigger than a page can't be placed and keeps pack -1.
+    // The sampler's wrap mode can't tile an image inside a page, so a tiling texture has to wrap its UVs in the shader
+    // (fract) before applying the placement.
+    static Pack packAtlas(const std::vector<Image>& images, const AtlasOptions& options, std::vector<Placement>& placements);
+
+    // Makes a GL_TEXTURE_2D_ARRAY holding the pack, with every mip level it has; returns the texture object.
+    // Its memory is counted by GpuMemory, so whoever deletes it should GpuMemory::forget it too.
+    static unsigned int upload(const Pack& pack, GLint wrap = GL_REPEAT, GLint minFilter = GL_LINEAR_MIPMAP_LINEAR, GLint magFilter = GL_LINEAR);
+};
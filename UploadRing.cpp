@@ -0,0 +1,161 @@
+#include "UploadRing.h"
+#include "GLState.h"
+#include "GpuMemory.h"
+
+#include <algorithm>
+#include <iostream>
+
+// glBufferStorage and the persistent map bits are only declared when glad was generated with GL 4.4 or ARB_buffer_storage
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+#define UPLOADRING_BUFFER_STORAGE
+#endif
+
+namespace
+{
+    bool hasBufferStorage()
+    {
+#ifdef GL_VERSION_4_4
+        if (GLAD_GL_VERSION_4_4)
+            return true;
+#endif
+#ifdef GL_ARB_buffer_storage
+        if (GLAD_GL_ARB_buffer_storage)
+            return true;
+#endif
+        return false;
+    }
+}
+
+UploadRing::UploadRing(size_t slotCount, size_t slotSize)
+    : slots(std::max<size_t>(slotCount, 1)), slotSize(slotSize)
+{
+}
+
+UploadRing::~UploadRing()
+{
+    release();
+}
+
+unsigned char* UploadRing::map(size_t size)
+{
+    if (!initialized)
+    {
+        // decided on first use, since the extensions are only known once a context is current
+        persistentMapping = hasBufferStorage();
+        initialized = true;
+    }
+
+    // only persistently mapped slots are fenced, an orphaned slot never waits for the GPU
+    Slot& slot = slots[current];
+    wait(slot);
+
+    if (slot.buffer == 0 || slot.size < size)
+        allocate(slot, std::max(size, slotSize));
+    GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+
+    if (slot.mapped)
+        return slot.mapped;
+
+    // Orphan the buffer: the driver hands over fresh storage if the GPU still reads the old one,
+    // instead of making the map wait for it.
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)slot.size, NULL, GL_STREAM_DRAW);
+    return (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+bool UploadRing::unmap()
+{
+    // a coherent persistent mapping needs no flush, the writes are visible to the commands issued after them
+    if (slots[current].mapped)
+        return true;
+
+    // glUnmapBuffer returns false if the buffer contents got corrupted while mapped
+    return glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+}
+
+void UploadRing::fence()
+{
+    // an orphaned slot gets fresh storage on its next map(), so there is nothing to wait for
+    Slot& slot = slots[current];
+    if (slot.mapped)
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    current = (current + 1) % slots.size();
+}
+
+void UploadRing::release()
+{
+    for (Slot& slot : slots)
+    {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        if (slot.buffer)
+        {
+            // deleting a buffer also unmaps it
+            glDeleteBuffers(1, &slot.buffer);
+            GLState::forgetBuffer(slot.buffer);
+            GpuMemory::forget(GpuMemory::Kind::Buffer, slot.buffer);
+        }
+        slot = Slot();
+    }
+    current = 0;
+    initialized = false;
+}
+
+void UploadRing::allocate(Slot& slot, size_t size)
+{
+    if (slot.buffer)
+    {
+        glDeleteBuffers(1, &slot.buffer);
+        GLState::forgetBuffer(slot.buffer);
+        GpuMemory::forget(GpuMemory::Kind::Buffer, slot.buffer);
+    }
+
+    glGenBuffers(1, &slot.buffer);
+    GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+    GpuMemory::track(GpuMemory::Kind::Buffer, slot.buffer, size);
+    slot.size = size;
+    slot.mapped = nullptr;
+
+#ifdef UPLOADRING_BUFFER_STORAGE
+    if (persistentMapping)
+    {
+        // immutable storage that stays mapped for the life of the buffer; the fences keep the CPU from overwriting data still in flight
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)size, NULL, flags);
+        slot.mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)size, flags);
+        if (slot.mapped)
+            return;
+
+        // Immutable storage can't be orphaned, so the slot starts over with a plain buffer. The slots that did map
+        // keep their mappings; the ones allocated from now on orphan.
+        std::cout << "Can't map the upload buffer persistently, orphaning it for every upload instead" << std::endl;
+        persistentMapping = false;
+        glDeleteBuffers(1, &slot.buffer);
+        GLState::forgetBuffer(slot.buffer);
+        GpuMemory::forget(GpuMemory::Kind::Buffer, slot.buffer);
+        glGenBuffers(1, &slot.buffer);
+        GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        GpuMemory::track(GpuMemory::Kind::Buffer, slot.buffer, size);
+    }
+#endif
+
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)size, NULL, GL_STREAM_DRAW);
+}
+
+void UploadRing::wait(Slot& slot)
+{
+    if (!slot.fence)
+        return;
+
+    // the first wait also flushes, so the fence is sure to reach the GPU and the loop can't hang
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    for (;;)
+    {
+        const GLenum result = glClientWaitSync(slot.fence, flags, 1000000); // 1 ms
+        if (result != GL_TIMEOUT_EXPIRED)
+            break; // signaled, or GL_WAIT_FAILED which waiting longer won't fix
+        flags = 0;
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+}
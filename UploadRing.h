@@ -0,0 +1,64 @@
+#pragma once
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+
+#include <cstddef>
+#include <vector>
+
+
+
+// A ring of pixel unpack buffers for streaming texture data to the GPU.
+// Each upload is written into the next slot of the ring, so the CPU fills one slot while the GPU is still copying out of the others.
+// With GL 4.4 or ARB_buffer_storage the slots are mapped once, persistently and coherently, and each gets a fence once
+// its upload commands are issued, so the CPU only waits if it laps the GPU.
+// On plain 3.3, or if a persistent mapping fails, the slot is orphaned and mapped again for every upload, which never waits.
+//
+// Usage, on the GL thread:
+//     unsigned char* pixels = ring.map(size);    // write size bytes here
+//     ring.unmap();                              // the slot is now bound to GL_PIXEL_UNPACK_BUFFER
+//     glTexImage2D(..., (void*)0);               // so the data pointer is an offset into it
+//     ring.fence();
+class UploadRing
+{
+public:
+    // slotSize is only the starting size, a slot grows when an upload doesn't fit
+    explicit UploadRing(size_t slotCount = 4, size_t slotSize = 4 << 20);
+    // deletes the buffers, so it must run while the GL context is alive (or after release())
+    ~UploadRing();
+
+    UploadRing(const UploadRing&) = delete;
+    UploadRing& operator=(const UploadRing&) = delete;
+
+    // Returns size writable bytes in the next slot, or nullptr if it couldn't be mapped. A persistently mapped slot is first waited on
+    // until the GPU no longer reads it.
+    // The slot's buffer is left bound to GL_PIXEL_UNPACK_BUFFER.
+    unsigned char* map(size_t size);
+    // Finishes writing the mapped slot. Returns false if the contents got lost, in which case nothing should be uploaded from it.
+    bool unmap();
+    // Fences the slot after the commands that read from it and moves on to the next one. Unbinds GL_PIXEL_UNPACK_BUFFER.
+    void fence();
+
+    // deletes every buffer and fence; the ring sets itself up again on the next map()
+    void release();
+
+    // whether new slots get mapped persistently
+    bool persistent() const { return persistentMapping; }
+
+private:
+    struct Slot
+    {
+        unsigned int buffer = 0;
+        size_t size = 0;
+        unsigned char* mapped = nullptr; // persistent mapping only
+        GLsync fence = 0;                // likewise
+    };
+
+    std::vector<Slot> slots;
+    size_t slotSize;
+    size_t current = 0;
+    bool persistentMapping = false;
+    bool initialized = false;
+
+    void allocate(Slot& slot, size_t size);
+    static void wait(Slot& slot);
+};
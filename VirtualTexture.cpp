@@ -0,0 +1,705 @@
+#include "VirtualTexture.h"
+#include "GLState.h"
+#include "GpuMemory.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+    // "VTEX" followed by the format version
+    const uint32_t magic = 0x58455456u;
+    const uint32_t version = 1;
+
+    // the size of the vtLevelSizes array in glsl()
+    const int maxLevels = 24;
+
+    // the feedback stores tile coordinates in 16 bits
+    const int maxPages = 65535;
+
+    // the file header, all little-endian uint32: magic, version, width, height, tileSize, border, level count,
+    // then the width and height of every level, then the tiles of each level, finest first, row by row
+    const size_t headerWords = 7;
+
+    // a tile that is never evicted, so every page table entry has something to fall back to
+    const uint64_t pinned = ~0ull;
+
+    int nextPowerOfTwo(int value)
+    {
+        int power = 1;
+        while (power < value)
+            power *= 2;
+        return power;
+    }
+
+    void writeWord(std::ofstream& file, uint32_t value)
+    {
+        const unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+        file.write((const char*)bytes, 4);
+    }
+
+    uint32_t readWord(const unsigned char* bytes)
+    {
+        return bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+    }
+
+    // reads one tile from the file, tileBytes long at offset
+    bool readTile(std::ifstream& file, size_t offset, std::vector<unsigned char>& pixels)
+    {
+        file.clear();
+        file.seekg((std::streamoff)offset);
+        file.read((char*)pixels.data(), (std::streamsize)pixels.size());
+        return (size_t)file.gcount() == pixels.size();
+    }
+
+    const char* shaderSource = R"(
+const int vtMaxLevels = 24;
+uniform usampler2D vtPageTable;
+uniform sampler2D vtCache;
+uniform vec2 vtLevelSizes[vtMaxLevels];
+uniform int vtLevelCount;
+uniform float vtTileSize;
+uniform float vtBorder;
+uniform float vtCacheSize;
+uniform float vtFeedbackBias;
+
+// the level a pixel needs, from how many level 0 texels it spans
+int vtLevel(vec2 uv, float bias)
+{
+    vec2 dx = dFdx(uv * vtLevelSizes[0]), dy = dFdy(uv * vtLevelSizes[0]);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + bias;
+    return clamp(int(floor(lod)), 0, vtLevelCount - 1);
+}
+
+ivec2 vtPage(vec2 uv, int level)
+{
+    vec2 size = vtLevelSizes[level];
+    return clamp(ivec2(uv * size / vtTileSize), ivec2(0), ivec2(ceil(size / vtTileSize)) - 1);
+}
+
+vec4 vtSample(vec2 uv)
+{
+    uv = clamp(uv, 0.0, 1.0);
+    int level = vtLevel(uv, 0.0);
+    // the tile's slot, or the slot of its nearest loaded ancestor and that ancestor's level
+    uvec4 entry = texelFetch(vtPageTable, vtPage(uv, level), level);
+    int loaded = int(entry.b);
+    vec2 inTile = uv * vtLevelSizes[loaded] - vec2(vtPage(uv, loaded)) * vtTileSize;
+    vec2 texel = vec2(entry.rg) * (vtTileSize + 2.0 * vtBorder) + vtBorder + inTile;
+    return textureLod(vtCache, texel / vtCacheSize, 0.0);
+}
+
+// the tile this pixel needs, for the feedback pass
+uvec4 vtFeedback(vec2 uv)
+{
+    uv = clamp(uv, 0.0, 1.0);
+    int level = vtLevel(uv, vtFeedbackBias);
+    return uvec4(uvec2(vtPage(uv, level)), uint(level), 1u);
+}
+)";
+}
+
+bool VirtualTexture::build(const unsigned char* pixels, int width, int height, const std::string& path,
+    int tileSize, int border, const MipGenerator::Options& mipOptions)
+{
+    if (width <= 0 || height <= 0 || tileSize <= 0 || border < 0 || border > tileSize)
+    {
+        std::cout << "Can't build virtual texture " << path << ": bad image or tile size" << std::endl;
+        return false;
+    }
+
+    // levels down to the first one that fits in a single tile
+    int levelCount = 1;
+    for (int w = width, h = height; std::max(w, h) > tileSize; w = std::max(1, w / 2), h = std::max(1, h / 2))
+        ++levelCount;
+    if (levelCount > maxLevels || (width + tileSize - 1) / tileSize > maxPages || (height + tileSize - 1) / tileSize > maxPages)
+    {
+        std::cout << "Can't build virtual texture " << path << ": too many tiles, use bigger ones" << std::endl;
+        return false;
+    }
+
+    MipChain chain;
+    MipGenerator::generate(pixels, width, height, 4, mipOptions, chain);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cout << "Can't write virtual texture " << path << std::endl;
+        return false;
+    }
+    const uint32_t header[headerWords] = { magic, version, (uint32_t)width, (uint32_t)height, (uint32_t)tileSize, (uint32_t)border, (uint32_t)levelCount };
+    for (uint32_t word : header)
+        writeWord(file, word);
+    for (int level = 0; level < levelCount; ++level)
+    {
+        writeWord(file, (uint32_t)chain.levels[level].width);
+        writeWord(file, (uint32_t)chain.levels[level].height);
+    }
+
+    // every tile with its border, which repeats the level's edge texels where there is no neighbour
+    const int stored = tileSize + 2 * border;
+    std::vector<unsigned char> tile((size_t)stored * stored * 4);
+    for (int level = 0; level < levelCount; ++level)
+    {
+        const MipChain::Level& mip = chain.levels[level];
+        const unsigned char* source = chain.data.data() + mip.offset;
+        const int pagesX = (mip.width + tileSize - 1) / tileSize, pagesY = (mip.height + tileSize - 1) / tileSize;
+        for (int pageY = 0; pageY < pagesY; ++pageY)
+            for (int pageX = 0; pageX < pagesX; ++pageX)
+            {
+                for (int y = 0; y < stored; ++y)
+                {
+                    const int sy = std::min(std::max(pageY * tileSize + y - border, 0), mip.height - 1);
+                    unsigned char* out = tile.data() + (size_t)y * stored * 4;
+                    for (int x = 0; x < stored; ++x, out += 4)
+                    {
+                        const int sx = std::min(std::max(pageX * tileSize + x - border, 0), mip.width - 1);
+                        memcpy(out, source + ((size_t)sy * mip.width + sx) * 4, 4);
+                    }
+                }
+                file.write((const char*)tile.data(), (std::streamsize)tile.size());
+            }
+    }
+
+    if (!file)
+    {
+        std::cout << "Failed to write virtual texture " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+const char* VirtualTexture::glsl()
+{
+    return shaderSource;
+}
+
+VirtualTexture::VirtualTexture(const std::string& path)
+    : VirtualTexture(path, Options())
+{
+}
+
+VirtualTexture::VirtualTexture(const std::string& path, const Options& options)
+    : path(path), options(options), uploadRing(4, 1 << 20)
+{
+    if (!open())
+        return;
+    createTextures();
+    if (!valid())
+        return;
+
+    // the coarsest level is one tile, loaded now and kept for good
+    const int root = tileIndex((int)levels.size() - 1, 0, 0);
+    std::ifstream file(path, std::ios::binary);
+    TileData data{ root, std::vector<unsigned char>(tileBytes) };
+    if (!readTile(file, dataOffset + (size_t)root * tileBytes, data.pixels))
+    {
+        std::cout << "Failed to read virtual texture " << path << std::endl;
+        deleteTextures();
+        return;
+    }
+    requested.insert(root);
+    loaded.push_back(std::move(data));
+    uploadTiles();
+    auto rootSlot = slotOf.find(root);
+    if (rootSlot == slotOf.end())
+    {
+        std::cout << "Failed to upload virtual texture " << path << std::endl;
+        deleteTextures();
+        return;
+    }
+    slots[rootSlot->second].lastUsed = pinned;
+    writePageTable();
+
+    if (this->options.workerCount == 0)
+        this->options.workerCount = 1;
+    for (unsigned int i = 0; i < this->options.workerCount; ++i)
+        workers.emplace_back(&VirtualTexture::work, this);
+}
+
+VirtualTexture::~VirtualTexture()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobQueued.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+
+    for (Readback& readback : readbacks)
+    {
+        if (readback.fence)
+            glDeleteSync(readback.fence);
+        if (readback.buffer)
+        {
+            GLState::forgetBuffer(readback.buffer);
+            GpuMemory::forget(GpuMemory::Kind::Buffer, readback.buffer);
+            glDeleteBuffers(1, &readback.buffer);
+        }
+    }
+    if (feedbackFramebuffer)
+    {
+        glDeleteFramebuffers(1, &feedbackFramebuffer);
+        glDeleteRenderbuffers(1, &feedbackColor);
+        glDeleteRenderbuffers(1, &feedbackDepth);
+        GpuMemory::forget(GpuMemory::Kind::Renderbuffer, feedbackColor);
+        GpuMemory::forget(GpuMemory::Kind::Renderbuffer, feedbackDepth);
+    }
+    deleteTextures();
+    uploadRing.release();
+}
+
+// Deletes the page table and the tile cache, which leaves the texture invalid.
+void VirtualTexture::deleteTextures()
+{
+    if (!pageTable)
+        return;
+    GLState::forgetTexture(pageTable);
+    GLState::forgetTexture(cache);
+    GpuMemory::forget(GpuMemory::Kind::Texture, pageTable);
+    GpuMemory::forget(GpuMemory::Kind::Texture, cache);
+    glDeleteTextures(1, &pageTable);
+    glDeleteTextures(1, &cache);
+    pageTable = cache = 0;
+}
+
+// Reads the header and works out the tile layout.
+bool VirtualTexture::open()
+{
+    std::ifstream file(path, std::ios::binary);
+    unsigned char bytes[headerWords * 4];
+    if (!file.read((char*)bytes, sizeof(bytes)) || readWord(bytes) != magic || readWord(bytes + 4) != version)
+    {
+        std::cout << "Failed to open virtual texture " << path << ": not a tile file" << std::endl;
+        return false;
+    }
+    const uint32_t levelCount = readWord(bytes + 24);
+    tileSize = (int)readWord(bytes + 16);
+    border = (int)readWord(bytes + 20);
+    if (levelCount == 0 || levelCount > (uint32_t)maxLevels || tileSize <= 0 || border > tileSize)
+    {
+        std::cout << "Failed to open virtual texture " << path << ": bad header" << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> sizes(levelCount * 8);
+    if (!file.read((char*)sizes.data(), (std::streamsize)sizes.size()))
+    {
+        std::cout << "Failed to open virtual texture " << path << ": truncated header" << std::endl;
+        return false;
+    }
+    int firstTile = 0;
+    for (uint32_t i = 0; i < levelCount; ++i)
+    {
+        Level level;
+        level.width = (int)readWord(sizes.data() + i * 8);
+        level.height = (int)readWord(sizes.data() + i * 8 + 4);
+        level.pagesX = (level.width + tileSize - 1) / tileSize;
+        level.pagesY = (level.height + tileSize - 1) / tileSize;
+        level.firstTile = firstTile;
+        firstTile += level.pagesX * level.pagesY;
+        levels.push_back(level);
+    }
+    if (levels.back().pagesX != 1 || levels.back().pagesY != 1)
+    {
+        std::cout << "Failed to open virtual texture " << path << ": the last level isn't a single tile" << std::endl;
+        levels.clear();
+        return false;
+    }
+
+    const int stored = tileSize + 2 * border;
+    tileBytes = stored * stored * 4;
+    dataOffset = (headerWords + 2 * levelCount) * 4;
+    return true;
+}
+
+// Makes the page table, with a mip level per image level, and the tile cache.
+void VirtualTexture::createTextures()
+{
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    const int stored = tileSize + 2 * border;
+    options.cacheTiles = std::min(std::max(options.cacheTiles, 2), std::min(256, maxSize / stored));
+
+    // Power-of-two sizes, so that halving them for each level, the way GL sizes mip levels, always leaves room
+    // for the level's tiles.
+    pageTableWidth = nextPowerOfTwo(levels[0].pagesX);
+    pageTableHeight = nextPowerOfTwo(levels[0].pagesY);
+    if (options.cacheTiles < 2 || pageTableWidth > maxSize || pageTableHeight > maxSize)
+    {
+        std::cout << "Virtual texture " << path << " needs bigger textures than this GPU has" << std::endl;
+        return;
+    }
+
+    glGenTextures(1, &pageTable);
+    GLState::bindTexture(GL_TEXTURE_2D, pageTable);
+    // integer textures can't be filtered, and the shader only uses texelFetch anyway
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    for (size_t level = 0; level < levels.size(); ++level)
+        glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_RGBA8UI, std::max(1, pageTableWidth >> level), std::max(1, pageTableHeight >> level),
+            0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+    GpuMemory::track(GpuMemory::Kind::Texture, pageTable, GpuMemory::textureBytes(pageTableWidth, pageTableHeight, 4));
+
+    glGenTextures(1, &cache);
+    GLState::bindTexture(GL_TEXTURE_2D, cache);
+    // the borders take care of filtering across tiles, so one level and plain bilinear filtering
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    const int cacheSize = options.cacheTiles * stored;
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cacheSize, cacheSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    GpuMemory::track(GpuMemory::Kind::Texture, cache, GpuMemory::textureBytes(cacheSize, cacheSize, 4, false));
+
+    slots.assign((size_t)options.cacheTiles * options.cacheTiles, Slot());
+    entries.resize(levels.size());
+    for (size_t level = 0; level < levels.size(); ++level)
+        entries[level].assign((size_t)levels[level].pagesX * levels[level].pagesY * 4, 0);
+}
+
+void VirtualTexture::bind(unsigned int program, GLuint pageTableUnit, GLuint cacheUnit) const
+{
+    GLState::bindTexture(pageTableUnit, GL_TEXTURE_2D, pageTable);
+    GLState::bindTexture(cacheUnit, GL_TEXTURE_2D, cache);
+
+    float sizes[maxLevels * 2] = {};
+    for (size_t level = 0; level < levels.size(); ++level)
+    {
+        sizes[level * 2] = (float)levels[level].width;
+        sizes[level * 2 + 1] = (float)levels[level].height;
+    }
+    glUniform1i(glGetUniformLocation(program, "vtPageTable"), (GLint)pageTableUnit);
+    glUniform1i(glGetUniformLocation(program, "vtCache"), (GLint)cacheUnit);
+    glUniform2fv(glGetUniformLocation(program, "vtLevelSizes"), (GLsizei)levels.size(), sizes);
+    glUniform1i(glGetUniformLocation(program, "vtLevelCount"), (GLint)levels.size());
+    glUniform1f(glGetUniformLocation(program, "vtTileSize"), (float)tileSize);
+    glUniform1f(glGetUniformLocation(program, "vtBorder"), (float)border);
+    glUniform1f(glGetUniformLocation(program, "vtCacheSize"), (float)(options.cacheTiles * (tileSize + 2 * border)));
+    // the feedback pass is feedbackDivisor times coarser, so its derivatives come out that much bigger
+    glUniform1f(glGetUniformLocation(program, "vtFeedbackBias"), -std::log2((float)std::max(options.feedbackDivisor, 1)));
+}
+
+void VirtualTexture::beginFeedback(int width, int height)
+{
+    const int divisor = std::max(options.feedbackDivisor, 1);
+    width = std::max(1, width / divisor);
+    height = std::max(1, height / divisor);
+
+    if (!feedbackFramebuffer)
+    {
+        glGenFramebuffers(1, &feedbackFramebuffer);
+        glGenRenderbuffers(1, &feedbackColor);
+        glGenRenderbuffers(1, &feedbackDepth);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+    if (width != feedbackWidth || height != feedbackHeight)
+    {
+        // tile x, tile y, level, and 1 where something was drawn
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackColor);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA16UI, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        GpuMemory::track(GpuMemory::Kind::Renderbuffer, feedbackColor, (size_t)width * height * 8);
+        GpuMemory::track(GpuMemory::Kind::Renderbuffer, feedbackDepth, (size_t)width * height * 4);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, feedbackColor);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+        feedbackWidth = width;
+        feedbackHeight = height;
+    }
+
+    glViewport(0, 0, width, height);
+    const GLuint nothing[4] = { 0, 0, 0, 0 };
+    glClearBufferuiv(GL_COLOR, 0, nothing);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void VirtualTexture::endFeedback()
+{
+    // Copied into a pixel pack buffer, which returns straight away; update() maps it once the fence says the GPU is done.
+    // If both buffers are still waiting, this frame's feedback is skipped rather than stalling.
+    Readback& readback = readbacks[nextReadback];
+    if (!readback.fence && feedbackFramebuffer)
+    {
+        if (!readback.buffer)
+            glGenBuffers(1, &readback.buffer);
+        GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        if (readback.width != feedbackWidth || readback.height != feedbackHeight)
+        {
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)feedbackWidth * feedbackHeight * 8, NULL, GL_STREAM_READ);
+            GpuMemory::track(GpuMemory::Kind::Buffer, readback.buffer, (size_t)feedbackWidth * feedbackHeight * 8);
+            readback.width = feedbackWidth;
+            readback.height = feedbackHeight;
+        }
+        glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, (void*)0);
+        GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        nextReadback = 1 - nextReadback;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void VirtualTexture::update()
+{
+    if (!valid())
+        return;
+    ++frame;
+
+    // the older readback first
+    for (int i = 0; i < 2; ++i)
+    {
+        Readback& readback = readbacks[(nextReadback + i) % 2];
+        if (!readback.fence)
+            continue;
+        const GLenum status = glClientWaitSync(readback.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(readback.fence);
+        readback.fence = 0;
+
+        const size_t count = (size_t)readback.width * readback.height;
+        GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        const void* texels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)count * 8, GL_MAP_READ_BIT);
+        if (texels)
+        {
+            readFeedback((const uint16_t*)texels, count);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    uploadTiles();
+    if (entriesDirty)
+        writePageTable();
+}
+
+// Marks the tiles the feedback shows, and their ancestors, as used this frame, and queues the missing ones.
+void VirtualTexture::readFeedback(const uint16_t* texels, size_t count)
+{
+    lastFeedback = frame;
+    std::unordered_set<int> seen;
+    std::vector<int> missing;
+    int previous = -1;
+    for (size_t i = 0; i < count; ++i, texels += 4)
+    {
+        if (texels[3] == 0 || texels[2] >= levels.size())
+            continue;
+        int level = texels[2], x = texels[0], y = texels[1];
+        if (x >= levels[level].pagesX || y >= levels[level].pagesY)
+            continue;
+        // neighbouring pixels mostly want the same tile
+        const int tile = tileIndex(level, x, y);
+        if (tile == previous || !seen.insert(tile).second)
+            continue;
+        previous = tile;
+
+        for (;;)
+        {
+            const int ancestor = tileIndex(level, x, y);
+            auto slot = slotOf.find(ancestor);
+            if (slot != slotOf.end())
+                slots[slot->second].lastUsed = std::max(slots[slot->second].lastUsed, frame);
+            else if (!requested.count(ancestor))
+                missing.push_back(ancestor);
+            if (++level == (int)levels.size())
+                break;
+            x = std::min(x / 2, levels[level].pagesX - 1);
+            y = std::min(y / 2, levels[level].pagesY - 1);
+            if (!seen.insert(tileIndex(level, x, y)).second)
+                break; // and its ancestors were seen too
+        }
+    }
+
+    // coarse levels first, they're what most of the screen falls back to
+    std::sort(missing.begin(), missing.end());
+    missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+    std::reverse(missing.begin(), missing.end());
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // tiles queued for an earlier view and no longer wanted aren't worth reading anymore
+        for (auto job = jobs.begin(); job != jobs.end();)
+        {
+            if (seen.count(*job))
+            {
+                ++job;
+                continue;
+            }
+            requested.erase(*job);
+            job = jobs.erase(job);
+        }
+        for (int tile : missing)
+        {
+            requested.insert(tile);
+            jobs.push_back(tile);
+        }
+    }
+    if (!missing.empty())
+        jobQueued.notify_all();
+}
+
+void VirtualTexture::work()
+{
+    std::ifstream file(path, std::ios::binary);
+    for (;;)
+    {
+        int tile;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobQueued.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+            tile = jobs.front();
+            jobs.pop_front();
+        }
+
+        TileData data{ tile, std::vector<unsigned char>(tileBytes) };
+        if (!readTile(file, dataOffset + (size_t)tile * tileBytes, data.pixels))
+            data.pixels.clear();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        loaded.push_back(std::move(data));
+    }
+}
+
+// Uploads up to tilesPerUpdate of the tiles that have been read, all staged in one upload ring slot.
+void VirtualTexture::uploadTiles()
+{
+    std::vector<TileData> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!loaded.empty() && (int)batch.size() < options.tilesPerUpdate)
+        {
+            batch.push_back(std::move(loaded.front()));
+            loaded.pop_front();
+        }
+    }
+
+    struct Upload { const TileData* data; int slot; };
+    std::vector<Upload> uploads;
+    for (const TileData& data : batch)
+    {
+        if (data.pixels.empty())
+        {
+            // stays in requested, so it isn't asked for again
+            std::cout << "Failed to read tile " << data.tile << " of virtual texture " << path << std::endl;
+            continue;
+        }
+        requested.erase(data.tile);
+        const int slot = allocateSlot(data.tile);
+        if (slot >= 0)
+            uploads.push_back({ &data, slot });
+        // otherwise the cache is full of tiles in view; it will be asked for again if it's still needed
+    }
+    if (uploads.empty())
+        return;
+
+    unsigned char* staging = uploadRing.map(uploads.size() * tileBytes);
+    bool staged = staging != nullptr;
+    if (staged)
+    {
+        for (size_t i = 0; i < uploads.size(); ++i)
+            memcpy(staging + i * tileBytes, uploads[i].data->pixels.data(), tileBytes);
+        staged = uploadRing.unmap();
+    }
+    if (staged)
+    {
+        const int stored = tileSize + 2 * border;
+        GLState::bindTexture(GL_TEXTURE_2D, cache);
+        for (size_t i = 0; i < uploads.size(); ++i)
+        {
+            const int slot = uploads[i].slot;
+            glTexSubImage2D(GL_TEXTURE_2D, 0, slot % options.cacheTiles * stored, slot / options.cacheTiles * stored, stored, stored,
+                GL_RGBA, GL_UNSIGNED_BYTE, (void*)(i * tileBytes));
+            slotOf[uploads[i].data->tile] = slot;
+        }
+    }
+    else
+    {
+        for (const Upload& upload : uploads)
+            slots[upload.slot].tile = -1;
+    }
+    uploadRing.fence();
+    entriesDirty = true;
+}
+
+// Gives tile a free slot, or else the least recently used one whose tile wasn't in the last feedback; -1 if there is none.
+int VirtualTexture::allocateSlot(int tile)
+{
+    int best = -1;
+    for (size_t i = 0; i < slots.size(); ++i)
+    {
+        const Slot& slot = slots[i];
+        if (slot.tile < 0)
+        {
+            best = (int)i;
+            break;
+        }
+        if (slot.lastUsed == pinned || slot.lastUsed >= lastFeedback)
+            continue;
+        if (best < 0 || slot.lastUsed < slots[best].lastUsed)
+            best = (int)i;
+    }
+    if (best < 0)
+        return -1;
+
+    // the evicted tile falls back to its ancestors from the next page table write on
+    Slot& slot = slots[best];
+    if (slot.tile >= 0)
+        slotOf.erase(slot.tile);
+    slot.tile = tile;
+    slot.lastUsed = frame;
+    return best;
+}
+
+// Rebuilds the page table from the coarsest level down: a loaded tile points at its own slot, any other tile at
+// whatever its parent points at. Then uploads every level.
+void VirtualTexture::writePageTable()
+{
+    for (int level = (int)levels.size() - 1; level >= 0; --level)
+    {
+        const Level& info = levels[level];
+        unsigned char* entry = entries[level].data();
+        for (int y = 0; y < info.pagesY; ++y)
+            for (int x = 0; x < info.pagesX; ++x, entry += 4)
+            {
+                auto slot = slotOf.find(tileIndex(level, x, y));
+                if (slot != slotOf.end())
+                {
+                    entry[0] = (unsigned char)(slot->second % options.cacheTiles);
+                    entry[1] = (unsigned char)(slot->second / options.cacheTiles);
+                    entry[2] = (unsigned char)level;
+                    entry[3] = 0;
+                }
+                else if (level == (int)levels.size() - 1)
+                {
+                    // the root tile is pinned, so this can't happen; there is no coarser level to fall back to anyway
+                    memset(entry, 0, 4);
+                }
+                else
+                {
+                    const Level& parent = levels[level + 1];
+                    const int parentX = std::min(x / 2, parent.pagesX - 1), parentY = std::min(y / 2, parent.pagesY - 1);
+                    memcpy(entry, entries[level + 1].data() + ((size_t)parentY * parent.pagesX + parentX) * 4, 4);
+                }
+            }
+    }
+
+    GLState::bindTexture(GL_TEXTURE_2D, pageTable);
+    for (size_t level = 0; level < levels.size(); ++level)
+        glTexSubImage2D(GL_TEXTURE_2D, (GLint)level, 0, 0, levels[level].pagesX, levels[level].pagesY,
+            GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, entries[level].data());
+    entriesDirty = false;
+}
+
+int VirtualTexture::tileIndex(int level, int x, int y) const
+{
+    return levels[level].firstTile + y * levels[level].pagesX + x;
+}
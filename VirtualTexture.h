@@ -0,0 +1,153 @@
+#pragma once
+
+#include <glad/glad.h> // include glad to get all the required OpenGL headers
+#include "MipGenerator.h"
+#include "UploadRing.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+
+// A texture too big to upload whole (larger than GL_MAX_TEXTURE_SIZE, or than the VRAM it deserves), drawn from
+// a fixed-size cache of tiles that are streamed in as the view needs them.
+//
+// The image is cut offline into square tiles for every mip level and stored in a tile file (build()).
+// On the GPU there are two textures:
+//     - the tile cache, a grid of tile slots, each holding one tile plus a border for bilinear filtering;
+//     - the page table, an integer texture with a mip level per image level and a texel per tile, telling which slot
+//       holds that tile. A tile that isn't loaded points at its nearest loaded ancestor instead, so the shader always
+//       finds something to draw, just blurrier. The coarsest level is a single tile that is always loaded.
+// Which tiles the view needs comes from a feedback pass: the scene is drawn at a fraction of the resolution with
+// a shader that writes the tile each pixel samples (see glsl()). The result is read back asynchronously and the
+// missing tiles are read from the file by worker threads, then uploaded a few per frame.
+//
+// Per frame, on the GL thread:
+//     vt.beginFeedback(width, height);  // draw the scene with the feedback shader
+//     vt.endFeedback();
+//     vt.update();                      // then draw the scene, sampling with vtSample()
+class VirtualTexture
+{
+public:
+    struct Options
+    {
+        int cacheTiles = 16;         // the cache is cacheTiles x cacheTiles slots, at most 256
+        int feedbackDivisor = 8;     // the feedback pass runs at 1/feedbackDivisor of the view resolution
+        unsigned int workerCount = 1;
+        int tilesPerUpdate = 16;     // tiles uploaded by one update() at most
+    };
+
+    // Writes the tile file for a width x height RGBA image: its mip chain, cut into tileSize x tileSize tiles, each stored
+    // with border texels from its neighbours around it. Returns false if the file couldn't be written.
+    // The whole image and its mip chain are built in memory; tiles past 65535 per side aren't supported.
+    static bool build(const unsigned char* pixels, int width, int height, const std::string& path,
+        int tileSize = 128, int border = 4, const MipGenerator::Options& mipOptions = MipGenerator::Options());
+
+    // The GLSL declarations and functions for shaders that sample a virtual texture: vtSample(uv) for drawing and
+    // vtFeedback(uv) for the feedback pass, whose output must be a uvec4. Goes after the #version line.
+    static const char* glsl();
+
+    // opens the tile file and creates the textures, so it needs a current GL context; check valid() afterwards
+    explicit VirtualTexture(const std::string& path, const Options& options);
+    explicit VirtualTexture(const std::string& path);
+    // must run while the GL context is alive
+    ~VirtualTexture();
+
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+    bool valid() const { return pageTable != 0; }
+    int width() const { return levels.empty() ? 0 : levels[0].width; }
+    int height() const { return levels.empty() ? 0 : levels[0].height; }
+
+    // binds the page table and the tile cache, and sets the vt* uniforms of program, which must be in use
+    void bind(unsigned int program, GLuint pageTableUnit, GLuint cacheUnit) const;
+
+    // binds the feedback framebuffer, sized for a view of width x height, and clears it; restore the viewport afterwards
+    void beginFeedback(int width, int height);
+    // starts reading the feedback back, and binds the default framebuffer again
+    void endFeedback();
+
+    // Takes in feedback that has arrived, queues the missing tiles and uploads the tiles that have been read.
+    void update();
+
+    // tiles currently in the cache
+    size_t residentTiles() const { return slotOf.size(); }
+    // tiles requested and not yet uploaded
+    size_t pendingTiles() const { return requested.size(); }
+
+private:
+    struct Level
+    {
+        int width, height;
+        int pagesX, pagesY;      // tiles across and down
+        int firstTile;           // index of its first tile in the file
+    };
+
+    struct Slot
+    {
+        int tile = -1;
+        uint64_t lastUsed = 0;
+    };
+
+    struct Readback
+    {
+        unsigned int buffer = 0;
+        GLsync fence = 0;
+        int width = 0, height = 0;
+    };
+
+    struct TileData
+    {
+        int tile;
+        std::vector<unsigned char> pixels;
+    };
+
+    std::string path;
+    Options options;
+    int tileSize = 0, border = 0, tileBytes = 0;
+    size_t dataOffset = 0;
+    std::vector<Level> levels;
+
+    unsigned int pageTable = 0, cache = 0;
+    int pageTableWidth = 0, pageTableHeight = 0;
+    std::vector<std::vector<unsigned char>> entries;   // per level, the page table contents, 4 bytes per tile
+    bool entriesDirty = true;
+
+    std::vector<Slot> slots;
+    std::unordered_map<int, int> slotOf;         // tile -> slot
+    std::unordered_set<int> requested;           // tiles queued, being read, or waiting for upload
+    uint64_t lastFeedback = 0;                   // frame of the last feedback taken in
+    uint64_t frame = 1;
+    UploadRing uploadRing;
+
+    unsigned int feedbackFramebuffer = 0, feedbackColor = 0, feedbackDepth = 0;
+    int feedbackWidth = 0, feedbackHeight = 0;
+    Readback readbacks[2];
+    int nextReadback = 0;
+
+    // shared with the workers, guarded by mutex
+    std::mutex mutex;
+    std::condition_variable jobQueued;
+    std::deque<int> jobs;
+    std::deque<TileData> loaded;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    bool open();
+    void createTextures();
+    void deleteTextures();
+    void work();
+    void readFeedback(const uint16_t* texels, size_t count);
+    void uploadTiles();
+    int allocateSlot(int tile);
+    void writePageTable();
+    int tileIndex(int level, int x, int y) const;
+};
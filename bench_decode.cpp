@@ -0,0 +1,1827 @@
+// Decoder benchmark for stb_image.
+//
+// Builds a deterministic synthetic corpus in memory (gradients, noise and photo-like pictures at a few sizes
+// and channel counts), encodes it as JPEG, PNG, GIF, HDR, TGA, BMP, PSD and PNM with the small encoders below,
+// then decodes every file over and over and reports images/s and MB/s of decoded pixels for each one.
+// Built with STBI_PROFILE it also splits the decode time into the stages stb_image counts:
+// JPEG Huffman decoding, IDCT and colour conversion, PNG inflate and unfiltering, and channel conversion.
+//
+// It compiles the stb_image implementation itself, so build it on its own, not together with stb_image.cpp:
+//   g++ -O2 -std=c++17 -DSTBI_PROFILE bench_decode.cpp -o bench_decode
+//   cl /O2 /EHsc /std:c++17 /DSTBI_PROFILE bench_decode.cpp
+//
+// Usage: bench_decode [--filter text] [--min-time seconds] [--channels n] [--dump directory]
+//   --filter    only run the cases whose name contains text, e.g. "png", "jpeg 420" or "photo 1920x1080"
+//   --min-time  how long to keep decoding each file, 0.2 seconds by default
+//   --channels  ask the loaders for n channels (req_comp), which adds the channel conversion stage
+//   --dump      write the corpus into a directory instead of timing it
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace
+{
+    typedef std::vector<unsigned char> Bytes;
+
+    // splitmix64, so the corpus comes out the same on every run and every machine
+    class Random
+    {
+    public:
+        explicit Random(uint64_t seed) : state(seed) {}
+
+        uint64_t next()
+        {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        // uniform in [lo, hi)
+        double range(double lo, double hi)
+        {
+            return lo + (hi - lo) * ((next() >> 11) * (1.0 / 9007199254740992.0));
+        }
+
+    private:
+        uint64_t state;
+    };
+
+    void put8(Bytes& out, unsigned v) { out.push_back((unsigned char)v); }
+    void put16le(Bytes& out, unsigned v) { put8(out, v & 255); put8(out, (v >> 8) & 255); }
+    void put32le(Bytes& out, uint32_t v) { put16le(out, v & 0xffff); put16le(out, v >> 16); }
+    void put16be(Bytes& out, unsigned v) { put8(out, (v >> 8) & 255); put8(out, v & 255); }
+    void put32be(Bytes& out, uint32_t v) { put16be(out, v >> 16); put16be(out, v & 0xffff); }
+    void putString(Bytes& out, const char* s) { out.insert(out.end(), s, s + strlen(s)); }
+
+
+#pragma region Pictures
+    enum class Content { Gradient, Noise, Photo };
+
+    const char* contentName(Content content)
+    {
+        switch (content)
+        {
+        case Content::Gradient: return "gradient";
+        case Content::Noise:    return "noise";
+        default:                return "photo";
+        }
+    }
+
+    // An RGBA picture with 16 bits per sample. The 8-bit encoders use the top byte of each sample.
+    struct Picture
+    {
+        int width = 0, height = 0;
+        std::vector<uint16_t> rgba;
+
+        // the picture as interleaved samples with 1 (luma), 2 (luma, alpha), 3 (RGB) or 4 (RGBA) channels
+        std::vector<uint16_t> samples(int channels) const
+        {
+            size_t count = (size_t)width * height;
+            std::vector<uint16_t> out(count * channels);
+            for (size_t i = 0; i < count; ++i)
+            {
+                const uint16_t* p = &rgba[i * 4];
+                uint16_t* q = &out[i * channels];
+                if (channels <= 2)
+                {
+                    q[0] = (uint16_t)((p[0] * 19595u + p[1] * 38470u + p[2] * 7471u + 32768u) >> 16);
+                    if (channels == 2)
+                        q[1] = p[3];
+                }
+                else
+                {
+                    for (int c = 0; c < channels; ++c)
+                        q[c] = p[c];
+                }
+            }
+            return out;
+        }
+    };
+
+    Bytes to8(const std::vector<uint16_t>& samples)
+    {
+        Bytes out(samples.size());
+        for (size_t i = 0; i < samples.size(); ++i)
+            out[i] = (unsigned char)(samples[i] >> 8);
+        return out;
+    }
+
+    template <class T>
+    Bytes bytesOf(const std::vector<T>& values)
+    {
+        Bytes out(values.size() * sizeof(T));
+        if (!values.empty())
+            memcpy(out.data(), values.data(), out.size());
+        return out;
+    }
+
+    uint16_t toSample(double v)
+    {
+        return (uint16_t)std::lround(std::min(std::max(v, 0.0), 1.0) * 65535.0);
+    }
+
+    // Something with the statistics of a photo: smooth shading, hard-edged objects and a little grain.
+    void makePhoto(Picture& pic, Random& rng)
+    {
+        const double pi = 3.14159265358979323846;
+        int w = pic.width, h = pic.height;
+        std::vector<double> rgb((size_t)w * h * 3);
+
+        // a sky-to-ground blend with a low-frequency ripple over it
+        double top[3], bottom[3];
+        std::vector<double> waveX((size_t)w * 3), waveY((size_t)h * 3);
+        for (int c = 0; c < 3; ++c)
+        {
+            top[c] = rng.range(0.4, 0.95);
+            bottom[c] = rng.range(0.05, 0.5);
+            double fx = rng.range(1.0, 5.0) * 2.0 * pi / w, px = rng.range(0.0, 2.0 * pi);
+            double fy = rng.range(1.0, 5.0) * 2.0 * pi / h, py = rng.range(0.0, 2.0 * pi);
+            for (int x = 0; x < w; ++x)
+                waveX[x * 3 + c] = std::sin(fx * x + px);
+            for (int y = 0; y < h; ++y)
+                waveY[y * 3 + c] = std::sin(fy * y + py);
+        }
+        for (int y = 0; y < h; ++y)
+        {
+            double t = h > 1 ? y / (double)(h - 1) : 0.0;
+            for (int x = 0; x < w; ++x)
+                for (int c = 0; c < 3; ++c)
+                    rgb[((size_t)y * w + x) * 3 + c] = top[c] * (1.0 - t) + bottom[c] * t + 0.08 * waveX[x * 3 + c] * waveY[y * 3 + c];
+        }
+
+        // a couple dozen shaded ellipses standing in for objects
+        for (int blob = 0; blob < 24; ++blob)
+        {
+            double cx = rng.range(0.0, w), cy = rng.range(0.0, h);
+            double rx = rng.range(0.03, 0.25) * w + 1.0, ry = rng.range(0.03, 0.25) * h + 1.0;
+            double opacity = rng.range(0.6, 1.0);
+            double color[3];
+            for (int c = 0; c < 3; ++c)
+                color[c] = rng.range(0.0, 1.0);
+
+            int x0 = std::max(0, (int)(cx - rx)), x1 = std::min(w - 1, (int)(cx + rx));
+            int y0 = std::max(0, (int)(cy - ry)), y1 = std::min(h - 1, (int)(cy + ry));
+            for (int y = y0; y <= y1; ++y)
+            {
+                for (int x = x0; x <= x1; ++x)
+                {
+                    double dx = (x - cx) / rx, dy = (y - cy) / ry;
+                    double d = dx * dx + dy * dy;
+                    if (d >= 1.0)
+                        continue;
+                    // anti-aliased rim and darker towards the edge, like a lit surface
+                    double a = opacity * (d < 0.9 ? 1.0 : (1.0 - d) * 10.0);
+                    double shade = 1.0 - 0.35 * d;
+                    double* p = &rgb[((size_t)y * w + x) * 3];
+                    for (int c = 0; c < 3; ++c)
+                        p[c] = p[c] * (1.0 - a) + color[c] * shade * a;
+                }
+            }
+        }
+
+        for (int y = 0; y < h; ++y)
+        {
+            for (int x = 0; x < w; ++x)
+            {
+                size_t i = (size_t)y * w + x;
+                for (int c = 0; c < 3; ++c)
+                    pic.rgba[i * 4 + c] = toSample(rgb[i * 3 + c] + rng.range(-0.015, 0.015));
+
+                // opaque in the middle, fading out towards the corners
+                double ex = w > 1 ? 2.0 * x / (w - 1) - 1.0 : 0.0, ey = h > 1 ? 2.0 * y / (h - 1) - 1.0 : 0.0;
+                pic.rgba[i * 4 + 3] = toSample((1.0 - std::sqrt((ex * ex + ey * ey) * 0.5)) * 2.5);
+            }
+        }
+    }
+
+    Picture makePicture(Content content, int width, int height)
+    {
+        Picture pic;
+        pic.width = width;
+        pic.height = height;
+        pic.rgba.resize((size_t)width * height * 4);
+        Random rng(0x5EEDull * 1000003u + (uint64_t)content * 7919u + (uint64_t)width * 65536u + height);
+
+        switch (content)
+        {
+        case Content::Gradient:
+            for (int y = 0; y < height; ++y)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    double fx = width > 1 ? x / (double)(width - 1) : 0.0, fy = height > 1 ? y / (double)(height - 1) : 0.0;
+                    uint16_t* p = &pic.rgba[((size_t)y * width + x) * 4];
+                    p[0] = toSample(fx);
+                    p[1] = toSample(fy);
+                    p[2] = toSample(1.0 - (fx + fy) * 0.5);
+                    p[3] = toSample(0.25 + 0.75 * fx);
+                }
+            }
+            break;
+        case Content::Noise:
+            for (uint16_t& sample : pic.rgba)
+                sample = (uint16_t)rng.next();
+            break;
+        case Content::Photo:
+            makePhoto(pic, rng);
+            break;
+        }
+        return pic;
+    }
+#pragma endregion
+
+
+    // An encoded file, plus what stb_image should give back for it when asked for the file's own channel count.
+    struct Encoded
+    {
+        Bytes file;
+        const char* extension = "";
+        int channels = 0;   // channels the loader returns
+        int bits = 8;       // 8 or 16 bits per channel, 32 for float (HDR)
+        Bytes expected;     // the exact decoded pixels, or empty if they aren't known exactly
+        Bytes approx;       // for lossy formats: the source pixels, compared by PSNR
+    };
+
+
+#pragma region Bit writers
+    // DEFLATE and GIF's LZW pack codes starting at the least significant bit
+    class BitWriterLsb
+    {
+    public:
+        explicit BitWriterLsb(Bytes& out) : out(out) {}
+
+        void put(uint32_t value, int count)
+        {
+            bits |= (uint64_t)value << used;
+            used += count;
+            while (used >= 8)
+            {
+                put8(out, (unsigned)bits & 255);
+                bits >>= 8;
+                used -= 8;
+            }
+        }
+
+        void flush()
+        {
+            if (used > 0)
+                put8(out, (unsigned)bits & 255);
+            bits = 0;
+            used = 0;
+        }
+
+    private:
+        Bytes& out;
+        uint64_t bits = 0;
+        int used = 0;
+    };
+
+    // JPEG packs them starting at the most significant bit, with a zero stuffed after every 0xFF
+    class BitWriterMsb
+    {
+    public:
+        explicit BitWriterMsb(Bytes& out) : out(out) {}
+
+        void put(uint32_t value, int count)
+        {
+            bits = (bits << count) | (value & ((1u << count) - 1));
+            used += count;
+            while (used >= 8)
+            {
+                unsigned byte = (unsigned)(bits >> (used - 8)) & 255;
+                put8(out, byte);
+                if (byte == 0xFF)
+                    put8(out, 0);
+                used -= 8;
+            }
+            bits &= (1u << used) - 1;
+        }
+
+        // pad the last byte with 1 bits, as the standard asks
+        void flush()
+        {
+            if (used > 0)
+                put((1u << (8 - used)) - 1, 8 - used);
+        }
+
+    private:
+        Bytes& out;
+        uint32_t bits = 0;
+        int used = 0;
+    };
+#pragma endregion
+
+
+#pragma region PNG
+    uint32_t crc32(const unsigned char* data, size_t size)
+    {
+        static uint32_t table[256];
+        if (table[1] == 0)
+        {
+            for (uint32_t n = 0; n < 256; ++n)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k)
+                    c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+        }
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; ++i)
+            crc = table[(crc ^ data[i]) & 255] ^ (crc >> 8);
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    uint32_t adler32(const Bytes& data)
+    {
+        uint32_t a = 1, b = 0;
+        for (unsigned char byte : data)
+        {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    // Huffman code lengths for the given symbol frequencies, none longer than maxBits.
+    // Too-long trees are fixed by flattening the frequencies and trying again, which is what simple encoders do.
+    std::vector<uint8_t> huffmanLengths(const std::vector<uint32_t>& frequencies, int maxBits)
+    {
+        size_t count = frequencies.size();
+        std::vector<uint8_t> lengths(count, 0);
+        std::vector<uint64_t> weights(frequencies.begin(), frequencies.end());
+
+        std::vector<size_t> used;
+        for (size_t i = 0; i < count; ++i)
+            if (weights[i] > 0)
+                used.push_back(i);
+        // a single code still needs a sibling for the code to be complete
+        if (used.size() < 2)
+        {
+            size_t only = used.empty() ? 0 : used[0];
+            lengths[only] = 1;
+            lengths[only == 0 ? 1 : 0] = 1;
+            return lengths;
+        }
+
+        for (;;)
+        {
+            typedef std::pair<uint64_t, size_t> Node;
+            std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+            std::vector<size_t> parent(count + used.size(), SIZE_MAX);
+            for (size_t symbol : used)
+                queue.push(Node(weights[symbol], symbol));
+
+            size_t next = count;
+            while (queue.size() > 1)
+            {
+                Node a = queue.top(); queue.pop();
+                Node b = queue.top(); queue.pop();
+                parent[a.second] = parent[b.second] = next;
+                queue.push(Node(a.first + b.first, next++));
+            }
+
+            int longest = 0;
+            for (size_t symbol : used)
+            {
+                int depth = 0;
+                for (size_t node = symbol; parent[node] != SIZE_MAX; node = parent[node])
+                    ++depth;
+                lengths[symbol] = (uint8_t)depth;
+                longest = std::max(longest, depth);
+            }
+            if (longest <= maxBits)
+                return lengths;
+
+            for (size_t symbol : used)
+                weights[symbol] = (weights[symbol] + 1) / 2;
+        }
+    }
+
+    // canonical codes for the lengths, bit-reversed so BitWriterLsb sends them most significant bit first
+    std::vector<uint16_t> canonicalCodes(const std::vector<uint8_t>& lengths)
+    {
+        int perLength[16] = { 0 }, nextCode[16] = { 0 };
+        for (uint8_t length : lengths)
+            if (length)
+                ++perLength[length];
+        for (int bits = 1, code = 0; bits < 16; ++bits)
+        {
+            code = (code + perLength[bits - 1]) << 1;
+            nextCode[bits] = code;
+        }
+
+        std::vector<uint16_t> codes(lengths.size(), 0);
+        for (size_t i = 0; i < lengths.size(); ++i)
+        {
+            if (!lengths[i])
+                continue;
+            int code = nextCode[lengths[i]]++, reversed = 0;
+            for (int b = 0; b < lengths[i]; ++b)
+                reversed |= ((code >> b) & 1) << (lengths[i] - 1 - b);
+            codes[i] = (uint16_t)reversed;
+        }
+        return codes;
+    }
+
+    const int lengthBase[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+    const int lengthExtra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+    const int distanceBase[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+    const int distanceExtra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+    int lengthCode(int length)
+    {
+        int code = 28;
+        while (lengthBase[code] > length)
+            --code;
+        return code;
+    }
+
+    int distanceCode(int distance)
+    {
+        int code = 29;
+        while (distanceBase[code] > distance)
+            --code;
+        return code;
+    }
+
+    // a literal byte (distance 0) or a back-reference
+    struct Token
+    {
+        uint16_t length;
+        uint16_t distance;
+    };
+
+    // one DEFLATE block with its own dynamic Huffman tables
+    void writeDeflateBlock(BitWriterLsb& bits, const std::vector<Token>& tokens, bool last)
+    {
+        std::vector<uint32_t> literalFrequencies(286, 0), distanceFrequencies(30, 0);
+        for (const Token& token : tokens)
+        {
+            if (token.distance == 0)
+                ++literalFrequencies[token.length];
+            else
+            {
+                ++literalFrequencies[257 + lengthCode(token.length)];
+                ++distanceFrequencies[distanceCode(token.distance)];
+            }
+        }
+        ++literalFrequencies[256];
+
+        std::vector<uint8_t> literalLengths = huffmanLengths(literalFrequencies, 15);
+        std::vector<uint8_t> distanceLengths = huffmanLengths(distanceFrequencies, 15);
+        std::vector<uint16_t> literalCodes = canonicalCodes(literalLengths);
+        std::vector<uint16_t> distanceCodes = canonicalCodes(distanceLengths);
+
+        int literalCount = 286, distanceCount = 30;
+        while (literalCount > 257 && !literalLengths[literalCount - 1])
+            --literalCount;
+        while (distanceCount > 1 && !distanceLengths[distanceCount - 1])
+            --distanceCount;
+
+        // the two length tables go out as one run-length coded sequence of code length symbols
+        std::vector<uint8_t> all(literalLengths.begin(), literalLengths.begin() + literalCount);
+        all.insert(all.end(), distanceLengths.begin(), distanceLengths.begin() + distanceCount);
+        std::vector<std::pair<int, int>> symbols; // symbol, extra bits value
+        for (size_t i = 0; i < all.size();)
+        {
+            size_t run = 1;
+            while (i + run < all.size() && all[i + run] == all[i])
+                ++run;
+            size_t left = run;
+            if (all[i] == 0)
+            {
+                while (left >= 11)
+                {
+                    size_t n = std::min<size_t>(left, 138);
+                    symbols.push_back(std::make_pair(18, (int)n - 11));
+                    left -= n;
+                }
+                if (left >= 3)
+                {
+                    symbols.push_back(std::make_pair(17, (int)left - 3));
+                    left = 0;
+                }
+            }
+            else
+            {
+                symbols.push_back(std::make_pair((int)all[i], 0));
+                --left;
+                while (left >= 3)
+                {
+                    size_t n = std::min<size_t>(left, 6);
+                    symbols.push_back(std::make_pair(16, (int)n - 3));
+                    left -= n;
+                }
+            }
+            for (; left > 0; --left)
+                symbols.push_back(std::make_pair((int)all[i], 0));
+            i += run;
+        }
+
+        std::vector<uint32_t> lengthFrequencies(19, 0);
+        for (const std::pair<int, int>& symbol : symbols)
+            ++lengthFrequencies[symbol.first];
+        std::vector<uint8_t> lengthLengths = huffmanLengths(lengthFrequencies, 7);
+        std::vector<uint16_t> lengthCodes = canonicalCodes(lengthLengths);
+        static const int order[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+        int lengthCount = 19;
+        while (lengthCount > 4 && !lengthLengths[order[lengthCount - 1]])
+            --lengthCount;
+
+        bits.put(last ? 1 : 0, 1);
+        bits.put(2, 2);
+        bits.put(literalCount - 257, 5);
+        bits.put(distanceCount - 1, 5);
+        bits.put(lengthCount - 4, 4);
+        for (int i = 0; i < lengthCount; ++i)
+            bits.put(lengthLengths[order[i]], 3);
+        for (const std::pair<int, int>& symbol : symbols)
+        {
+            bits.put(lengthCodes[symbol.first], lengthLengths[symbol.first]);
+            if (symbol.first == 16)
+                bits.put(symbol.second, 2);
+            else if (symbol.first == 17)
+                bits.put(symbol.second, 3);
+            else if (symbol.first == 18)
+                bits.put(symbol.second, 7);
+        }
+
+        for (const Token& token : tokens)
+        {
+            if (token.distance == 0)
+            {
+                bits.put(literalCodes[token.length], literalLengths[token.length]);
+                continue;
+            }
+            int code = lengthCode(token.length);
+            bits.put(literalCodes[257 + code], literalLengths[257 + code]);
+            bits.put(token.length - lengthBase[code], lengthExtra[code]);
+            code = distanceCode(token.distance);
+            bits.put(distanceCodes[code], distanceLengths[code]);
+            bits.put(token.distance - distanceBase[code], distanceExtra[code]);
+        }
+        bits.put(literalCodes[256], literalLengths[256]);
+    }
+
+    // zlib stream of greedy hash-chain LZ77, roughly what zlib does at its faster levels
+    Bytes zlibCompress(const Bytes& data)
+    {
+        const int windowSize = 32768, hashBits = 15, maxChain = 24, maxMatch = 258;
+        Bytes out;
+        put8(out, 0x78);
+        put8(out, 0x9C);
+        BitWriterLsb bits(out);
+
+        std::vector<int> head((size_t)1 << hashBits, -1), previous(windowSize, -1);
+        size_t size = data.size();
+        auto hash = [&](size_t at) {
+            uint32_t v = (uint32_t)data[at] << 16 | (uint32_t)data[at + 1] << 8 | data[at + 2];
+            return (v * 2654435761u) >> (32 - hashBits);
+        };
+        auto insert = [&](size_t at) {
+            if (at + 3 > size)
+                return;
+            uint32_t h = hash(at);
+            previous[at & (windowSize - 1)] = head[h];
+            head[h] = (int)at;
+        };
+
+        std::vector<Token> tokens;
+        for (size_t i = 0; i < size;)
+        {
+            int best = 0, bestDistance = 0;
+            if (i + 3 <= size)
+            {
+                int limit = (int)std::min<size_t>(maxMatch, size - i);
+                int candidate = head[hash(i)];
+                for (int chain = maxChain; candidate >= 0 && i - candidate <= (size_t)windowSize && chain > 0; --chain)
+                {
+                    int length = 0;
+                    while (length < limit && data[candidate + length] == data[i + length])
+                        ++length;
+                    if (length > best)
+                    {
+                        best = length;
+                        bestDistance = (int)(i - candidate);
+                        if (length == limit)
+                            break;
+                    }
+                    candidate = previous[candidate & (windowSize - 1)];
+                }
+            }
+
+            if (best >= 3)
+            {
+                tokens.push_back({ (uint16_t)best, (uint16_t)bestDistance });
+                for (int k = 0; k < best; ++k)
+                    insert(i + k);
+                i += best;
+            }
+            else
+            {
+                tokens.push_back({ data[i], 0 });
+                insert(i);
+                ++i;
+            }
+
+            if (tokens.size() >= 16384)
+            {
+                writeDeflateBlock(bits, tokens, false);
+                tokens.clear();
+            }
+        }
+        writeDeflateBlock(bits, tokens, true);
+        bits.flush();
+        put32be(out, adler32(data));
+        return out;
+    }
+
+    int paeth(int a, int b, int c)
+    {
+        int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc)
+            return a;
+        return pb <= pc ? b : c;
+    }
+
+    void applyFilter(unsigned char* out, const unsigned char* row, const unsigned char* prior, size_t stride, int bpp, int type)
+    {
+        for (size_t i = 0; i < stride; ++i)
+        {
+            int a = i >= (size_t)bpp ? row[i - bpp] : 0, b = prior[i], c = i >= (size_t)bpp ? prior[i - bpp] : 0;
+            int prediction = 0;
+            switch (type)
+            {
+            case 1: prediction = a; break;
+            case 2: prediction = b; break;
+            case 3: prediction = (a + b) >> 1; break;
+            case 4: prediction = paeth(a, b, c); break;
+            }
+            out[i] = (unsigned char)(row[i] - prediction);
+        }
+    }
+
+    // filter 0-4 uses that filter on every row, 5 picks per row by the usual smallest-sum-of-residuals rule
+    void filterRows(Bytes& out, const unsigned char* rows, int width, int height, int bpp, int filter)
+    {
+        size_t stride = (size_t)width * bpp;
+        Bytes zero(stride, 0), candidate(stride), best(stride);
+        for (int y = 0; y < height; ++y)
+        {
+            const unsigned char* row = rows + y * stride;
+            const unsigned char* prior = y ? row - stride : zero.data();
+            int type = filter;
+            if (filter == 5)
+            {
+                uint64_t bestCost = UINT64_MAX;
+                for (int t = 0; t < 5; ++t)
+                {
+                    applyFilter(candidate.data(), row, prior, stride, bpp, t);
+                    uint64_t cost = 0;
+                    for (unsigned char v : candidate)
+                        cost += std::abs((int)(signed char)v);
+                    if (cost < bestCost)
+                    {
+                        bestCost = cost;
+                        type = t;
+                        best.swap(candidate);
+                    }
+                }
+            }
+            else
+                applyFilter(best.data(), row, prior, stride, bpp, type);
+            put8(out, type);
+            out.insert(out.end(), best.begin(), best.end());
+        }
+    }
+
+    void putChunk(Bytes& out, const char* type, const unsigned char* data, size_t size)
+    {
+        put32be(out, (uint32_t)size);
+        size_t start = out.size();
+        putString(out, type);
+        out.insert(out.end(), data, data + size);
+        put32be(out, crc32(&out[start], size + 4));
+    }
+
+    Encoded encodePng(const Picture& pic, int channels, int depth, int filter, bool interlaced)
+    {
+        static const int colorTypes[5] = { 0, 0, 4, 2, 6 };
+        int w = pic.width, h = pic.height, bpp = channels * depth / 8;
+        std::vector<uint16_t> samples = pic.samples(channels);
+
+        // PNG stores 16-bit samples big-endian
+        Bytes pixels(samples.size() * depth / 8);
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            if (depth == 8)
+                pixels[i] = (unsigned char)(samples[i] >> 8);
+            else
+            {
+                pixels[i * 2] = (unsigned char)(samples[i] >> 8);
+                pixels[i * 2 + 1] = (unsigned char)samples[i];
+            }
+        }
+
+        Bytes filtered;
+        if (!interlaced)
+            filterRows(filtered, pixels.data(), w, h, bpp, filter);
+        else
+        {
+            // Adam7: each pass is a subimage of its own, filtered from a zero row
+            static const int passes[7][4] = { {0,0,8,8}, {4,0,8,8}, {0,4,4,8}, {2,0,4,4}, {0,2,2,4}, {1,0,2,2}, {0,1,1,2} };
+            for (const int* pass : passes)
+            {
+                int passW = (w - pass[0] + pass[2] - 1) / pass[2], passH = (h - pass[1] + pass[3] - 1) / pass[3];
+                if (passW <= 0 || passH <= 0)
+                    continue;
+                Bytes sub((size_t)passW * passH * bpp);
+                for (int y = 0; y < passH; ++y)
+                    for (int x = 0; x < passW; ++x)
+                        memcpy(&sub[((size_t)y * passW + x) * bpp], &pixels[((size_t)(pass[1] + y * pass[3]) * w + pass[0] + x * pass[2]) * bpp], bpp);
+                filterRows(filtered, sub.data(), passW, passH, bpp, filter);
+            }
+        }
+        Bytes compressed = zlibCompress(filtered);
+
+        Encoded e;
+        e.extension = "png";
+        static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        e.file.assign(signature, signature + 8);
+        Bytes header;
+        put32be(header, w);
+        put32be(header, h);
+        put8(header, depth);
+        put8(header, colorTypes[channels]);
+        put8(header, 0);
+        put8(header, 0);
+        put8(header, interlaced ? 1 : 0);
+        putChunk(e.file, "IHDR", header.data(), header.size());
+        for (size_t at = 0; at < compressed.size(); at += 65536)
+            putChunk(e.file, "IDAT", &compressed[at], std::min<size_t>(65536, compressed.size() - at));
+        putChunk(e.file, "IEND", nullptr, 0);
+
+        e.channels = channels;
+        e.bits = depth;
+        e.expected = depth == 8 ? to8(samples) : bytesOf(samples);
+        return e;
+    }
+#pragma endregion
+
+
+#pragma region JPEG
+    const int zigzag[64] = {
+        0, 1, 8,16, 9, 2, 3,10,17,24,32,25,18,11, 4, 5,12,19,26,33,40,48,41,34,27,20,13, 6, 7,14,21,28,
+       35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
+
+    // the example tables from Annex K of the JPEG standard, in natural order
+    const int lumaQuant[64] = {
+        16,11,10,16, 24, 40, 51, 61,  12,12,14,19, 26, 58, 60, 55,  14,13,16,24, 40, 57, 69, 56,  14,17,22,29, 51, 87, 80, 62,
+        18,22,37,56, 68,109,103, 77,  24,35,55,64, 81,104,113, 92,  49,64,78,87,103,121,120,101,  72,92,95,98,112,100,103, 99 };
+    const int chromaQuant[64] = {
+        17,18,24,47,99,99,99,99,  18,21,26,66,99,99,99,99,  24,26,56,99,99,99,99,99,  47,66,99,99,99,99,99,99,
+        99,99,99,99,99,99,99,99,  99,99,99,99,99,99,99,99,  99,99,99,99,99,99,99,99,  99,99,99,99,99,99,99,99 };
+
+    const unsigned char dcLumaBits[16] = { 0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0 };
+    const unsigned char dcChromaBits[16] = { 0,3,1,1,1,1,1,1,1,1,1,0,0,0,0,0 };
+    const unsigned char dcValues[12] = { 0,1,2,3,4,5,6,7,8,9,10,11 };
+    const unsigned char acLumaBits[16] = { 0,2,1,3,3,2,4,3,5,5,4,4,0,0,1,0x7d };
+    const unsigned char acLumaValues[162] = {
+        0x01,0x02,0x03,0x00,0x04,0x11,0x05,0x12,0x21,0x31,0x41,0x06,0x13,0x51,0x61,0x07,0x22,0x71,0x14,0x32,0x81,0x91,0xa1,0x08,
+        0x23,0x42,0xb1,0xc1,0x15,0x52,0xd1,0xf0,0x24,0x33,0x62,0x72,0x82,0x09,0x0a,0x16,0x17,0x18,0x19,0x1a,0x25,0x26,0x27,0x28,
+        0x29,0x2a,0x34,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,0x59,
+        0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x83,0x84,0x85,0x86,0x87,0x88,0x89,
+        0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,0xb5,0xb6,
+        0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,0xe1,0xe2,
+        0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf1,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9,0xfa };
+    const unsigned char acChromaBits[16] = { 0,2,1,2,4,4,3,4,7,5,4,4,0,1,2,0x77 };
+    const unsigned char acChromaValues[162] = {
+        0x00,0x01,0x02,0x03,0x11,0x04,0x05,0x21,0x31,0x06,0x12,0x41,0x51,0x07,0x61,0x71,0x13,0x22,0x32,0x81,0x08,0x14,0x42,0x91,
+        0xa1,0xb1,0xc1,0x09,0x23,0x33,0x52,0xf0,0x15,0x62,0x72,0xd1,0x0a,0x16,0x24,0x34,0xe1,0x25,0xf1,0x17,0x18,0x19,0x1a,0x26,
+        0x27,0x28,0x29,0x2a,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,
+        0x59,0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x82,0x83,0x84,0x85,0x86,0x87,
+        0x88,0x89,0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,
+        0xb5,0xb6,0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,
+        0xe2,0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9,0xfa };
+
+    struct JpegHuffman
+    {
+        const unsigned char* bits;
+        const unsigned char* values;
+        uint16_t code[256];
+        uint8_t size[256];
+
+        JpegHuffman(const unsigned char* bits, const unsigned char* values) : bits(bits), values(values), code(), size()
+        {
+            int next = 0, k = 0;
+            for (int length = 1; length <= 16; ++length, next <<= 1)
+            {
+                for (int i = 0; i < bits[length - 1]; ++i, ++k, ++next)
+                {
+                    code[values[k]] = (uint16_t)next;
+                    size[values[k]] = (uint8_t)length;
+                }
+            }
+        }
+
+        int valueCount() const
+        {
+            int count = 0;
+            for (int i = 0; i < 16; ++i)
+                count += bits[i];
+            return count;
+        }
+
+        void put(BitWriterMsb& out, int symbol) const { out.put(code[symbol], size[symbol]); }
+    };
+
+    enum class Chroma { Gray, Yuv444, Yuv420 };
+
+    struct JpegComponent
+    {
+        int id, h, v, table;
+        int blocksW, blocksH;   // blocks in the MCU-padded plane
+        int usedW, usedH;       // blocks a non-interleaved scan covers
+        std::vector<int> coefficients; // 64 per block, in zigzag order
+    };
+
+    int bitLength(int value)
+    {
+        int bits = 0;
+        for (value = std::abs(value); value; value >>= 1)
+            ++bits;
+        return bits;
+    }
+
+    // the [ss, se] part of one block's zigzag coefficients; AC bands are only coded with EOB runs of one
+    void encodeBlock(BitWriterMsb& out, const int* zz, int& dcPrediction, const JpegHuffman& dc, const JpegHuffman& ac, int ss, int se)
+    {
+        if (ss == 0)
+        {
+            int diff = zz[0] - dcPrediction, category = bitLength(diff);
+            dcPrediction = zz[0];
+            dc.put(out, category);
+            if (category)
+                out.put(diff < 0 ? diff - 1 : diff, category);
+        }
+        if (se == 0)
+            return;
+
+        int run = 0;
+        for (int k = std::max(ss, 1); k <= se; ++k)
+        {
+            int value = zz[k];
+            if (value == 0)
+            {
+                ++run;
+                continue;
+            }
+            for (; run >= 16; run -= 16)
+                ac.put(out, 0xF0);
+            int category = bitLength(value);
+            ac.put(out, run << 4 | category);
+            out.put(value < 0 ? value - 1 : value, category);
+            run = 0;
+        }
+        if (run > 0)
+            ac.put(out, 0x00);
+    }
+
+    // Baseline, or progressive with spectral selection (a DC scan, then two AC bands per component).
+    Encoded encodeJpeg(const Picture& pic, Chroma chroma, bool progressive, int quality = 85)
+    {
+        const double pi = 3.14159265358979323846;
+        int w = pic.width, h = pic.height;
+        int componentCount = chroma == Chroma::Gray ? 1 : 3;
+        int maxSampling = chroma == Chroma::Yuv420 ? 2 : 1;
+        int mcuSize = 8 * maxSampling, mcuX = (w + mcuSize - 1) / mcuSize, mcuY = (h + mcuSize - 1) / mcuSize;
+        std::vector<uint16_t> source = pic.samples(componentCount);
+
+        // IJG quality scaling
+        int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+        int quant[2][64];
+        for (int i = 0; i < 64; ++i)
+        {
+            quant[0][i] = std::min(255, std::max(1, (lumaQuant[i] * scale + 50) / 100));
+            quant[1][i] = std::min(255, std::max(1, (chromaQuant[i] * scale + 50) / 100));
+        }
+
+        // full resolution planes, JFIF's YCbCr
+        std::vector<float> planes[3];
+        for (int k = 0; k < componentCount; ++k)
+            planes[k].resize((size_t)w * h);
+        for (size_t i = 0; i < (size_t)w * h; ++i)
+        {
+            if (componentCount == 1)
+            {
+                planes[0][i] = (float)(source[i] >> 8);
+                continue;
+            }
+            float r = (float)(source[i * 3] >> 8), g = (float)(source[i * 3 + 1] >> 8), b = (float)(source[i * 3 + 2] >> 8);
+            planes[0][i] = 0.299f * r + 0.587f * g + 0.114f * b;
+            planes[1][i] = -0.168736f * r - 0.331264f * g + 0.5f * b + 128.0f;
+            planes[2][i] = 0.5f * r - 0.418688f * g - 0.081312f * b + 128.0f;
+        }
+
+        float basis[8][8];
+        for (int u = 0; u < 8; ++u)
+            for (int x = 0; x < 8; ++x)
+                basis[u][x] = (float)((u == 0 ? std::sqrt(0.125) : 0.5) * std::cos((2 * x + 1) * u * pi / 16.0));
+
+        JpegComponent components[3];
+        for (int k = 0; k < componentCount; ++k)
+        {
+            JpegComponent& c = components[k];
+            c.id = k + 1;
+            c.h = c.v = k == 0 ? maxSampling : 1;
+            c.table = k == 0 ? 0 : 1;
+            c.blocksW = mcuX * c.h;
+            c.blocksH = mcuY * c.v;
+            c.usedW = ((w * c.h + maxSampling - 1) / maxSampling + 7) / 8;
+            c.usedH = ((h * c.v + maxSampling - 1) / maxSampling + 7) / 8;
+            c.coefficients.resize((size_t)c.blocksW * c.blocksH * 64);
+
+            // subsampled planes average the pixels they cover; the padding repeats the last row and column
+            int factor = maxSampling / c.h;
+            for (int by = 0; by < c.blocksH; ++by)
+            {
+                for (int bx = 0; bx < c.blocksW; ++bx)
+                {
+                    float block[64], rows[64];
+                    for (int y = 0; y < 8; ++y)
+                    {
+                        for (int x = 0; x < 8; ++x)
+                        {
+                            float sum = 0.0f;
+                            for (int dy = 0; dy < factor; ++dy)
+                            {
+                                for (int dx = 0; dx < factor; ++dx)
+                                {
+                                    int sx = std::min(w - 1, ((bx * 8 + x) * factor) + dx), sy = std::min(h - 1, ((by * 8 + y) * factor) + dy);
+                                    sum += planes[k][(size_t)sy * w + sx];
+                                }
+                            }
+                            block[y * 8 + x] = sum / (factor * factor) - 128.0f;
+                        }
+                    }
+
+                    // separable DCT-II, rows then columns
+                    for (int y = 0; y < 8; ++y)
+                    {
+                        for (int u = 0; u < 8; ++u)
+                        {
+                            float sum = 0.0f;
+                            for (int x = 0; x < 8; ++x)
+                                sum += basis[u][x] * block[y * 8 + x];
+                            rows[y * 8 + u] = sum;
+                        }
+                    }
+                    int* out = &c.coefficients[((size_t)by * c.blocksW + bx) * 64];
+                    for (int i = 0; i < 64; ++i)
+                    {
+                        int natural = zigzag[i], v = natural >> 3, u = natural & 7;
+                        float sum = 0.0f;
+                        for (int y = 0; y < 8; ++y)
+                            sum += basis[v][y] * rows[y * 8 + u];
+                        out[i] = (int)std::lround(sum / quant[c.table][natural]);
+                    }
+                }
+            }
+        }
+
+        const JpegHuffman dcTables[2] = { JpegHuffman(dcLumaBits, dcValues), JpegHuffman(dcChromaBits, dcValues) };
+        const JpegHuffman acTables[2] = { JpegHuffman(acLumaBits, acLumaValues), JpegHuffman(acChromaBits, acChromaValues) };
+        int tableCount = componentCount == 1 ? 1 : 2;
+
+        Encoded e;
+        e.extension = "jpg";
+        Bytes& out = e.file;
+        put16be(out, 0xFFD8);
+
+        static const unsigned char jfif[14] = { 'J','F','I','F',0, 1,1, 0, 0,1, 0,1, 0,0 };
+        put16be(out, 0xFFE0);
+        put16be(out, 16);
+        out.insert(out.end(), jfif, jfif + 14);
+
+        put16be(out, 0xFFDB);
+        put16be(out, 2 + 65 * tableCount);
+        for (int t = 0; t < tableCount; ++t)
+        {
+            put8(out, t);
+            for (int i = 0; i < 64; ++i)
+                put8(out, quant[t][zigzag[i]]);
+        }
+
+        put16be(out, progressive ? 0xFFC2 : 0xFFC0);
+        put16be(out, 8 + 3 * componentCount);
+        put8(out, 8);
+        put16be(out, h);
+        put16be(out, w);
+        put8(out, componentCount);
+        for (int k = 0; k < componentCount; ++k)
+        {
+            put8(out, components[k].id);
+            put8(out, components[k].h << 4 | components[k].v);
+            put8(out, components[k].table);
+        }
+
+        int huffmanSize = 2;
+        for (int t = 0; t < tableCount; ++t)
+            huffmanSize += 2 * 17 + dcTables[t].valueCount() + acTables[t].valueCount();
+        put16be(out, 0xFFC4);
+        put16be(out, huffmanSize);
+        for (int t = 0; t < tableCount; ++t)
+        {
+            const JpegHuffman* tables[2] = { &dcTables[t], &acTables[t] };
+            for (int kind = 0; kind < 2; ++kind)
+            {
+                put8(out, kind << 4 | t);
+                out.insert(out.end(), tables[kind]->bits, tables[kind]->bits + 16);
+                out.insert(out.end(), tables[kind]->values, tables[kind]->values + tables[kind]->valueCount());
+            }
+        }
+
+        auto writeScan = [&](const std::vector<int>& scanComponents, int ss, int se) {
+            put16be(out, 0xFFDA);
+            put16be(out, 6 + 2 * (int)scanComponents.size());
+            put8(out, (unsigned)scanComponents.size());
+            for (int k : scanComponents)
+            {
+                put8(out, components[k].id);
+                put8(out, components[k].table << 4 | components[k].table);
+            }
+            put8(out, ss);
+            put8(out, se);
+            put8(out, 0);
+
+            BitWriterMsb bits(out);
+            int predictions[3] = { 0, 0, 0 };
+            if (scanComponents.size() == 1)
+            {
+                const JpegComponent& c = components[scanComponents[0]];
+                for (int by = 0; by < c.usedH; ++by)
+                    for (int bx = 0; bx < c.usedW; ++bx)
+                        encodeBlock(bits, &c.coefficients[((size_t)by * c.blocksW + bx) * 64], predictions[0], dcTables[c.table], acTables[c.table], ss, se);
+            }
+            else
+            {
+                for (int my = 0; my < mcuY; ++my)
+                {
+                    for (int mx = 0; mx < mcuX; ++mx)
+                    {
+                        for (int k : scanComponents)
+                        {
+                            const JpegComponent& c = components[k];
+                            for (int y = 0; y < c.v; ++y)
+                                for (int x = 0; x < c.h; ++x)
+                                    encodeBlock(bits, &c.coefficients[((size_t)(my * c.v + y) * c.blocksW + mx * c.h + x) * 64], predictions[k], dcTables[c.table], acTables[c.table], ss, se);
+                        }
+                    }
+                }
+            }
+            bits.flush();
+        };
+
+        std::vector<int> all;
+        for (int k = 0; k < componentCount; ++k)
+            all.push_back(k);
+        if (!progressive)
+            writeScan(all, 0, 63);
+        else
+        {
+            writeScan(all, 0, 0);
+            for (int k = 0; k < componentCount; ++k)
+            {
+                writeScan(std::vector<int>(1, k), 1, 5);
+                writeScan(std::vector<int>(1, k), 6, 63);
+            }
+        }
+        put16be(out, 0xFFD9);
+
+        e.channels = componentCount;
+        e.approx = to8(source);
+        return e;
+    }
+#pragma endregion
+
+
+#pragma region GIF, HDR, TGA, BMP, PSD, PNM
+    // 256 colours: 3 bits of red, 3 of green, 2 of blue
+    Encoded encodeGif(const Picture& pic)
+    {
+        int w = pic.width, h = pic.height;
+        Bytes rgb = to8(pic.samples(3));
+        Encoded e;
+        e.extension = "gif";
+        Bytes& out = e.file;
+
+        putString(out, "GIF89a");
+        put16le(out, w);
+        put16le(out, h);
+        put8(out, 0xF7);
+        put8(out, 0);
+        put8(out, 0);
+        unsigned char palette[256][3];
+        for (int i = 0; i < 256; ++i)
+        {
+            palette[i][0] = (unsigned char)((i >> 5) * 255 / 7);
+            palette[i][1] = (unsigned char)(((i >> 2) & 7) * 255 / 7);
+            palette[i][2] = (unsigned char)((i & 3) * 255 / 3);
+            out.insert(out.end(), palette[i], palette[i] + 3);
+        }
+        put8(out, 0x2C);
+        put16le(out, 0);
+        put16le(out, 0);
+        put16le(out, w);
+        put16le(out, h);
+        put8(out, 0);
+
+        Bytes indices((size_t)w * h);
+        e.expected.resize((size_t)w * h * 4);
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            int index = (rgb[i * 3] >> 5) << 5 | (rgb[i * 3 + 1] >> 5) << 2 | rgb[i * 3 + 2] >> 6;
+            indices[i] = (unsigned char)index;
+            memcpy(&e.expected[i * 4], palette[index], 3);
+            e.expected[i * 4 + 3] = 255;
+        }
+
+        // LZW with 8-bit roots; the dictionary is a (prefix, byte) table, reset cheaply by bumping a generation
+        const int clearCode = 256;
+        Bytes lzw;
+        BitWriterLsb bits(lzw);
+        std::vector<uint32_t> generation((size_t)4096 * 256, 0);
+        std::vector<uint16_t> codes((size_t)4096 * 256);
+        uint32_t current = 1;
+        int codeSize = 9, lastCode = clearCode + 1;
+        bits.put(clearCode, codeSize);
+        int prefix = indices.empty() ? 0 : indices[0];
+        for (size_t i = 1; i < indices.size(); ++i)
+        {
+            size_t key = (size_t)prefix * 256 + indices[i];
+            if (generation[key] == current)
+            {
+                prefix = codes[key];
+                continue;
+            }
+            bits.put(prefix, codeSize);
+            generation[key] = current;
+            codes[key] = (uint16_t)++lastCode;
+            if (lastCode >= (1 << codeSize))
+                ++codeSize;
+            if (lastCode == 4095)
+            {
+                bits.put(clearCode, codeSize);
+                ++current;
+                codeSize = 9;
+                lastCode = clearCode + 1;
+            }
+            prefix = indices[i];
+        }
+        bits.put(prefix, codeSize);
+        bits.put(clearCode, codeSize);
+        bits.put(clearCode + 1, 9);
+        bits.flush();
+
+        put8(out, 8);
+        for (size_t at = 0; at < lzw.size(); at += 255)
+        {
+            size_t n = std::min<size_t>(255, lzw.size() - at);
+            put8(out, (unsigned)n);
+            out.insert(out.end(), lzw.begin() + at, lzw.begin() + at + n);
+        }
+        put8(out, 0);
+        put8(out, 0x3B);
+
+        e.channels = 4;
+        return e;
+    }
+
+    // Radiance RGBE with the usual per-channel run-length coded scanlines
+    Encoded encodeHdr(const Picture& pic)
+    {
+        int w = pic.width, h = pic.height;
+        std::vector<uint16_t> samples = pic.samples(3);
+        Bytes rgbe((size_t)w * h * 4);
+        std::vector<float> expected((size_t)w * h * 3);
+        for (size_t i = 0; i < (size_t)w * h; ++i)
+        {
+            // squared so the values spread over a few stops, up to 8
+            float value[3];
+            for (int c = 0; c < 3; ++c)
+            {
+                double v = samples[i * 3 + c] / 65535.0;
+                value[c] = (float)(v * v * 8.0);
+            }
+            float largest = std::max(value[0], std::max(value[1], value[2]));
+            unsigned char* p = &rgbe[i * 4];
+            if (largest < 1e-32f)
+                p[0] = p[1] = p[2] = p[3] = 0;
+            else
+            {
+                int exponent;
+                float scale = (float)(std::frexp(largest, &exponent) * 256.0 / largest);
+                for (int c = 0; c < 3; ++c)
+                    p[c] = (unsigned char)(value[c] * scale);
+                p[3] = (unsigned char)(exponent + 128);
+            }
+            // decoded the same way stbi__hdr_convert does
+            float f = p[3] ? (float)std::ldexp(1.0f, p[3] - (128 + 8)) : 0.0f;
+            for (int c = 0; c < 3; ++c)
+                expected[i * 3 + c] = p[3] ? p[c] * f : 0.0f;
+        }
+
+        Encoded e;
+        e.extension = "hdr";
+        Bytes& out = e.file;
+        char header[96];
+        snprintf(header, sizeof(header), "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", h, w);
+        putString(out, header);
+
+        Bytes channel(w);
+        for (int y = 0; y < h; ++y)
+        {
+            const unsigned char* row = &rgbe[(size_t)y * w * 4];
+            if (w < 8 || w >= 32768)
+            {
+                out.insert(out.end(), row, row + (size_t)w * 4);
+                continue;
+            }
+            put8(out, 2);
+            put8(out, 2);
+            put8(out, w >> 8);
+            put8(out, w & 255);
+            for (int c = 0; c < 4; ++c)
+            {
+                for (int x = 0; x < w; ++x)
+                    channel[x] = row[x * 4 + c];
+                // runs of four or more go out as runs, everything else as literal stretches (Greg Ward's scheme)
+                int at = 0;
+                while (at < w)
+                {
+                    int runStart = at, runLength = 0, previousRun = 0;
+                    while (runLength < 4 && runStart < w)
+                    {
+                        runStart += runLength;
+                        previousRun = runLength;
+                        runLength = 1;
+                        while (runStart + runLength < w && runLength < 127 && channel[runStart] == channel[runStart + runLength])
+                            ++runLength;
+                    }
+                    if (previousRun > 1 && previousRun == runStart - at)
+                    {
+                        put8(out, 128 + previousRun);
+                        put8(out, channel[at]);
+                        at = runStart;
+                    }
+                    while (at < runStart)
+                    {
+                        int n = std::min(128, runStart - at);
+                        put8(out, n);
+                        out.insert(out.end(), channel.begin() + at, channel.begin() + at + n);
+                        at += n;
+                    }
+                    if (runLength >= 4)
+                    {
+                        put8(out, 128 + runLength);
+                        put8(out, channel[runStart]);
+                        at += runLength;
+                    }
+                }
+            }
+        }
+
+        e.channels = 3;
+        e.bits = 32;
+        e.expected = bytesOf(expected);
+        return e;
+    }
+
+    // Runs of a repeated element and literal stretches, at most 128 elements a packet, as TGA and
+    // PSD (PackBits) both pack their data. Only the packet header byte differs between the two.
+    void packRuns(Bytes& out, const unsigned char* data, int count, int size, bool packBits)
+    {
+        auto same = [&](int a, int b) { return memcmp(data + (size_t)a * size, data + (size_t)b * size, size) == 0; };
+        int i = 0;
+        while (i < count)
+        {
+            int run = 1;
+            while (i + run < count && run < 128 && same(i, i + run))
+                ++run;
+            if (run >= 2)
+            {
+                put8(out, packBits ? 257 - run : 0x80 | (run - 1));
+                out.insert(out.end(), data + (size_t)i * size, data + (size_t)(i + 1) * size);
+                i += run;
+            }
+            else
+            {
+                int start = i;
+                while (i < count && i - start < 128 && !(i + 1 < count && same(i, i + 1)))
+                    ++i;
+                put8(out, i - start - 1);
+                out.insert(out.end(), data + (size_t)start * size, data + (size_t)i * size);
+            }
+        }
+    }
+
+    Encoded encodeTga(const Picture& pic, int channels, bool rle)
+    {
+        int w = pic.width, h = pic.height;
+        Bytes pixels = to8(pic.samples(channels));
+        Encoded e;
+        e.extension = "tga";
+        e.expected = pixels;
+        if (channels >= 3)
+            for (size_t i = 0; i < pixels.size(); i += channels)
+                std::swap(pixels[i], pixels[i + 2]);
+
+        Bytes& out = e.file;
+        put8(out, 0);
+        put8(out, 0);
+        put8(out, (channels == 1 ? 3 : 2) + (rle ? 8 : 0));
+        out.insert(out.end(), 5, 0);
+        put16le(out, 0);
+        put16le(out, 0);
+        put16le(out, w);
+        put16le(out, h);
+        put8(out, channels * 8);
+        put8(out, (channels == 4 ? 8 : 0) | 0x20); // alpha bits, rows stored top-down
+        if (!rle)
+            out.insert(out.end(), pixels.begin(), pixels.end());
+        else
+            for (int y = 0; y < h; ++y)
+                packRuns(out, &pixels[(size_t)y * w * channels], w, channels, false);
+
+        e.channels = channels;
+        return e;
+    }
+
+    // 24 and 32-bit BGR(A), or 8 bits indexing a grey palette
+    Encoded encodeBmp(const Picture& pic, int bitsPerPixel)
+    {
+        int w = pic.width, h = pic.height, channels = bitsPerPixel / 8;
+        int stride = (w * channels + 3) & ~3, paletteSize = bitsPerPixel == 8 ? 1024 : 0;
+        Bytes pixels = to8(pic.samples(channels));
+        Encoded e;
+        e.extension = "bmp";
+        Bytes& out = e.file;
+
+        putString(out, "BM");
+        put32le(out, 14 + 40 + paletteSize + stride * h);
+        put32le(out, 0);
+        put32le(out, 14 + 40 + paletteSize);
+        put32le(out, 40);
+        put32le(out, w);
+        put32le(out, h);
+        put16le(out, 1);
+        put16le(out, bitsPerPixel);
+        put32le(out, 0);
+        put32le(out, stride * h);
+        put32le(out, 2835);
+        put32le(out, 2835);
+        put32le(out, bitsPerPixel == 8 ? 256 : 0);
+        put32le(out, 0);
+        for (int i = 0; i < paletteSize / 4; ++i)
+        {
+            put8(out, i);
+            put8(out, i);
+            put8(out, i);
+            put8(out, 0);
+        }
+        for (int y = h - 1; y >= 0; --y)
+        {
+            size_t start = out.size();
+            for (int x = 0; x < w; ++x)
+            {
+                const unsigned char* p = &pixels[((size_t)y * w + x) * channels];
+                if (channels == 1)
+                    put8(out, p[0]);
+                else
+                {
+                    put8(out, p[2]);
+                    put8(out, p[1]);
+                    put8(out, p[0]);
+                    if (channels == 4)
+                        put8(out, p[3]);
+                }
+            }
+            out.resize(start + stride, 0);
+        }
+
+        // the palette image comes back as RGB
+        if (channels == 1)
+        {
+            e.channels = 3;
+            e.expected.resize(pixels.size() * 3);
+            for (size_t i = 0; i < pixels.size(); ++i)
+                e.expected[i * 3] = e.expected[i * 3 + 1] = e.expected[i * 3 + 2] = pixels[i];
+        }
+        else
+        {
+            e.channels = channels;
+            e.expected = pixels;
+        }
+        return e;
+    }
+
+    // RGB(A) in planar order, raw or PackBits per row; 16-bit rows are packed as big-endian bytes
+    Encoded encodePsd(const Picture& pic, int channels, int depth, bool rle)
+    {
+        int w = pic.width, h = pic.height;
+        std::vector<uint16_t> samples = pic.samples(channels);
+        Encoded e;
+        e.extension = "psd";
+
+        // Photoshop blends partially transparent pixels into white, and stb_image takes that matte back out. The
+        // 8-bit RGBA pixels are stored matted, rounding towards white so taking the matte out stays in 0..255, and
+        // what stb_image's own arithmetic gives back for them is what's expected.
+        Bytes unmatted;
+        if (channels == 4 && depth == 8)
+        {
+            unmatted = to8(samples);
+            for (size_t i = 0; i < (size_t)w * h; ++i)
+            {
+                unsigned char* p = &unmatted[i * 4];
+                for (int c = 0; c < 3; ++c)
+                {
+                    unsigned char stored = (unsigned char)(255 - (255 - p[c]) * p[3] / 255);
+                    samples[i * 4 + c] = (uint16_t)(stored << 8);
+                    p[c] = stored;
+                    if (p[3] != 0 && p[3] != 255)
+                    {
+                        float a = p[3] / 255.0f;
+                        float ra = 1.0f / a;
+                        float inv_a = 255.0f * (1 - ra);
+                        p[c] = (unsigned char)(stored * ra + inv_a);
+                    }
+                }
+            }
+        }
+        Bytes& out = e.file;
+
+        putString(out, "8BPS");
+        put16be(out, 1);
+        out.insert(out.end(), 6, 0);
+        put16be(out, channels);
+        put32be(out, h);
+        put32be(out, w);
+        put16be(out, depth);
+        put16be(out, 3);
+        put32be(out, 0);
+        put32be(out, 0);
+        put32be(out, 0);
+        put16be(out, rle ? 1 : 0);
+
+        if (rle)
+        {
+            int bytes = depth / 8;
+            Bytes counts, data, row((size_t)w * bytes);
+            for (int c = 0; c < channels; ++c)
+            {
+                for (int y = 0; y < h; ++y)
+                {
+                    for (int x = 0; x < w; ++x)
+                    {
+                        uint16_t v = samples[((size_t)y * w + x) * channels + c];
+                        row[(size_t)x * bytes] = (unsigned char)(v >> 8);
+                        if (bytes == 2)
+                            row[(size_t)x * 2 + 1] = (unsigned char)v;
+                    }
+                    size_t start = data.size();
+                    packRuns(data, row.data(), w * bytes, 1, true);
+                    put16be(counts, (unsigned)(data.size() - start));
+                }
+            }
+            out.insert(out.end(), counts.begin(), counts.end());
+            out.insert(out.end(), data.begin(), data.end());
+        }
+        else
+        {
+            for (int c = 0; c < channels; ++c)
+            {
+                for (size_t i = 0; i < (size_t)w * h; ++i)
+                {
+                    if (depth == 8)
+                        put8(out, samples[i * channels + c] >> 8);
+                    else
+                        put16be(out, samples[i * channels + c]);
+                }
+            }
+        }
+
+        // stb_image always returns RGBA for PSD
+        e.channels = 4;
+        e.bits = depth;
+        if (channels == 3)
+        {
+            std::vector<uint16_t> rgba((size_t)w * h * 4);
+            for (size_t i = 0; i < (size_t)w * h; ++i)
+            {
+                for (int c = 0; c < 3; ++c)
+                    rgba[i * 4 + c] = depth == 8 ? samples[i * 3 + c] >> 8 : samples[i * 3 + c];
+                rgba[i * 4 + 3] = depth == 8 ? 255 : 65535;
+            }
+            if (depth == 8)
+            {
+                e.expected.resize(rgba.size());
+                std::copy(rgba.begin(), rgba.end(), e.expected.begin());
+            }
+            else
+                e.expected = bytesOf(rgba);
+        }
+        else if (depth == 8)
+            e.expected = unmatted;
+        return e;
+    }
+
+    Encoded encodePnm(const Picture& pic, int channels, int depth)
+    {
+        std::vector<uint16_t> samples = pic.samples(channels);
+        Encoded e;
+        e.extension = channels == 1 ? "pgm" : "ppm";
+        char header[64];
+        snprintf(header, sizeof(header), "P%d\n%d %d\n%d\n", channels == 1 ? 5 : 6, pic.width, pic.height, depth == 16 ? 65535 : 255);
+        putString(e.file, header);
+        if (depth == 8)
+        {
+            e.expected = to8(samples);
+            e.file.insert(e.file.end(), e.expected.begin(), e.expected.end());
+        }
+        else
+        {
+            for (uint16_t sample : samples)
+                put16be(e.file, sample);
+            e.expected = bytesOf(samples);
+        }
+        e.channels = channels;
+        e.bits = depth;
+        return e;
+    }
+#pragma endregion
+
+
+    struct CaseSpec
+    {
+        const char* format;
+        std::string variant;
+        std::function<Encoded(const Picture&)> encode;
+    };
+
+    std::vector<CaseSpec> caseSpecs()
+    {
+        std::vector<CaseSpec> specs;
+        auto add = [&](const char* format, const std::string& variant, std::function<Encoded(const Picture&)> encode) {
+            specs.push_back({ format, variant, encode });
+        };
+
+        add("jpeg", "444",     [](const Picture& p) { return encodeJpeg(p, Chroma::Yuv444, false); });
+        add("jpeg", "420",     [](const Picture& p) { return encodeJpeg(p, Chroma::Yuv420, false); });
+        add("jpeg", "gray",    [](const Picture& p) { return encodeJpeg(p, Chroma::Gray, false); });
+        add("jpeg", "prog444", [](const Picture& p) { return encodeJpeg(p, Chroma::Yuv444, true); });
+        add("jpeg", "prog420", [](const Picture& p) { return encodeJpeg(p, Chroma::Yuv420, true); });
+
+        static const char* filterNames[6] = { "none", "sub", "up", "avg", "paeth", "adaptive" };
+        for (int filter = 0; filter < 6; ++filter)
+            add("png", std::string("rgb8-") + filterNames[filter], [filter](const Picture& p) { return encodePng(p, 3, 8, filter, false); });
+        add("png", "rgb8-adam7",   [](const Picture& p) { return encodePng(p, 3, 8, 5, true); });
+        add("png", "gray8",        [](const Picture& p) { return encodePng(p, 1, 8, 5, false); });
+        add("png", "ga8",          [](const Picture& p) { return encodePng(p, 2, 8, 5, false); });
+        add("png", "rgba8",        [](const Picture& p) { return encodePng(p, 4, 8, 5, false); });
+        add("png", "rgb16",        [](const Picture& p) { return encodePng(p, 3, 16, 5, false); });
+        add("png", "rgba16-adam7", [](const Picture& p) { return encodePng(p, 4, 16, 5, true); });
+
+        add("gif", "332", [](const Picture& p) { return encodeGif(p); });
+        add("hdr", "rle", [](const Picture& p) { return encodeHdr(p); });
+
+        add("tga", "rgb24",     [](const Picture& p) { return encodeTga(p, 3, false); });
+        add("tga", "rgba32",    [](const Picture& p) { return encodeTga(p, 4, false); });
+        add("tga", "gray8",     [](const Picture& p) { return encodeTga(p, 1, false); });
+        add("tga", "rgb24-rle", [](const Picture& p) { return encodeTga(p, 3, true); });
+        add("tga", "rgba32-rle",[](const Picture& p) { return encodeTga(p, 4, true); });
+        add("tga", "gray8-rle", [](const Picture& p) { return encodeTga(p, 1, true); });
+
+        add("bmp", "rgb24",  [](const Picture& p) { return encodeBmp(p, 24); });
+        add("bmp", "rgba32", [](const Picture& p) { return encodeBmp(p, 32); });
+        add("bmp", "pal8",   [](const Picture& p) { return encodeBmp(p, 8); });
+
+        add("psd", "rgb8",      [](const Picture& p) { return encodePsd(p, 3, 8, false); });
+        add("psd", "rgb8-rle",  [](const Picture& p) { return encodePsd(p, 3, 8, true); });
+        add("psd", "rgba8-rle", [](const Picture& p) { return encodePsd(p, 4, 8, true); });
+        add("psd", "rgb16",     [](const Picture& p) { return encodePsd(p, 3, 16, false); });
+        add("psd", "rgb16-rle", [](const Picture& p) { return encodePsd(p, 3, 16, true); });
+
+        add("pnm", "p5-8",  [](const Picture& p) { return encodePnm(p, 1, 8); });
+        add("pnm", "p6-8",  [](const Picture& p) { return encodePnm(p, 3, 8); });
+        add("pnm", "p5-16", [](const Picture& p) { return encodePnm(p, 1, 16); });
+        add("pnm", "p6-16", [](const Picture& p) { return encodePnm(p, 3, 16); });
+        return specs;
+    }
+
+    void* decode(const Encoded& e, int requested, int* w, int* h, int* channels)
+    {
+        const stbi_uc* data = e.file.data();
+        int size = (int)e.file.size();
+        if (e.bits == 16)
+            return stbi_load_16_from_memory(data, size, w, h, channels, requested);
+        if (e.bits == 32)
+            return stbi_loadf_from_memory(data, size, w, h, channels, requested);
+        return stbi_load_from_memory(data, size, w, h, channels, requested);
+    }
+
+    // "ok" or what went wrong for lossless formats, the PSNR for lossy ones
+    std::string verify(const Encoded& e, const Picture& pic, const void* pixels, int w, int h, int channels, int requested)
+    {
+        if (w != pic.width || h != pic.height || channels != e.channels)
+        {
+            char text[96];
+            snprintf(text, sizeof(text), "WRONG SIZE %dx%dx%d", w, h, channels);
+            return text;
+        }
+        if (requested != 0 && requested != e.channels)
+            return "-";
+        if (!e.expected.empty())
+            return memcmp(pixels, e.expected.data(), e.expected.size()) == 0 ? "ok" : "MISMATCH";
+        if (!e.approx.empty())
+        {
+            const unsigned char* decoded = (const unsigned char*)pixels;
+            double error = 0.0;
+            for (size_t i = 0; i < e.approx.size(); ++i)
+            {
+                double d = (double)decoded[i] - e.approx[i];
+                error += d * d;
+            }
+            error /= e.approx.size();
+            char text[32];
+            snprintf(text, sizeof(text), "psnr %.1f dB", error > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / error) : 99.0);
+            return text;
+        }
+        return "-";
+    }
+
+#ifdef STBI_PROFILE
+    // how many stbi_profile_counter ticks make a second
+    double counterFrequency()
+    {
+        auto start = std::chrono::steady_clock::now();
+        unsigned long long first = stbi_profile_counter();
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(50))
+        {
+        }
+        unsigned long long last = stbi_profile_counter();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return (last - first) / seconds;
+    }
+#endif
+
+    void usage()
+    {
+        std::printf("usage: bench_decode [--filter text] [--min-time seconds] [--channels n] [--dump directory]\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string filter, dumpDirectory;
+    double minTime = 0.2;
+    int requested = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 1;
+        }
+        if (arg == "--filter")
+            filter = argv[++i];
+        else if (arg == "--min-time")
+            minTime = std::atof(argv[++i]);
+        else if (arg == "--channels")
+            requested = std::atoi(argv[++i]);
+        else if (arg == "--dump")
+            dumpDirectory = argv[++i];
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (requested < 0 || requested > 4)
+    {
+        usage();
+        return 1;
+    }
+
+    struct Size { int width, height; };
+    const Size sizes[3] = { { 64, 64 }, { 512, 512 }, { 1920, 1080 } };
+    const Content contents[3] = { Content::Gradient, Content::Noise, Content::Photo };
+    std::vector<CaseSpec> specs = caseSpecs();
+#ifdef STBI_PROFILE
+    double frequency = counterFrequency();
+#endif
+
+    if (!dumpDirectory.empty())
+        std::filesystem::create_directories(dumpDirectory);
+    else
+        std::printf("%-36s %10s %10s %10s %9s  %s\n", "case", "file size", "ms/image", "images/s", "MB/s", "check");
+
+    // decoded bytes and seconds per format, for the summary
+    std::map<std::string, std::pair<double, double>> totals;
+    int failures = 0;
+
+    for (const Size& size : sizes)
+    {
+        for (Content content : contents)
+        {
+            Picture pic;
+            for (const CaseSpec& spec : specs)
+            {
+                char name[96];
+                snprintf(name, sizeof(name), "%s %s %s %dx%d", spec.format, spec.variant.c_str(), contentName(content), size.width, size.height);
+                if (!filter.empty() && std::string(name).find(filter) == std::string::npos)
+                    continue;
+                if (pic.rgba.empty())
+                    pic = makePicture(content, size.width, size.height);
+                Encoded e = spec.encode(pic);
+
+                if (!dumpDirectory.empty())
+                {
+                    std::string file = name;
+                    std::replace(file.begin(), file.end(), ' ', '_');
+                    std::ofstream(std::filesystem::path(dumpDirectory) / (file + "." + e.extension), std::ios::binary)
+                        .write((const char*)e.file.data(), (std::streamsize)e.file.size());
+                    continue;
+                }
+
+                // the first decode is checked against what went in, and warms the caches
+                int w, h, channels;
+                void* pixels = decode(e, requested, &w, &h, &channels);
+                if (!pixels)
+                {
+                    std::printf("%-36s %10zu FAILED: %s\n", name, e.file.size(), stbi_failure_reason());
+                    ++failures;
+                    continue;
+                }
+                std::string check = verify(e, pic, pixels, w, h, channels, requested);
+                stbi_image_free(pixels);
+                if (check != "ok" && check != "-" && check.compare(0, 4, "psnr") != 0)
+                    ++failures;
+
+#ifdef STBI_PROFILE
+                stbi_profile_reset();
+#endif
+                long iterations = 0;
+                auto start = std::chrono::steady_clock::now();
+                double elapsed = 0.0;
+                do
+                {
+                    stbi_image_free(decode(e, requested, &w, &h, &channels));
+                    ++iterations;
+                    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                } while (elapsed < minTime || iterations < 3);
+
+                double perImage = elapsed / iterations;
+                double decodedBytes = (double)w * h * (requested ? requested : channels) * (e.bits / 8);
+                std::printf("%-36s %10zu %10.3f %10.1f %9.1f  %s\n", name, e.file.size(), perImage * 1e3, 1.0 / perImage, decodedBytes / perImage / 1e6, check.c_str());
+                totals[spec.format].first += decodedBytes;
+                totals[spec.format].second += perImage;
+
+#ifdef STBI_PROFILE
+                for (int stage = 0; stage < STBI_PROFILE_count; ++stage)
+                {
+                    double seconds = stbi_profile_ticks(stage) / frequency / iterations;
+                    if (seconds <= 0.0)
+                        continue;
+                    std::printf("    %-32s %10s %10.3f %9.1f%% %9.1f\n", stbi_profile_stage_name(stage), "", seconds * 1e3, 100.0 * seconds / perImage, decodedBytes / seconds / 1e6);
+                }
+#endif
+            }
+        }
+    }
+
+    if (dumpDirectory.empty() && !totals.empty())
+    {
+        std::printf("\n%-36s %9s\n", "format (all cases)", "MB/s");
+        for (const auto& total : totals)
+            std::printf("%-36s %9.1f\n", total.first.c_str(), total.second.first / total.second.second / 1e6);
+    }
+    return failures ? 1 : 0;
+}
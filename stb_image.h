@@ -210,6 +210,35 @@ RECENT REVISION HISTORY:
 //
 // ===========================================================================
 //
+// Decoding into caller-provided memory
+//
+// The stbi_load_into family decodes an 8-bit image straight into memory
+// you provide, for example a mapped GL_PIXEL_UNPACK_BUFFER, instead of
+// returning a buffer you then have to copy and free:
+//
+//   int x,y,n, stride;
+//   stbi_info(filename, &x, &y, &n);
+//   stride = (x*4 + 3) & ~3;                 // any row pitch >= x*desired_channels
+//   ... obtain at least stride*y bytes at 'dest' ...
+//   ok = stbi_load_into(filename, dest, stride*y, stride, &x, &y, &n, 4);
+//
+// 'output_stride' is the distance in bytes between the starts of consecutive
+// rows; pass 0 for tightly packed rows. The call fails (returns 0) without
+// writing anything if the decoded image does not fit in 'output_size' bytes;
+// *x, *y and *channels_in_file are still filled in so you can retry.
+// Vertical flipping and 16-to-8 bit reduction are folded into the final
+// write, so they don't cost a separate pass over the image.
+//
+// JPEG writes its rows straight into 'dest' as it decodes them. So do 8-bit
+// PNG without a palette, BMP, TGA and 8-bit PNM, as long as desired_channels
+// is 0 or matches what the file decodes to. Everything else -- paletted or
+// 16-bit PNG, GIF, PSD, PIC, HDR, and channel conversions outside JPEG --
+// still decodes into a buffer of its own and copies that into 'dest', so it
+// costs one full-image allocation. A corrupt file that fails part way
+// through may leave 'dest' partly written.
+//
+// ===========================================================================
+//
 // UNICODE:
 //
 //   If compiling for Windows and you wish to use Unicode filenames, compile
@@ -253,6 +282,14 @@ RECENT REVISION HISTORY:
 // The three functions you must define are "read" (reads some bytes of data),
 // "skip" (skips some bytes of data), "eof" (reports if the stream is at the end).
 //
+// The functions that take a filename (stbi_load, stbi_info, ...) don't go
+// through that buffer on Linux: they mmap the file and decode it as if it
+// came from stbi_load_from_memory, so probing a header only touches the pages
+// it reads. Files that can't be mapped (pipes, empty files, files over 2GB)
+// and other platforms use stdio with a 64KB buffer instead. Don't truncate a
+// file while it's being decoded, or the process may get SIGBUS. Define
+// STBI_NO_MMAP to always use stdio.
+//
 // ===========================================================================
 //
 // SIMD support
@@ -274,6 +311,12 @@ RECENT REVISION HISTORY:
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
 //
+// Converting between channel counts (desired_channels != channels_in_file)
+// also uses SSE2 on x86. If the compiler targets SSSE3 or AVX2 (for example
+// -mssse3, -mavx2, -march=native or /arch:AVX2), wider shuffle kernels are
+// used as well; there's no run-time detection for those. Define STBI_NO_SSSE3
+// or STBI_NO_AVX2 to opt out of them.
+//
 // ===========================================================================
 //
 // HDR image support   (disable by defining STBI_NO_HDR)
@@ -383,6 +426,21 @@ enum
    STBI_rgb_alpha  = 4
 };
 
+enum
+{
+   STBI_format_auto = 0, // only used for stbi_set_format_hint
+
+   STBI_format_jpeg,
+   STBI_format_png,
+   STBI_format_bmp,
+   STBI_format_gif,
+   STBI_format_psd,
+   STBI_format_pic,
+   STBI_format_pnm,
+   STBI_format_hdr,
+   STBI_format_tga
+};
+
 #include <stdlib.h>
 typedef unsigned char stbi_uc;
 typedef unsigned short stbi_us;
@@ -433,6 +491,15 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
 #endif
 
+// decode into caller-provided memory with the given row pitch; returns 1 on success, 0 on failure
+STBIDEF int      stbi_load_into_from_memory   (stbi_uc           const *buffer, int len   , stbi_uc *output, size_t output_size, int output_stride, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF int      stbi_load_into_from_callbacks(stbi_io_callbacks const *clbk  , void *user, stbi_uc *output, size_t output_size, int output_stride, int *x, int *y, int *channels_in_file, int desired_channels);
+
+#ifndef STBI_NO_STDIO
+STBIDEF int      stbi_load_into          (char const *filename, stbi_uc *output, size_t output_size, int output_stride, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF int      stbi_load_into_from_file(FILE *f,              stbi_uc *output, size_t output_size, int output_stride, int *x, int *y, int *channels_in_file, int desired_channels);
+#endif
+
 #ifdef STBI_WINDOWS_UTF8
 STBIDEF int stbi_convert_wchar_to_utf8(char *buffer, size_t bufferlen, const wchar_t* input);
 #endif
@@ -514,15 +581,50 @@ STBIDEF void stbi_set_unpremultiply_on_load(int flag_true_if_should_unpremultipl
 // or just pass them through "as-is"
 STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 
-// flip the image vertically, so the first pixel in the output array is the bottom left
+// flip the image vertically, so the first pixel in the output array is the bottom left.
+// the JPEG, PNG, BMP, TGA and PNM loaders write their scanlines in flipped order as
+// they decode, so this is free for them; other formats get a separate flip pass.
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+// the format is normally picked from the first bytes of the file. if you know
+// what you're loading, pass one of the STBI_format_* values to have that
+// format tried first; if the file turns out not to be one, it's detected as
+// usual. mostly useful for TGA, which has no magic number to detect it by.
+// STBI_format_auto (the default) turns the hint off.
+STBIDEF void stbi_set_format_hint(int format);
+
 // as above, but only applies to images loaded on the thread that calls the function
 // this function is only available if your compiler supports thread-local variables;
 // calling it will fail to link if your compiler doesn't
 STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpremultiply);
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
+STBIDEF void stbi_set_format_hint_thread(int format);
+
+#ifdef STBI_PROFILE
+// define STBI_PROFILE (in the file with the implementation and wherever you call
+// these) to count the time spent in the main decode stages. the counts are in
+// ticks of the cheapest cycle counter available (rdtsc on x86, cntvct on arm64,
+// clock() elsewhere), are kept per thread if STBI_THREAD_LOCAL is available, and
+// accumulate over every load until you reset them. it adds a counter read around
+// every block the stage works on, so leave it off in normal builds.
+enum
+{
+   STBI_PROFILE_jpeg_huffman, // entropy decoding of the coefficients
+   STBI_PROFILE_jpeg_idct,
+   STBI_PROFILE_jpeg_color,   // chroma upsampling and YCbCr->RGB
+   STBI_PROFILE_png_inflate,
+   STBI_PROFILE_png_unfilter, // includes de-interlacing and bit depth expansion
+   STBI_PROFILE_convert,      // stbi__convert_format to the requested channels
+   STBI_PROFILE_count
+};
+
+STBIDEF void               stbi_profile_reset(void);
+STBIDEF unsigned long long stbi_profile_ticks(int stage);
+STBIDEF const char        *stbi_profile_stage_name(int stage);
+// the raw counter the stages are timed with, to calibrate the ticks against a wall clock
+STBIDEF unsigned long long stbi_profile_counter(void);
+#endif
 
 // ZLIB client - used by PNG, available for other purposes
 
@@ -598,6 +700,18 @@ STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const ch
 #include <stdio.h>
 #endif
 
+// on Linux the filename-based functions map the file and decode it from memory
+#if !defined(STBI_NO_STDIO) && !defined(STBI_NO_MMAP) && defined(__linux__)
+#define STBI__MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifndef O_CLOEXEC // strict -std=c99 hides it; the descriptor is closed right after mapping anyway
+#define O_CLOEXEC 0
+#endif
+#endif
+
 #ifndef STBI_ASSERT
 #include <assert.h>
 #define STBI_ASSERT(x) assert(x)
@@ -792,10 +906,84 @@ static int stbi__sse2_available(void)
 #define STBI_SIMD_ALIGN(type, name) type name
 #endif
 
+// the channel-count converters use SSE2 without a run-time check, so only when
+// the target guarantees it (always on x64, -msse2 or /arch:SSE2 on x86).
+// SSSE3 and AVX2 follow the same rule as GCC's SSE2 above: they're used only if
+// the compiler already targets them (-mssse3, -mavx2, -march=native, /arch:AVX2).
+#if defined(STBI_SSE2) && (defined(STBI__X64_TARGET) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define STBI__CONVERT_SSE2
+#if !defined(STBI_NO_SSSE3) && (defined(__SSSE3__) || defined(__AVX__))
+#define STBI_SSSE3
+#include <tmmintrin.h>
+#endif
+#if defined(STBI_SSSE3) && !defined(STBI_NO_AVX2) && defined(__AVX2__)
+#define STBI_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
 #ifndef STBI_MAX_DIMENSIONS
 #define STBI_MAX_DIMENSIONS (1 << 24)
 #endif
 
+#ifdef STBI_PROFILE
+#if defined(_MSC_VER) && (defined(STBI__X86_TARGET) || defined(STBI__X64_TARGET))
+#include <intrin.h>
+#define stbi__profile_now()  ((unsigned long long) __rdtsc())
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <x86intrin.h>
+#define stbi__profile_now()  ((unsigned long long) __rdtsc())
+#elif defined(__GNUC__) && defined(__aarch64__)
+static unsigned long long stbi__profile_now(void)
+{
+   unsigned long long t;
+   __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(t));
+   return t;
+}
+#else
+#include <time.h>
+#define stbi__profile_now()  ((unsigned long long) clock())
+#endif
+
+static
+#ifdef STBI_THREAD_LOCAL
+STBI_THREAD_LOCAL
+#endif
+unsigned long long stbi__profile_total[STBI_PROFILE_count], stbi__profile_start[STBI_PROFILE_count];
+
+STBIDEF void stbi_profile_reset(void)
+{
+   int i;
+   for (i=0; i < STBI_PROFILE_count; ++i)
+      stbi__profile_total[i] = 0;
+}
+
+STBIDEF unsigned long long stbi_profile_ticks(int stage)
+{
+   return (stage >= 0 && stage < STBI_PROFILE_count) ? stbi__profile_total[stage] : 0;
+}
+
+STBIDEF const char *stbi_profile_stage_name(int stage)
+{
+   static const char *names[STBI_PROFILE_count] = {
+      "jpeg huffman", "jpeg idct", "jpeg color", "png inflate", "png unfilter", "convert"
+   };
+   return (stage >= 0 && stage < STBI_PROFILE_count) ? names[stage] : "";
+}
+
+STBIDEF unsigned long long stbi_profile_counter(void)
+{
+   return stbi__profile_now();
+}
+
+// these are expressions, so in C89 they have to go after a block's declarations
+#define STBI__PROFILE_BEGIN(stage)  (stbi__profile_start[stage] = stbi__profile_now())
+#define STBI__PROFILE_END(stage)    (stbi__profile_total[stage] += stbi__profile_now() - stbi__profile_start[stage])
+#else
+#define STBI__PROFILE_BEGIN(stage)  ((void) 0)
+#define STBI__PROFILE_END(stage)    ((void) 0)
+#endif
+
 ///////////////////////////////////////////////
 //
 //  stbi__context struct and start_xxx functions
@@ -903,6 +1091,10 @@ typedef struct
    int bits_per_channel;
    int num_channels;
    int channel_order;
+   int vertically_flipped; // loader already emitted rows bottom-up, don't flip again
+   stbi_uc *output;        // stbi_load_into: caller's memory the loader may write 8-bit rows into
+   size_t output_size;
+   size_t output_stride;
 } stbi__result_info;
 
 #ifndef STBI_NO_JPEG
@@ -1134,59 +1326,186 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
-static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
+static int stbi__format_hint_global = STBI_format_auto;
+
+STBIDEF void stbi_set_format_hint(int format)
+{
+   stbi__format_hint_global = format;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__format_hint  stbi__format_hint_global
+#else
+static STBI_THREAD_LOCAL int stbi__format_hint_local, stbi__format_hint_set;
+
+STBIDEF void stbi_set_format_hint_thread(int format)
+{
+   stbi__format_hint_local = format;
+   stbi__format_hint_set = 1;
+}
+
+#define stbi__format_hint  (stbi__format_hint_set       \
+                             ? stbi__format_hint_local  \
+                             : stbi__format_hint_global)
+#endif // STBI_THREAD_LOCAL
+
+#define STBI__FORMAT_PROBE  -1 // too little buffered to tell; try every format
+
+// Every format but TGA begins with its own magic bytes, and each format's test
+// rejects a stream without them, so the first bytes name the one format whose
+// test can pass. That test and then TGA's (which has no magic number, and so
+// always went last) give the same answer as running every test in turn,
+// without parsing and rewinding past the other headers. The checks here only
+// need to be necessary conditions of each test.
+static int stbi__sniff_format(stbi__context *s)
+{
+   stbi_uc const *p = s->img_buffer_original;
+   if (s->img_buffer_original_end - p < 8) return STBI__FORMAT_PROBE;
+
+   if (p[0] == 0x89 && p[1] == 'P'  && p[2] == 'N'  && p[3] == 'G' ) return STBI_format_png;
+   if (p[0] == 'B'  && p[1] == 'M'                                  ) return STBI_format_bmp;
+   if (p[0] == 'G'  && p[1] == 'I'  && p[2] == 'F'  && p[3] == '8' ) return STBI_format_gif;
+   if (p[0] == '8'  && p[1] == 'B'  && p[2] == 'P'  && p[3] == 'S' ) return STBI_format_psd;
+   if (p[0] == 0x53 && p[1] == 0x80 && p[2] == 0xF6 && p[3] == 0x34) return STBI_format_pic;
+   if (p[0] == 0xff                                                 ) return STBI_format_jpeg; // SOI, maybe after fill bytes
+   if (p[0] == 'P'  && (p[1] == '5' || p[1] == '6')                 ) return STBI_format_pnm;
+   if (p[0] == '#'  && p[1] == '?'                                  ) return STBI_format_hdr;
+   return STBI_format_tga;
+}
+
+static int stbi__format_test(stbi__context *s, int format)
+{
+   stbi__rewind(s);
+   switch (format) {
+      #ifndef STBI_NO_JPEG
+      case STBI_format_jpeg: return stbi__jpeg_test(s);
+      #endif
+      #ifndef STBI_NO_PNG
+      case STBI_format_png:  return stbi__png_test(s);
+      #endif
+      #ifndef STBI_NO_BMP
+      case STBI_format_bmp:  return stbi__bmp_test(s);
+      #endif
+      #ifndef STBI_NO_GIF
+      case STBI_format_gif:  return stbi__gif_test(s);
+      #endif
+      #ifndef STBI_NO_PSD
+      case STBI_format_psd:  return stbi__psd_test(s);
+      #endif
+      #ifndef STBI_NO_PIC
+      case STBI_format_pic:  return stbi__pic_test(s);
+      #endif
+      #ifndef STBI_NO_PNM
+      case STBI_format_pnm:  return stbi__pnm_test(s);
+      #endif
+      #ifndef STBI_NO_HDR
+      case STBI_format_hdr:  return stbi__hdr_test(s);
+      #endif
+      #ifndef STBI_NO_TGA
+      case STBI_format_tga:  return stbi__tga_test(s);
+      #endif
+      default:               return 0;
+   }
+}
+
+// returns the format whose test passes, or 0 if none does
+static int stbi__detect_format(stbi__context *s)
+{
+   // the order the tests used to run in: explicit magic numbers first, TGA last
+   static const int probe_order[] = {
+      STBI_format_png, STBI_format_bmp, STBI_format_gif, STBI_format_psd, STBI_format_pic,
+      STBI_format_jpeg, STBI_format_pnm, STBI_format_hdr, STBI_format_tga
+   };
+   int hint = stbi__format_hint, format, i;
+
+   if (hint != STBI_format_auto && stbi__format_test(s, hint)) return hint;
+
+   format = stbi__sniff_format(s);
+   if (format == STBI__FORMAT_PROBE) {
+      for (i=0; i < (int) (sizeof(probe_order)/sizeof(probe_order[0])); ++i)
+         if (probe_order[i] != hint && stbi__format_test(s, probe_order[i]))
+            return probe_order[i];
+      return 0;
+   }
+   if (format != hint && stbi__format_test(s, format)) return format;
+   if (format != STBI_format_tga && hint != STBI_format_tga && stbi__format_test(s, STBI_format_tga)) return STBI_format_tga;
+   return 0;
+}
+
+// stbi_load_into: loaders whose rows come out as final 8-bit pixels write them straight
+// into the caller's memory when this says a w x h image with n channels fits there.
+// they then return ri->output itself, with any vertical flip already applied, stepping
+// rows by ri->output_stride (which this resolves for tightly packed rows).
+static int stbi__into_usable(stbi__result_info *ri, int w, int h, int n)
+{
+   size_t row_bytes = (size_t) w * n, stride;
+   if (ri->output == NULL || w <= 0 || h <= 0) return 0;
+   stride = ri->output_stride ? ri->output_stride : row_bytes;
+   if (stride < row_bytes || ri->output_size < row_bytes) return 0;
+   if ((size_t) (h-1) > (ri->output_size - row_bytes) / stride) return 0;
+   ri->output_stride = stride;
+   return 1;
+}
+
+// frees a loader's pixel buffer, unless it is the caller's memory
+static void stbi__free_output(void *out, stbi__result_info *ri)
+{
+   if (out != ri->output) STBI_FREE(out);
+}
+
+static void *stbi__load_main_into(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc, stbi_uc *output, size_t output_size, size_t output_stride)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
    ri->bits_per_channel = 8; // default is 8 so most paths don't have to be changed
    ri->channel_order = STBI_ORDER_RGB; // all current input & output are this, but this is here so we can add BGR order
    ri->num_channels = 0;
+   ri->output = output;
+   ri->output_size = output_size;
+   ri->output_stride = output_stride;
 
-   // test the formats with a very explicit header first (at least a FOURCC
-   // or distinctive magic number first)
-   #ifndef STBI_NO_PNG
-   if (stbi__png_test(s))  return stbi__png_load(s,x,y,comp,req_comp, ri);
-   #endif
-   #ifndef STBI_NO_BMP
-   if (stbi__bmp_test(s))  return stbi__bmp_load(s,x,y,comp,req_comp, ri);
-   #endif
-   #ifndef STBI_NO_GIF
-   if (stbi__gif_test(s))  return stbi__gif_load(s,x,y,comp,req_comp, ri);
-   #endif
-   #ifndef STBI_NO_PSD
-   if (stbi__psd_test(s))  return stbi__psd_load(s,x,y,comp,req_comp, ri, bpc);
-   #else
-   STBI_NOTUSED(bpc);
-   #endif
-   #ifndef STBI_NO_PIC
-   if (stbi__pic_test(s))  return stbi__pic_load(s,x,y,comp,req_comp, ri);
-   #endif
-
-   // then the formats that can end up attempting to load with just 1 or 2
-   // bytes matching expectations; these are prone to false positives, so
-   // try them later
-   #ifndef STBI_NO_JPEG
-   if (stbi__jpeg_test(s)) return stbi__jpeg_load(s,x,y,comp,req_comp, ri);
-   #endif
-   #ifndef STBI_NO_PNM
-   if (stbi__pnm_test(s))  return stbi__pnm_load(s,x,y,comp,req_comp, ri);
-   #endif
-
-   #ifndef STBI_NO_HDR
-   if (stbi__hdr_test(s)) {
-      float *hdr = stbi__hdr_load(s, x,y,comp,req_comp, ri);
-      return stbi__hdr_to_ldr(hdr, *x, *y, req_comp ? req_comp : *comp);
+   switch (stbi__detect_format(s)) {
+      #ifndef STBI_NO_PNG
+      case STBI_format_png:  return stbi__png_load(s,x,y,comp,req_comp, ri);
+      #endif
+      #ifndef STBI_NO_BMP
+      case STBI_format_bmp:  return stbi__bmp_load(s,x,y,comp,req_comp, ri);
+      #endif
+      #ifndef STBI_NO_GIF
+      case STBI_format_gif:  return stbi__gif_load(s,x,y,comp,req_comp, ri);
+      #endif
+      #ifndef STBI_NO_PSD
+      case STBI_format_psd:  return stbi__psd_load(s,x,y,comp,req_comp, ri, bpc);
+      #endif
+      #ifndef STBI_NO_PIC
+      case STBI_format_pic:  return stbi__pic_load(s,x,y,comp,req_comp, ri);
+      #endif
+      #ifndef STBI_NO_JPEG
+      case STBI_format_jpeg: return stbi__jpeg_load(s,x,y,comp,req_comp, ri);
+      #endif
+      #ifndef STBI_NO_PNM
+      case STBI_format_pnm:  return stbi__pnm_load(s,x,y,comp,req_comp, ri);
+      #endif
+      #ifndef STBI_NO_HDR
+      case STBI_format_hdr: {
+         float *hdr = stbi__hdr_load(s, x,y,comp,req_comp, ri);
+         return stbi__hdr_to_ldr(hdr, *x, *y, req_comp ? req_comp : *comp);
+      }
+      #endif
+      #ifndef STBI_NO_TGA
+      case STBI_format_tga:  return stbi__tga_load(s,x,y,comp,req_comp, ri);
+      #endif
+      default: break;
    }
-   #endif
-
-   #ifndef STBI_NO_TGA
-   // test tga last because it's a crappy test!
-   if (stbi__tga_test(s))
-      return stbi__tga_load(s,x,y,comp,req_comp, ri);
-   #endif
+   STBI_NOTUSED(bpc);
 
    return stbi__errpuc("unknown image type", "Image not of any known type, or corrupt");
 }
 
+static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
+{
+   return stbi__load_main_into(s, x, y, comp, req_comp, ri, bpc, NULL, 0, 0);
+}
+
 static stbi_uc *stbi__convert_16_to_8(stbi__uint16 *orig, int w, int h, int channels)
 {
    int i;
@@ -1275,7 +1594,7 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
 
    // @TODO: move stbi__convert_format to here
 
-   if (stbi__vertically_flip_on_load) {
+   if (stbi__vertically_flip_on_load && !ri.vertically_flipped) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
    }
@@ -1302,7 +1621,7 @@ static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x,
    // @TODO: move stbi__convert_format16 to here
    // @TODO: special case RGB-to-Y (and RGBA-to-YA) for 8-bit-to-16-bit case to keep more precision
 
-   if (stbi__vertically_flip_on_load) {
+   if (stbi__vertically_flip_on_load && !ri.vertically_flipped) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi__uint16));
    }
@@ -1310,6 +1629,62 @@ static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x,
    return (stbi__uint16 *) result;
 }
 
+// decode into the caller's memory. the JPEG, PNG, BMP, TGA and PNM loaders write their rows
+// there themselves when they can (see stbi__into_usable); anything else is decoded into a
+// buffer of its own and then copied row by row, with the 16->8 reduction and the vertical
+// flip done by that copy.
+static int stbi__load_and_postprocess_8bit_into(stbi__context *s, stbi_uc *output, size_t output_size, int output_stride, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__result_info ri;
+   int w, h, n, row, i, flip;
+   size_t row_bytes, stride;
+   void *result;
+
+   if (output == NULL) return stbi__err("bad output", "Output buffer is NULL");
+   if (output_stride < 0) return stbi__err("bad stride", "Negative output stride");
+
+   result = stbi__load_main_into(s, &w, &h, &n, req_comp, &ri, 8, output, output_size, (size_t) output_stride);
+   if (result == NULL)
+      return 0;
+
+   // it is the responsibility of the loaders to make sure we get either 8 or 16 bit.
+   STBI_ASSERT(ri.bits_per_channel == 8 || ri.bits_per_channel == 16);
+
+   // report the dimensions even if the image doesn't fit, so the caller can retry
+   *x = w;
+   *y = h;
+   if (comp) *comp = n;
+
+   // written in place, already flipped
+   if (result == (void *) output) {
+      STBI_ASSERT(ri.vertically_flipped == stbi__vertically_flip_on_load);
+      return 1;
+   }
+
+   n = req_comp ? req_comp : n;
+   row_bytes = (size_t) w * n;
+   stride = output_stride ? (size_t) output_stride : row_bytes;
+   if (stride < row_bytes || (h > 0 && (size_t) (h-1) * stride + row_bytes > output_size)) {
+      STBI_FREE(result);
+      return stbi__err("buffer too small", "Output buffer too small for image");
+   }
+
+   flip = stbi__vertically_flip_on_load && !ri.vertically_flipped;
+   for (row = 0; row < h; ++row) {
+      stbi_uc *dest = output + (size_t) (flip ? h - 1 - row : row) * stride;
+      if (ri.bits_per_channel == 8) {
+         memcpy(dest, (stbi_uc *) result + row * row_bytes, row_bytes);
+      } else {
+         stbi__uint16 *src = (stbi__uint16 *) result + row * row_bytes;
+         for (i = 0; i < (int) row_bytes; ++i)
+            dest[i] = (stbi_uc) ((src[i] >> 8) & 0xFF); // same approximation as stbi__convert_16_to_8
+      }
+   }
+
+   STBI_FREE(result);
+   return 1;
+}
+
 #if !defined(STBI_NO_HDR) && !defined(STBI_NO_LINEAR)
 static void stbi__float_postprocess(float *result, int *x, int *y, int *comp, int req_comp)
 {
@@ -1362,14 +1737,80 @@ static FILE *stbi__fopen(char const *filename, char const *mode)
    return f;
 }
 
+// a file opened by name: mapped if possible, else a FILE with a big buffer
+typedef struct
+{
+   FILE *f;
+#ifdef STBI__MMAP
+   stbi_uc *map;
+   int map_len;
+#endif
+} stbi__file_source;
+
+#define STBI__FILE_BUFFER_SIZE  65536
+
+// whole_file says the caller is about to decode all of it, rather than probe a header
+static int stbi__open_source(stbi__file_source *src, char const *filename, int whole_file)
+{
+#ifdef STBI__MMAP
+   int fd = open(filename, O_RDONLY | O_CLOEXEC);
+   src->map = NULL;
+   if (fd >= 0) {
+      struct stat st;
+      if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size <= INT_MAX) {
+         int flags = MAP_PRIVATE;
+         void *p;
+         #ifdef MAP_POPULATE
+         if (whole_file) flags |= MAP_POPULATE; // fault it all in with one call
+         #endif
+         p = mmap(NULL, (size_t) st.st_size, PROT_READ, flags, fd, 0);
+         if (p != MAP_FAILED) {
+            src->map = (stbi_uc *) p;
+            src->map_len = (int) st.st_size;
+         }
+      }
+      close(fd);
+      if (src->map) {
+         src->f = NULL;
+         return 1;
+      }
+   }
+#endif
+   src->f = stbi__fopen(filename, "rb");
+   if (!src->f) return 0;
+   if (whole_file) setvbuf(src->f, NULL, _IOFBF, STBI__FILE_BUFFER_SIZE);
+   return 1;
+}
+
+static void stbi__start_source(stbi__context *s, stbi__file_source *src)
+{
+#ifdef STBI__MMAP
+   if (src->map) {
+      stbi__start_mem(s, src->map, src->map_len);
+      return;
+   }
+#endif
+   stbi__start_file(s, src->f);
+}
+
+static void stbi__close_source(stbi__file_source *src)
+{
+#ifdef STBI__MMAP
+   if (src->map) munmap(src->map, (size_t) src->map_len);
+#endif
+   if (src->f) fclose(src->f);
+}
+
 
 STBIDEF stbi_uc *stbi_load(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
-   FILE *f = stbi__fopen(filename, "rb");
+   stbi__file_source src;
+   stbi__context s;
    unsigned char *result;
-   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
-   result = stbi_load_from_file(f,x,y,comp,req_comp);
-   fclose(f);
+   if (!stbi__open_source(&src, filename, 1)) return stbi__errpuc("can't fopen", "Unable to open file");
+   stbi__start_source(&s, &src);
+   result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+   stbi__close_source(&src);
    return result;
 }
 
@@ -1386,6 +1827,31 @@ STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *comp, int req
    return result;
 }
 
+STBIDEF int stbi_load_into(char const *filename, stbi_uc *output, size_t output_size, int output_stride, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__file_source src;
+   stbi__context s;
+   int result;
+   if (!stbi__open_source(&src, filename, 1)) return stbi__err("can't fopen", "Unable to open file");
+   stbi__start_source(&s, &src);
+   result = stbi__load_and_postprocess_8bit_into(&s,output,output_size,output_stride,x,y,comp,req_comp);
+   stbi__close_source(&src);
+   return result;
+}
+
+STBIDEF int stbi_load_into_from_file(FILE *f, stbi_uc *output, size_t output_size, int output_stride, int *x, int *y, int *comp, int req_comp)
+{
+   int result;
+   stbi__context s;
+   stbi__start_file(&s,f);
+   result = stbi__load_and_postprocess_8bit_into(&s,output,output_size,output_stride,x,y,comp,req_comp);
+   if (result) {
+      // need to 'unget' all the characters in the IO buffer
+      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   }
+   return result;
+}
+
 STBIDEF stbi__uint16 *stbi_load_from_file_16(FILE *f, int *x, int *y, int *comp, int req_comp)
 {
    stbi__uint16 *result;
@@ -1401,11 +1867,13 @@ STBIDEF stbi__uint16 *stbi_load_from_file_16(FILE *f, int *x, int *y, int *comp,
 
 STBIDEF stbi_us *stbi_load_16(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
-   FILE *f = stbi__fopen(filename, "rb");
+   stbi__file_source src;
+   stbi__context s;
    stbi__uint16 *result;
-   if (!f) return (stbi_us *) stbi__errpuc("can't fopen", "Unable to open file");
-   result = stbi_load_from_file_16(f,x,y,comp,req_comp);
-   fclose(f);
+   if (!stbi__open_source(&src, filename, 1)) return (stbi_us *) stbi__errpuc("can't fopen", "Unable to open file");
+   stbi__start_source(&s, &src);
+   result = stbi__load_and_postprocess_16bit(&s,x,y,comp,req_comp);
+   stbi__close_source(&src);
    return result;
 }
 
@@ -1440,6 +1908,20 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF int stbi_load_into_from_memory(stbi_uc const *buffer, int len, stbi_uc *output, size_t output_size, int output_stride, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_and_postprocess_8bit_into(&s,output,output_size,output_stride,x,y,comp,req_comp);
+}
+
+STBIDEF int stbi_load_into_from_callbacks(stbi_io_callbacks const *clbk, void *user, stbi_uc *output, size_t output_size, int output_stride, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__load_and_postprocess_8bit_into(&s,output,output_size,output_stride,x,y,comp,req_comp);
+}
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp)
 {
@@ -1461,7 +1943,8 @@ static float *stbi__loadf_main(stbi__context *s, int *x, int *y, int *comp, int
 {
    unsigned char *data;
    #ifndef STBI_NO_HDR
-   if (stbi__hdr_test(s)) {
+   int format = stbi__sniff_format(s);
+   if ((format == STBI_format_hdr || format == STBI__FORMAT_PROBE) && stbi__hdr_test(s)) {
       stbi__result_info ri;
       float *hdr_data = stbi__hdr_load(s,x,y,comp,req_comp, &ri);
       if (hdr_data)
@@ -1492,11 +1975,13 @@ STBIDEF float *stbi_loadf_from_callbacks(stbi_io_callbacks const *clbk, void *us
 #ifndef STBI_NO_STDIO
 STBIDEF float *stbi_loadf(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
+   stbi__file_source src;
+   stbi__context s;
    float *result;
-   FILE *f = stbi__fopen(filename, "rb");
-   if (!f) return stbi__errpf("can't fopen", "Unable to open file");
-   result = stbi_loadf_from_file(f,x,y,comp,req_comp);
-   fclose(f);
+   if (!stbi__open_source(&src, filename, 1)) return stbi__errpf("can't fopen", "Unable to open file");
+   stbi__start_source(&s, &src);
+   result = stbi__loadf_main(&s,x,y,comp,req_comp);
+   stbi__close_source(&src);
    return result;
 }
 
@@ -1530,13 +2015,20 @@ STBIDEF int stbi_is_hdr_from_memory(stbi_uc const *buffer, int len)
 #ifndef STBI_NO_STDIO
 STBIDEF int      stbi_is_hdr          (char const *filename)
 {
-   FILE *f = stbi__fopen(filename, "rb");
+   #ifndef STBI_NO_HDR
+   stbi__file_source src;
+   stbi__context s;
    int result=0;
-   if (f) {
-      result = stbi_is_hdr_from_file(f);
-      fclose(f);
+   if (stbi__open_source(&src, filename, 0)) {
+      stbi__start_source(&s, &src);
+      result = stbi__hdr_test(&s);
+      stbi__close_source(&src);
    }
    return result;
+   #else
+   STBI_NOTUSED(filename);
+   return 0;
+   #endif
 }
 
 STBIDEF int stbi_is_hdr_from_file(FILE *f)
@@ -1688,6 +2180,30 @@ static int stbi__getn(stbi__context *s, stbi_uc *buffer, int n)
 }
 #endif
 
+#if defined(STBI_NO_TGA) && defined(STBI_NO_PSD) && defined(STBI_NO_HDR)
+// nothing
+#else
+// same result as n calls to stbi__get8 (reading past the end gives zeros), but
+// copies whatever is already buffered in one go; for memory that's everything
+static void stbi__get_bytes(stbi__context *s, stbi_uc *buffer, int n)
+{
+   while (n > 0) {
+      int blen = (int) (s->img_buffer_end - s->img_buffer);
+      if (blen > 0) {
+         if (blen > n) blen = n;
+         memcpy(buffer, s->img_buffer, blen);
+         s->img_buffer += blen;
+         buffer += blen;
+         n -= blen;
+      } else {
+         // refills from the callbacks, or a zero at the end
+         *buffer++ = stbi__get8(s);
+         --n;
+      }
+   }
+}
+#endif
+
 #if defined(STBI_NO_JPEG) && defined(STBI_NO_PNG) && defined(STBI_NO_PSD) && defined(STBI_NO_PIC)
 // nothing
 #else
@@ -1747,11 +2263,204 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
 {
    return (stbi_uc) (((r*77) + (g*150) +  (29*b)) >> 8);
 }
-#endif
+#endif
+
+#if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
+// nothing
+#else
+#ifdef STBI__CONVERT_SSE2
+// 4 pixels' worth of luminance from RGBx bytes, as 32-bit lanes; same math as stbi__compute_y
+static __m128i stbi__compute_y_sse2(__m128i rgbx)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i w    = _mm_setr_epi16(77,150,29,0, 77,150,29,0);
+   __m128i lo   = _mm_madd_epi16(_mm_unpacklo_epi8(rgbx, zero), w); // r*77+g*150, b*29 for pixels 0,1
+   __m128i hi   = _mm_madd_epi16(_mm_unpackhi_epi8(rgbx, zero), w); // same for pixels 2,3
+   lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+   hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+   lo = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2,0,2,0)));
+   return _mm_srli_epi32(lo, 8);
+}
+
+// 16 pixels' luminance as bytes, from four registers of RGBx pixels
+static __m128i stbi__compute_y16px_sse2(__m128i p0, __m128i p1, __m128i p2, __m128i p3)
+{
+   __m128i y01 = _mm_packs_epi32(stbi__compute_y_sse2(p0), stbi__compute_y_sse2(p1));
+   __m128i y23 = _mm_packs_epi32(stbi__compute_y_sse2(p2), stbi__compute_y_sse2(p3));
+   return _mm_packus_epi16(y01, y23);
+}
+
+// converts a prefix of a scanline with SIMD, and returns how many pixels it did;
+// the caller finishes the row. every kernel reads all of its input before it
+// stores, and never stores past the input it has consumed when req_comp < img_n,
+// so it is safe to run in place.
+static int stbi__convert_row_simd(stbi_uc *dest, stbi_uc const *src, int img_n, int req_comp, int count)
+{
+   int i = 0;
+   __m128i ff = _mm_set1_epi8((char) 0xff);
+   switch (img_n*8 + req_comp) {
+      case 1*8+2:
+         for (; i+16 <= count; i += 16) {
+            __m128i g = _mm_loadu_si128((__m128i const *) (src + i));
+            _mm_storeu_si128((__m128i *) (dest + i*2     ), _mm_unpacklo_epi8(g, ff));
+            _mm_storeu_si128((__m128i *) (dest + i*2 + 16), _mm_unpackhi_epi8(g, ff));
+         }
+         break;
+      case 1*8+4:
+         for (; i+16 <= count; i += 16) {
+            __m128i g  = _mm_loadu_si128((__m128i const *) (src + i));
+            __m128i gg = _mm_unpacklo_epi8(g, g), ga = _mm_unpacklo_epi8(g, ff);
+            __m128i hh = _mm_unpackhi_epi8(g, g), ha = _mm_unpackhi_epi8(g, ff);
+            _mm_storeu_si128((__m128i *) (dest + i*4     ), _mm_unpacklo_epi16(gg, ga));
+            _mm_storeu_si128((__m128i *) (dest + i*4 + 16), _mm_unpackhi_epi16(gg, ga));
+            _mm_storeu_si128((__m128i *) (dest + i*4 + 32), _mm_unpacklo_epi16(hh, ha));
+            _mm_storeu_si128((__m128i *) (dest + i*4 + 48), _mm_unpackhi_epi16(hh, ha));
+         }
+         break;
+      case 2*8+1: {
+         __m128i lo8 = _mm_set1_epi16(0x00ff);
+         for (; i+16 <= count; i += 16) {
+            __m128i a = _mm_and_si128(_mm_loadu_si128((__m128i const *) (src + i*2     )), lo8);
+            __m128i b = _mm_and_si128(_mm_loadu_si128((__m128i const *) (src + i*2 + 16)), lo8);
+            _mm_storeu_si128((__m128i *) (dest + i), _mm_packus_epi16(a, b));
+         }
+         break;
+      }
+      case 4*8+1:
+         for (; i+16 <= count; i += 16) {
+            __m128i p0 = _mm_loadu_si128((__m128i const *) (src + i*4     ));
+            __m128i p1 = _mm_loadu_si128((__m128i const *) (src + i*4 + 16));
+            __m128i p2 = _mm_loadu_si128((__m128i const *) (src + i*4 + 32));
+            __m128i p3 = _mm_loadu_si128((__m128i const *) (src + i*4 + 48));
+            _mm_storeu_si128((__m128i *) (dest + i), stbi__compute_y16px_sse2(p0, p1, p2, p3));
+         }
+         break;
+      case 4*8+2:
+         for (; i+16 <= count; i += 16) {
+            __m128i p0 = _mm_loadu_si128((__m128i const *) (src + i*4     ));
+            __m128i p1 = _mm_loadu_si128((__m128i const *) (src + i*4 + 16));
+            __m128i p2 = _mm_loadu_si128((__m128i const *) (src + i*4 + 32));
+            __m128i p3 = _mm_loadu_si128((__m128i const *) (src + i*4 + 48));
+            __m128i y  = stbi__compute_y16px_sse2(p0, p1, p2, p3);
+            __m128i a  = _mm_packus_epi16(_mm_packs_epi32(_mm_srli_epi32(p0, 24), _mm_srli_epi32(p1, 24)),
+                                          _mm_packs_epi32(_mm_srli_epi32(p2, 24), _mm_srli_epi32(p3, 24)));
+            _mm_storeu_si128((__m128i *) (dest + i*2     ), _mm_unpacklo_epi8(y, a));
+            _mm_storeu_si128((__m128i *) (dest + i*2 + 16), _mm_unpackhi_epi8(y, a));
+         }
+         break;
+      #ifdef STBI_SSSE3
+      case 1*8+3: {
+         __m128i m0 = _mm_setr_epi8(0,0,0,1,1,1,2,2,2,3,3,3,4,4,4,5);
+         __m128i m1 = _mm_setr_epi8(5,5,6,6,6,7,7,7,8,8,8,9,9,9,10,10);
+         __m128i m2 = _mm_setr_epi8(10,11,11,11,12,12,12,13,13,13,14,14,14,15,15,15);
+         for (; i+16 <= count; i += 16) {
+            __m128i g = _mm_loadu_si128((__m128i const *) (src + i));
+            _mm_storeu_si128((__m128i *) (dest + i*3     ), _mm_shuffle_epi8(g, m0));
+            _mm_storeu_si128((__m128i *) (dest + i*3 + 16), _mm_shuffle_epi8(g, m1));
+            _mm_storeu_si128((__m128i *) (dest + i*3 + 32), _mm_shuffle_epi8(g, m2));
+         }
+         break;
+      }
+      case 2*8+3: {
+         __m128i m0 = _mm_setr_epi8(0,0,0,2,2,2,4,4,4,6,6,6,8,8,8,10);
+         __m128i m1 = _mm_setr_epi8(10,10,12,12,12,14,14,14,-1,-1,-1,-1,-1,-1,-1,-1);
+         __m128i m2 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,0,0,0,2,2,2,4,4);
+         __m128i m3 = _mm_setr_epi8(4,6,6,6,8,8,8,10,10,10,12,12,12,14,14,14);
+         for (; i+16 <= count; i += 16) {
+            __m128i a = _mm_loadu_si128((__m128i const *) (src + i*2     ));
+            __m128i b = _mm_loadu_si128((__m128i const *) (src + i*2 + 16));
+            _mm_storeu_si128((__m128i *) (dest + i*3     ), _mm_shuffle_epi8(a, m0));
+            _mm_storeu_si128((__m128i *) (dest + i*3 + 16), _mm_or_si128(_mm_shuffle_epi8(a, m1), _mm_shuffle_epi8(b, m2)));
+            _mm_storeu_si128((__m128i *) (dest + i*3 + 32), _mm_shuffle_epi8(b, m3));
+         }
+         break;
+      }
+      case 2*8+4: {
+         __m128i m0 = _mm_setr_epi8(0,0,0,1,2,2,2,3,4,4,4,5,6,6,6,7);
+         __m128i m1 = _mm_setr_epi8(8,8,8,9,10,10,10,11,12,12,12,13,14,14,14,15);
+         for (; i+8 <= count; i += 8) {
+            __m128i ga = _mm_loadu_si128((__m128i const *) (src + i*2));
+            _mm_storeu_si128((__m128i *) (dest + i*4     ), _mm_shuffle_epi8(ga, m0));
+            _mm_storeu_si128((__m128i *) (dest + i*4 + 16), _mm_shuffle_epi8(ga, m1));
+         }
+         break;
+      }
+      case 3*8+1: case 3*8+2: case 3*8+4: {
+         // 16 RGB pixels are exactly three loads; realign them as four groups of 4 pixels
+         __m128i m = _mm_setr_epi8(0,1,2,-1,3,4,5,-1,6,7,8,-1,9,10,11,-1);
+         __m128i alpha = _mm_set1_epi32((int) 0xff000000);
+         #ifdef STBI_AVX2
+         if (req_comp == 4) {
+            __m256i m256 = _mm256_broadcastsi128_si256(m);
+            __m256i alpha256 = _mm256_set1_epi32((int) 0xff000000);
+            __m256i spread = _mm256_setr_epi32(0,1,2,3,3,4,5,6);
+            // each 32-byte load covers 8 pixels; the last 8 bytes belong to the next group
+            for (; i+11 <= count; i += 8) {
+               __m256i v = _mm256_loadu_si256((__m256i const *) (src + i*3));
+               v = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, spread), m256);
+               _mm256_storeu_si256((__m256i *) (dest + i*4), _mm256_or_si256(v, alpha256));
+            }
+         }
+         #endif
+         for (; i+16 <= count; i += 16) {
+            __m128i v0 = _mm_loadu_si128((__m128i const *) (src + i*3     ));
+            __m128i v1 = _mm_loadu_si128((__m128i const *) (src + i*3 + 16));
+            __m128i v2 = _mm_loadu_si128((__m128i const *) (src + i*3 + 32));
+            __m128i p0 = _mm_shuffle_epi8(v0, m);
+            __m128i p1 = _mm_shuffle_epi8(_mm_alignr_epi8(v1, v0, 12), m);
+            __m128i p2 = _mm_shuffle_epi8(_mm_alignr_epi8(v2, v1, 8), m);
+            __m128i p3 = _mm_shuffle_epi8(_mm_srli_si128(v2, 4), m);
+            if (req_comp == 4) {
+               _mm_storeu_si128((__m128i *) (dest + i*4     ), _mm_or_si128(p0, alpha));
+               _mm_storeu_si128((__m128i *) (dest + i*4 + 16), _mm_or_si128(p1, alpha));
+               _mm_storeu_si128((__m128i *) (dest + i*4 + 32), _mm_or_si128(p2, alpha));
+               _mm_storeu_si128((__m128i *) (dest + i*4 + 48), _mm_or_si128(p3, alpha));
+            } else {
+               __m128i y = stbi__compute_y16px_sse2(p0, p1, p2, p3);
+               if (req_comp == 1) {
+                  _mm_storeu_si128((__m128i *) (dest + i), y);
+               } else {
+                  _mm_storeu_si128((__m128i *) (dest + i*2     ), _mm_unpacklo_epi8(y, ff));
+                  _mm_storeu_si128((__m128i *) (dest + i*2 + 16), _mm_unpackhi_epi8(y, ff));
+               }
+            }
+         }
+         break;
+      }
+      case 4*8+3: {
+         __m128i m = _mm_setr_epi8(0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1);
+         #ifdef STBI_AVX2
+         __m256i m256 = _mm256_broadcastsi128_si256(m);
+         __m256i pack = _mm256_setr_epi32(0,1,2,4,5,6,7,7);
+         for (; i+8 <= count; i += 8) {
+            __m256i v = _mm256_loadu_si256((__m256i const *) (src + i*4));
+            __m128i lo, hi;
+            v  = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, m256), pack);
+            lo = _mm256_castsi256_si128(v);
+            hi = _mm256_extracti128_si256(v, 1);
+            _mm_storeu_si128((__m128i *) (dest + i*3), lo);
+            _mm_storel_epi64((__m128i *) (dest + i*3 + 16), hi);
+         }
+         #endif
+         for (; i+16 <= count; i += 16) {
+            __m128i p0 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *) (src + i*4     )), m);
+            __m128i p1 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *) (src + i*4 + 16)), m);
+            __m128i p2 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *) (src + i*4 + 32)), m);
+            __m128i p3 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *) (src + i*4 + 48)), m);
+            _mm_storeu_si128((__m128i *) (dest + i*3     ), _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+            _mm_storeu_si128((__m128i *) (dest + i*3 + 16), _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+            _mm_storeu_si128((__m128i *) (dest + i*3 + 32), _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+         }
+         break;
+      }
+      #endif // STBI_SSSE3
+      default:
+         break;
+   }
+   return i;
+}
+#endif // STBI__CONVERT_SSE2
 
-#if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
-// nothing
-#else
 static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
    int i,j;
@@ -1760,18 +2469,31 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
    if (req_comp == img_n) return data;
    STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
 
-   good = (unsigned char *) stbi__malloc_mad3(req_comp, x, y, 0);
-   if (good == NULL) {
-      STBI_FREE(data);
-      return stbi__errpuc("outofmem", "Out of memory");
+   // dropping channels never needs more room, so do it in place
+   if (req_comp < img_n)
+      good = data;
+   else {
+      good = (unsigned char *) stbi__malloc_mad3(req_comp, x, y, 0);
+      if (good == NULL) {
+         STBI_FREE(data);
+         return stbi__errpuc("outofmem", "Out of memory");
+      }
    }
 
+   STBI__PROFILE_BEGIN(STBI_PROFILE_convert);
    for (j=0; j < (int) y; ++j) {
       unsigned char *src  = data + j * x * img_n   ;
       unsigned char *dest = good + j * x * req_comp;
+      int done = 0;
+
+      #ifdef STBI__CONVERT_SSE2
+      done = stbi__convert_row_simd(dest, src, img_n, req_comp, x);
+      src  += done * img_n;
+      dest += done * req_comp;
+      #endif
 
       #define STBI__COMBO(a,b)  ((a)*8+(b))
-      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1-done; i >= 0; --i, src += a, dest += b)
       // convert source image with img_n components to one with req_comp components;
       // avoid switch per pixel, so use switch per scanline and massive macros
       switch (STBI__COMBO(img_n, req_comp)) {
@@ -1787,11 +2509,17 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
          STBI__CASE(4,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
          STBI__CASE(4,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = src[3]; } break;
          STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                    } break;
-         default: STBI_ASSERT(0); STBI_FREE(data); STBI_FREE(good); return stbi__errpuc("unsupported", "Unsupported format conversion");
+         default: STBI_ASSERT(0); STBI_FREE(data); if (good != data) STBI_FREE(good); return stbi__errpuc("unsupported", "Unsupported format conversion");
       }
       #undef STBI__CASE
    }
+   STBI__PROFILE_END(STBI_PROFILE_convert);
 
+   if (good == data) {
+      // give back the tail we no longer need; keep the original block if that fails
+      good = (unsigned char *) STBI_REALLOC_SIZED(data, (size_t) img_n*x*y, (size_t) req_comp*x*y);
+      return good ? good : data;
+   }
    STBI_FREE(data);
    return good;
 }
@@ -1809,6 +2537,166 @@ static stbi__uint16 stbi__compute_y_16(int r, int g, int b)
 #if defined(STBI_NO_PNG) && defined(STBI_NO_PSD)
 // nothing
 #else
+#ifdef STBI__CONVERT_SSE2
+// luminance of 4 RGBx pixels (2 per register), as 32-bit lanes; same math as stbi__compute_y_16
+static __m128i stbi__compute_y_16_sse2(__m128i p01, __m128i p23)
+{
+   __m128i w  = _mm_setr_epi16(77,150,29,0, 77,150,29,0);
+   __m128i lo = _mm_mullo_epi16(p01, w), hi = _mm_mulhi_epu16(p01, w);
+   __m128i a  = _mm_unpacklo_epi16(lo, hi), b = _mm_unpackhi_epi16(lo, hi);
+   __m128i c, d;
+   lo = _mm_mullo_epi16(p23, w); hi = _mm_mulhi_epu16(p23, w);
+   c  = _mm_unpacklo_epi16(lo, hi); d = _mm_unpackhi_epi16(lo, hi);
+   // horizontal sums of a,b,c,d
+   a  = _mm_add_epi32(_mm_unpacklo_epi32(a, b), _mm_unpackhi_epi32(a, b));
+   c  = _mm_add_epi32(_mm_unpacklo_epi32(c, d), _mm_unpackhi_epi32(c, d));
+   a  = _mm_add_epi32(_mm_unpacklo_epi64(a, c), _mm_unpackhi_epi64(a, c));
+   return _mm_srli_epi32(a, 8);
+}
+
+// packs 8 32-bit lanes holding 0..65535 into 8 uint16 (SSE2 only has a signed pack)
+static __m128i stbi__pack_u32_to_u16_sse2(__m128i a, __m128i b)
+{
+   __m128i bias = _mm_set1_epi32(32768);
+   return _mm_add_epi16(_mm_packs_epi32(_mm_sub_epi32(a, bias), _mm_sub_epi32(b, bias)), _mm_set1_epi16((short) 0x8000));
+}
+
+// 16-bit version of stbi__convert_row_simd, same rules
+static int stbi__convert_row16_simd(stbi__uint16 *dest, stbi__uint16 const *src, int img_n, int req_comp, int count)
+{
+   int i = 0;
+   __m128i ffff = _mm_set1_epi16(-1);
+   switch (img_n*8 + req_comp) {
+      case 1*8+2:
+         for (; i+8 <= count; i += 8) {
+            __m128i g = _mm_loadu_si128((__m128i const *) (src + i));
+            _mm_storeu_si128((__m128i *) (dest + i*2    ), _mm_unpacklo_epi16(g, ffff));
+            _mm_storeu_si128((__m128i *) (dest + i*2 + 8), _mm_unpackhi_epi16(g, ffff));
+         }
+         break;
+      case 1*8+4:
+         for (; i+8 <= count; i += 8) {
+            __m128i g  = _mm_loadu_si128((__m128i const *) (src + i));
+            __m128i gg = _mm_unpacklo_epi16(g, g), ga = _mm_unpacklo_epi16(g, ffff);
+            __m128i hh = _mm_unpackhi_epi16(g, g), ha = _mm_unpackhi_epi16(g, ffff);
+            _mm_storeu_si128((__m128i *) (dest + i*4     ), _mm_unpacklo_epi32(gg, ga));
+            _mm_storeu_si128((__m128i *) (dest + i*4 +  8), _mm_unpackhi_epi32(gg, ga));
+            _mm_storeu_si128((__m128i *) (dest + i*4 + 16), _mm_unpacklo_epi32(hh, ha));
+            _mm_storeu_si128((__m128i *) (dest + i*4 + 24), _mm_unpackhi_epi32(hh, ha));
+         }
+         break;
+      case 2*8+1: {
+         __m128i lo16 = _mm_set1_epi32(0xffff);
+         for (; i+8 <= count; i += 8) {
+            __m128i a = _mm_and_si128(_mm_loadu_si128((__m128i const *) (src + i*2    )), lo16);
+            __m128i b = _mm_and_si128(_mm_loadu_si128((__m128i const *) (src + i*2 + 8)), lo16);
+            _mm_storeu_si128((__m128i *) (dest + i), stbi__pack_u32_to_u16_sse2(a, b));
+         }
+         break;
+      }
+      case 2*8+4:
+         for (; i+4 <= count; i += 4) {
+            __m128i ga = _mm_loadu_si128((__m128i const *) (src + i*2));
+            __m128i gg = _mm_or_si128(_mm_and_si128(ga, _mm_set1_epi32(0xffff)), _mm_slli_epi32(ga, 16));
+            _mm_storeu_si128((__m128i *) (dest + i*4    ), _mm_unpacklo_epi32(gg, ga));
+            _mm_storeu_si128((__m128i *) (dest + i*4 + 8), _mm_unpackhi_epi32(gg, ga));
+         }
+         break;
+      case 4*8+1: case 4*8+2:
+         for (; i+8 <= count; i += 8) {
+            __m128i p0 = _mm_loadu_si128((__m128i const *) (src + i*4     ));
+            __m128i p1 = _mm_loadu_si128((__m128i const *) (src + i*4 +  8));
+            __m128i p2 = _mm_loadu_si128((__m128i const *) (src + i*4 + 16));
+            __m128i p3 = _mm_loadu_si128((__m128i const *) (src + i*4 + 24));
+            __m128i y  = stbi__pack_u32_to_u16_sse2(stbi__compute_y_16_sse2(p0, p1), stbi__compute_y_16_sse2(p2, p3));
+            if (req_comp == 1) {
+               _mm_storeu_si128((__m128i *) (dest + i), y);
+            } else {
+               __m128i a01 = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(_mm_srli_epi64(p0, 48)), _mm_castsi128_ps(_mm_srli_epi64(p1, 48)), _MM_SHUFFLE(2,0,2,0)));
+               __m128i a23 = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(_mm_srli_epi64(p2, 48)), _mm_castsi128_ps(_mm_srli_epi64(p3, 48)), _MM_SHUFFLE(2,0,2,0)));
+               __m128i a   = stbi__pack_u32_to_u16_sse2(a01, a23);
+               _mm_storeu_si128((__m128i *) (dest + i*2    ), _mm_unpacklo_epi16(y, a));
+               _mm_storeu_si128((__m128i *) (dest + i*2 + 8), _mm_unpackhi_epi16(y, a));
+            }
+         }
+         break;
+      #ifdef STBI_SSSE3
+      case 1*8+3: {
+         __m128i m0 = _mm_setr_epi8(0,1,0,1,0,1,2,3,2,3,2,3,4,5,4,5);
+         __m128i m1 = _mm_setr_epi8(4,5,6,7,6,7,6,7,8,9,8,9,8,9,10,11);
+         __m128i m2 = _mm_setr_epi8(10,11,10,11,12,13,12,13,12,13,14,15,14,15,14,15);
+         for (; i+8 <= count; i += 8) {
+            __m128i g = _mm_loadu_si128((__m128i const *) (src + i));
+            _mm_storeu_si128((__m128i *) (dest + i*3     ), _mm_shuffle_epi8(g, m0));
+            _mm_storeu_si128((__m128i *) (dest + i*3 +  8), _mm_shuffle_epi8(g, m1));
+            _mm_storeu_si128((__m128i *) (dest + i*3 + 16), _mm_shuffle_epi8(g, m2));
+         }
+         break;
+      }
+      case 2*8+3: {
+         __m128i m0 = _mm_setr_epi8(0,1,0,1,0,1,4,5,4,5,4,5,8,9,8,9);
+         __m128i m1 = _mm_setr_epi8(8,9,12,13,12,13,12,13,-1,-1,-1,-1,-1,-1,-1,-1);
+         __m128i m2 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,0,1,0,1,0,1,4,5);
+         __m128i m3 = _mm_setr_epi8(4,5,4,5,8,9,8,9,8,9,12,13,12,13,12,13);
+         for (; i+8 <= count; i += 8) {
+            __m128i a = _mm_loadu_si128((__m128i const *) (src + i*2    ));
+            __m128i b = _mm_loadu_si128((__m128i const *) (src + i*2 + 8));
+            _mm_storeu_si128((__m128i *) (dest + i*3     ), _mm_shuffle_epi8(a, m0));
+            _mm_storeu_si128((__m128i *) (dest + i*3 +  8), _mm_or_si128(_mm_shuffle_epi8(a, m1), _mm_shuffle_epi8(b, m2)));
+            _mm_storeu_si128((__m128i *) (dest + i*3 + 16), _mm_shuffle_epi8(b, m3));
+         }
+         break;
+      }
+      case 3*8+1: case 3*8+2: case 3*8+4: {
+         // 8 RGB pixels are exactly three loads; realign them as four pairs of pixels
+         __m128i m = _mm_setr_epi8(0,1,2,3,4,5,-1,-1,6,7,8,9,10,11,-1,-1);
+         __m128i alpha = _mm_setr_epi16(0,0,0,-1,0,0,0,-1);
+         for (; i+8 <= count; i += 8) {
+            __m128i v0 = _mm_loadu_si128((__m128i const *) (src + i*3     ));
+            __m128i v1 = _mm_loadu_si128((__m128i const *) (src + i*3 +  8));
+            __m128i v2 = _mm_loadu_si128((__m128i const *) (src + i*3 + 16));
+            __m128i p0 = _mm_shuffle_epi8(v0, m);
+            __m128i p1 = _mm_shuffle_epi8(_mm_alignr_epi8(v1, v0, 12), m);
+            __m128i p2 = _mm_shuffle_epi8(_mm_alignr_epi8(v2, v1, 8), m);
+            __m128i p3 = _mm_shuffle_epi8(_mm_srli_si128(v2, 4), m);
+            if (req_comp == 4) {
+               _mm_storeu_si128((__m128i *) (dest + i*4     ), _mm_or_si128(p0, alpha));
+               _mm_storeu_si128((__m128i *) (dest + i*4 +  8), _mm_or_si128(p1, alpha));
+               _mm_storeu_si128((__m128i *) (dest + i*4 + 16), _mm_or_si128(p2, alpha));
+               _mm_storeu_si128((__m128i *) (dest + i*4 + 24), _mm_or_si128(p3, alpha));
+            } else {
+               __m128i y = stbi__pack_u32_to_u16_sse2(stbi__compute_y_16_sse2(p0, p1), stbi__compute_y_16_sse2(p2, p3));
+               if (req_comp == 1) {
+                  _mm_storeu_si128((__m128i *) (dest + i), y);
+               } else {
+                  _mm_storeu_si128((__m128i *) (dest + i*2    ), _mm_unpacklo_epi16(y, ffff));
+                  _mm_storeu_si128((__m128i *) (dest + i*2 + 8), _mm_unpackhi_epi16(y, ffff));
+               }
+            }
+         }
+         break;
+      }
+      case 4*8+3: {
+         __m128i m = _mm_setr_epi8(0,1,2,3,4,5,8,9,10,11,12,13,-1,-1,-1,-1);
+         for (; i+8 <= count; i += 8) {
+            __m128i p0 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *) (src + i*4     )), m);
+            __m128i p1 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *) (src + i*4 +  8)), m);
+            __m128i p2 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *) (src + i*4 + 16)), m);
+            __m128i p3 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *) (src + i*4 + 24)), m);
+            _mm_storeu_si128((__m128i *) (dest + i*3     ), _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+            _mm_storeu_si128((__m128i *) (dest + i*3 +  8), _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+            _mm_storeu_si128((__m128i *) (dest + i*3 + 16), _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+         }
+         break;
+      }
+      #endif // STBI_SSSE3
+      default:
+         break;
+   }
+   return i;
+}
+#endif // STBI__CONVERT_SSE2
+
 static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
    int i,j;
@@ -1817,18 +2705,31 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
    if (req_comp == img_n) return data;
    STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
 
-   good = (stbi__uint16 *) stbi__malloc(req_comp * x * y * 2);
-   if (good == NULL) {
-      STBI_FREE(data);
-      return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory");
+   // dropping channels never needs more room, so do it in place
+   if (req_comp < img_n)
+      good = data;
+   else {
+      good = (stbi__uint16 *) stbi__malloc(req_comp * x * y * 2);
+      if (good == NULL) {
+         STBI_FREE(data);
+         return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory");
+      }
    }
 
+   STBI__PROFILE_BEGIN(STBI_PROFILE_convert);
    for (j=0; j < (int) y; ++j) {
       stbi__uint16 *src  = data + j * x * img_n   ;
       stbi__uint16 *dest = good + j * x * req_comp;
+      int done = 0;
+
+      #ifdef STBI__CONVERT_SSE2
+      done = stbi__convert_row16_simd(dest, src, img_n, req_comp, x);
+      src  += done * img_n;
+      dest += done * req_comp;
+      #endif
 
       #define STBI__COMBO(a,b)  ((a)*8+(b))
-      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1-done; i >= 0; --i, src += a, dest += b)
       // convert source image with img_n components to one with req_comp components;
       // avoid switch per pixel, so use switch per scanline and massive macros
       switch (STBI__COMBO(img_n, req_comp)) {
@@ -1844,11 +2745,17 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
          STBI__CASE(4,1) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]);                   } break;
          STBI__CASE(4,2) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]); dest[1] = src[3]; } break;
          STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                       } break;
-         default: STBI_ASSERT(0); STBI_FREE(data); STBI_FREE(good); return (stbi__uint16*) stbi__errpuc("unsupported", "Unsupported format conversion");
+         default: STBI_ASSERT(0); STBI_FREE(data); if (good != data) STBI_FREE(good); return (stbi__uint16*) stbi__errpuc("unsupported", "Unsupported format conversion");
       }
       #undef STBI__CASE
    }
+   STBI__PROFILE_END(STBI_PROFILE_convert);
 
+   if (good == data) {
+      // give back the tail we no longer need; keep the original block if that fails
+      good = (stbi__uint16 *) STBI_REALLOC_SIZED(data, (size_t) img_n*x*y*2, (size_t) req_comp*x*y*2);
+      return good ? good : data;
+   }
    STBI_FREE(data);
    return good;
 }
@@ -2963,8 +3870,12 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          for (j=0; j < h; ++j) {
             for (i=0; i < w; ++i) {
                int ha = z->img_comp[n].ha;
+               STBI__PROFILE_BEGIN(STBI_PROFILE_jpeg_huffman);
                if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+               STBI__PROFILE_END(STBI_PROFILE_jpeg_huffman);
+               STBI__PROFILE_BEGIN(STBI_PROFILE_jpeg_idct);
                z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               STBI__PROFILE_END(STBI_PROFILE_jpeg_idct);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -2991,8 +3902,12 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                         int x2 = (i*z->img_comp[n].h + x)*8;
                         int y2 = (j*z->img_comp[n].v + y)*8;
                         int ha = z->img_comp[n].ha;
+                        STBI__PROFILE_BEGIN(STBI_PROFILE_jpeg_huffman);
                         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                        STBI__PROFILE_END(STBI_PROFILE_jpeg_huffman);
+                        STBI__PROFILE_BEGIN(STBI_PROFILE_jpeg_idct);
                         z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                        STBI__PROFILE_END(STBI_PROFILE_jpeg_idct);
                      }
                   }
                }
@@ -3020,6 +3935,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          for (j=0; j < h; ++j) {
             for (i=0; i < w; ++i) {
                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+               STBI__PROFILE_BEGIN(STBI_PROFILE_jpeg_huffman);
                if (z->spec_start == 0) {
                   if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
                      return 0;
@@ -3028,6 +3944,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   if (!stbi__jpeg_decode_block_prog_ac(z, data, &z->huff_ac[ha], z->fast_ac[ha]))
                      return 0;
                }
+               STBI__PROFILE_END(STBI_PROFILE_jpeg_huffman);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -3051,8 +3968,10 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                         int x2 = (i*z->img_comp[n].h + x);
                         int y2 = (j*z->img_comp[n].v + y);
                         short *data = z->img_comp[n].coeff + 64 * (x2 + y2 * z->img_comp[n].coeff_w);
+                        STBI__PROFILE_BEGIN(STBI_PROFILE_jpeg_huffman);
                         if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
                            return 0;
+                        STBI__PROFILE_END(STBI_PROFILE_jpeg_huffman);
                      }
                   }
                }
@@ -3088,8 +4007,10 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
          for (j=0; j < h; ++j) {
             for (i=0; i < w; ++i) {
                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+               STBI__PROFILE_BEGIN(STBI_PROFILE_jpeg_idct);
                stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
                z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               STBI__PROFILE_END(STBI_PROFILE_jpeg_idct);
             }
          }
       }
@@ -3862,9 +4783,9 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
-static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp, stbi__result_info *ri)
 {
-   int n, decode_n, is_rgb;
+   int n, decode_n, is_rgb, flip = ri->vertically_flipped;
    z->s->img_n = 0; // make stbi__cleanup_jpeg safe
 
    // validate req_comp
@@ -3892,6 +4813,8 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
       int k;
       unsigned int i,j;
       stbi_uc *output;
+      size_t out_stride;
+      stbi_uc *scratch = NULL;
       stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
 
       stbi__resample res_comp[4];
@@ -3918,13 +4841,35 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
          else                               r->resample = stbi__resample_row_generic;
       }
 
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+      if (stbi__into_usable(ri, z->s->img_x, z->s->img_y, n)) {
+         // straight into the caller's memory. a row that ends at the end of that memory is
+         // converted aside first when n==3, since the converters store one byte past the row
+         if (n == 3) {
+            scratch = (stbi_uc *) stbi__malloc_mad2(n, z->s->img_x, 1);
+            if (!scratch) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+            scratch[n * z->s->img_x] = 0;
+         }
+         output = ri->output;
+         out_stride = ri->output_stride;
+      } else {
+         // can't error after this so, this is safe
+         output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+         if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+         out_stride = (size_t) n * z->s->img_x;
+      }
 
       // now go ahead and resample
+      STBI__PROFILE_BEGIN(STBI_PROFILE_jpeg_color);
       for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
+         // rows come out of the resampler top-down; place them bottom-up if flipping
+         stbi_uc *dest = output + out_stride * (flip ? z->s->img_y - 1 - j : j);
+         int aside = scratch != NULL && (size_t) (dest - output) + n * z->s->img_x >= ri->output_size;
+         stbi_uc *out = aside ? scratch : dest;
+         // the converters below may store one byte past the end of the row (out[3] when n==3),
+         // which would clobber the already-written row below when flipping, or the caller's
+         // padding between rows, so save it
+         stbi_uc *row_end = out + n * z->s->img_x;
+         stbi_uc row_end_byte = n == 3 ? *row_end : 0;
          for (k=0; k < decode_n; ++k) {
             stbi__resample *r = &res_comp[k];
             int y_bot = r->ystep >= (r->vs >> 1);
@@ -4016,7 +4961,11 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
                   for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
             }
          }
+         if (n == 3 && (flip || output == ri->output)) *row_end = row_end_byte;
+         if (aside) memcpy(dest, scratch, n * z->s->img_x);
       }
+      STBI__PROFILE_END(STBI_PROFILE_jpeg_color);
+      STBI_FREE(scratch);
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
       *out_y = z->s->img_y;
@@ -4031,10 +4980,10 @@ static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int re
    stbi__jpeg* j = (stbi__jpeg*) stbi__malloc(sizeof(stbi__jpeg));
    if (!j) return stbi__errpuc("outofmem", "Out of memory");
    memset(j, 0, sizeof(stbi__jpeg));
-   STBI_NOTUSED(ri);
+   ri->vertically_flipped = stbi__vertically_flip_on_load;
    j->s = s;
    stbi__setup_jpeg(j);
-   result = load_jpeg_image(j, x,y,comp,req_comp);
+   result = load_jpeg_image(j, x,y,comp,req_comp, ri);
    STBI_FREE(j);
    return result;
 }
@@ -4632,6 +5581,9 @@ typedef struct
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   int flip; // write scanlines bottom-up
+   stbi__result_info *ri;
+   stbi_uc *into; // the caller's memory (ri->output) when the rows are unfiltered straight into it
 } stbi__png;
 
 
@@ -4693,11 +5645,13 @@ static void stbi__create_png_alpha_expand8(stbi_uc *dest, stbi_uc *src, stbi__ui
 }
 
 // create the png data from post-deflated data
-static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+// into, if not NULL, is where the rows go, into_stride bytes apart; otherwise a->out is allocated
+static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color, int flip, stbi_uc *into, size_t into_stride)
 {
    int bytes = (depth == 16 ? 2 : 1);
    stbi__context *s = a->s;
-   stbi__uint32 i,j,stride = x*out_n*bytes;
+   stbi__uint32 i,j;
+   size_t stride = into ? into_stride : (size_t) x*out_n*bytes;
    stbi__uint32 img_len, img_width_bytes;
    stbi_uc *filter_buf;
    int all_ok = 1;
@@ -4709,7 +5663,10 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    int width = x;
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
-   a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
+   if (into)
+      a->out = into;
+   else
+      a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
    if (!a->out) return stbi__err("outofmem", "Out of memory");
 
    // note: error exits here don't need to clean up a->out individually,
@@ -4738,7 +5695,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       // cur/prior filter buffers alternate
       stbi_uc *cur = filter_buf + (j & 1)*img_width_bytes;
       stbi_uc *prior = filter_buf + (~j & 1)*img_width_bytes;
-      stbi_uc *dest = a->out + stride*j;
+      stbi_uc *dest = a->out + stride*(flip ? y-1-j : j);
       int nk = width * filter_bytes;
       int filter = *raw++;
 
@@ -4863,13 +5820,20 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
    int bytes = (depth == 16 ? 2 : 1);
    int out_bytes = out_n * bytes;
    stbi_uc *final;
+   size_t final_stride;
    int p;
    if (!interlaced)
-      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
+      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color, a->flip, a->into, a->into ? a->ri->output_stride : 0);
 
-   // de-interlacing
-   final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
-   if (!final) return stbi__err("outofmem", "Out of memory");
+   // de-interlacing: the passes are scattered into the caller's memory when decoding into it
+   if (a->into) {
+      final = a->into;
+      final_stride = a->ri->output_stride;
+   } else {
+      final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
+      if (!final) return stbi__err("outofmem", "Out of memory");
+      final_stride = (size_t) a->s->img_x * out_bytes;
+   }
    for (p=0; p < 7; ++p) {
       int xorig[] = { 0,4,0,2,0,1,0 };
       int yorig[] = { 0,0,4,0,2,0,1 };
@@ -4881,15 +5845,17 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
       y = (a->s->img_y - yorig[p] + yspc[p]-1) / yspc[p];
       if (x && y) {
          stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
-         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
-            STBI_FREE(final);
+         // passes are decoded top-down; the flip is applied when scattering into final
+         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color, 0, NULL, 0)) {
+            if (final != a->into) STBI_FREE(final);
             return 0;
          }
          for (j=0; j < y; ++j) {
             for (i=0; i < x; ++i) {
                int out_y = j*yspc[p]+yorig[p];
                int out_x = i*xspc[p]+xorig[p];
-               memcpy(final + out_y*a->s->img_x*out_bytes + out_x*out_bytes,
+               if (a->flip) out_y = a->s->img_y - 1 - out_y;
+               memcpy(final + out_y*final_stride + out_x*out_bytes,
                       a->out + (j*x+i)*out_bytes, out_bytes);
             }
          }
@@ -4906,23 +5872,26 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
 static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
 {
    stbi__context *s = z->s;
-   stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-   stbi_uc *p = z->out;
+   stbi__uint32 i, j;
+   size_t stride = z->into ? z->ri->output_stride : (size_t) s->img_x * out_n;
 
    // compute color-based transparency, assuming we've
    // already got 255 as the alpha value in the output
    STBI_ASSERT(out_n == 2 || out_n == 4);
 
-   if (out_n == 2) {
-      for (i=0; i < pixel_count; ++i) {
-         p[1] = (p[0] == tc[0] ? 0 : 255);
-         p += 2;
-      }
-   } else {
-      for (i=0; i < pixel_count; ++i) {
-         if (p[0] == tc[0] && p[1] == tc[1] && p[2] == tc[2])
-            p[3] = 0;
-         p += 4;
+   for (j=0; j < s->img_y; ++j) {
+      stbi_uc *p = z->out + j * stride;
+      if (out_n == 2) {
+         for (i=0; i < s->img_x; ++i) {
+            p[1] = (p[0] == tc[0] ? 0 : 255);
+            p += 2;
+         }
+      } else {
+         for (i=0; i < s->img_x; ++i) {
+            if (p[0] == tc[0] && p[1] == tc[1] && p[2] == tc[2])
+               p[3] = 0;
+            p += 4;
+         }
       }
    }
    return 1;
@@ -5087,6 +6056,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
    z->expanded = NULL;
    z->idata = NULL;
    z->out = NULL;
+   z->into = NULL;
 
    if (!stbi__check_png_header(s)) return 0;
 
@@ -5204,14 +6174,24 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             // initial guess for decoded data size to avoid unnecessary reallocs
             bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
             raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
+            STBI__PROFILE_BEGIN(STBI_PROFILE_png_inflate);
             z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
             if (z->expanded == NULL) return 0; // zlib should set error
+            STBI__PROFILE_END(STBI_PROFILE_png_inflate);
             STBI_FREE(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
+            // stbi_load_into: when no palette expansion or channel conversion follows, the
+            // rows are unfiltered straight into the caller's memory
+            if (z->depth <= 8 && !pal_img_n && !(is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
+                && (req_comp == 0 || req_comp == s->img_out_n)
+                && stbi__into_usable(z->ri, s->img_x, s->img_y, s->img_out_n))
+               z->into = z->ri->output;
+            STBI__PROFILE_BEGIN(STBI_PROFILE_png_unfilter);
             if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
+            STBI__PROFILE_END(STBI_PROFILE_png_unfilter);
             if (has_trans) {
                if (z->depth == 16) {
                   if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
@@ -5264,6 +6244,8 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
 {
    void *result=NULL;
    if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+   p->flip = ri->vertically_flipped = stbi__vertically_flip_on_load;
+   p->ri = ri;
    if (stbi__parse_png_file(p, STBI__SCAN_load, req_comp)) {
       if (p->depth <= 8)
          ri->bits_per_channel = 8;
@@ -5285,7 +6267,7 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
       *y = p->s->img_y;
       if (n) *n = p->s->img_n;
    }
-   STBI_FREE(p->out);      p->out      = NULL;
+   stbi__free_output(p->out, ri); p->out = NULL;
    STBI_FREE(p->expanded); p->expanded = NULL;
    STBI_FREE(p->idata);    p->idata    = NULL;
 
@@ -5535,8 +6517,8 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
    stbi_uc pal[256][4];
    int psize=0,i,j,width;
    int flip_vertically, pad, target;
+   size_t row_bytes, row_stride;
    stbi__bmp_data info;
-   STBI_NOTUSED(ri);
 
    info.all_a = 255;
    if (stbi__bmp_parse_header(s, &info) == NULL)
@@ -5545,6 +6527,10 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
    flip_vertically = ((int) s->img_y) > 0;
    s->img_y = abs((int) s->img_y);
 
+   // bottom-up files are stored in exactly the order a flipped load wants
+   ri->vertically_flipped = stbi__vertically_flip_on_load;
+   if (ri->vertically_flipped) flip_vertically = !flip_vertically;
+
    if (s->img_y > STBI_MAX_DIMENSIONS) return stbi__errpuc("too large","Very large image (corrupt?)");
    if (s->img_x > STBI_MAX_DIMENSIONS) return stbi__errpuc("too large","Very large image (corrupt?)");
 
@@ -5594,11 +6580,22 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
    if (!stbi__mad3sizes_valid(target, s->img_x, s->img_y, 0))
       return stbi__errpuc("too large", "Corrupt BMP");
 
-   out = (stbi_uc *) stbi__malloc_mad3(target, s->img_x, s->img_y, 0);
-   if (!out) return stbi__errpuc("outofmem", "Out of memory");
+   // each scanline is written straight to its final row, so no flip pass is needed afterwards;
+   // stbi_load_into hands over memory to write those rows into when no conversion follows
+   row_bytes = (size_t) s->img_x * target;
+   if ((req_comp == 0 || req_comp == target) && stbi__into_usable(ri, s->img_x, s->img_y, target)
+       && (s->img_y - 1) * ri->output_stride + row_bytes <= INT_MAX) { // rows are addressed by int offsets
+      out = ri->output;
+      row_stride = ri->output_stride;
+   } else {
+      out = (stbi_uc *) stbi__malloc_mad3(target, s->img_x, s->img_y, 0);
+      if (!out) return stbi__errpuc("outofmem", "Out of memory");
+      row_stride = row_bytes;
+   }
+   #define STBI__BMP_ROW(j)  ((int) ((size_t) (flip_vertically ? (int) s->img_y - 1 - (j) : (j)) * row_stride))
    if (info.bpp < 16) {
       int z=0;
-      if (psize == 0 || psize > 256) { STBI_FREE(out); return stbi__errpuc("invalid", "Corrupt BMP"); }
+      if (psize == 0 || psize > 256) { stbi__free_output(out, ri); return stbi__errpuc("invalid", "Corrupt BMP"); }
       for (i=0; i < psize; ++i) {
          pal[i][2] = stbi__get8(s);
          pal[i][1] = stbi__get8(s);
@@ -5610,11 +6607,12 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
       if (info.bpp == 1) width = (s->img_x + 7) >> 3;
       else if (info.bpp == 4) width = (s->img_x + 1) >> 1;
       else if (info.bpp == 8) width = s->img_x;
-      else { STBI_FREE(out); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
+      else { stbi__free_output(out, ri); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
       pad = (-width)&3;
       if (info.bpp == 1) {
          for (j=0; j < (int) s->img_y; ++j) {
             int bit_offset = 7, v = stbi__get8(s);
+            z = STBI__BMP_ROW(j);
             for (i=0; i < (int) s->img_x; ++i) {
                int color = (v>>bit_offset)&0x1;
                out[z++] = pal[color][0];
@@ -5631,6 +6629,7 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
          }
       } else {
          for (j=0; j < (int) s->img_y; ++j) {
+            z = STBI__BMP_ROW(j);
             for (i=0; i < (int) s->img_x; i += 2) {
                int v=stbi__get8(s),v2=0;
                if (info.bpp == 4) {
@@ -5667,15 +6666,16 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
             easy = 2;
       }
       if (!easy) {
-         if (!mr || !mg || !mb) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
+         if (!mr || !mg || !mb) { stbi__free_output(out, ri); return stbi__errpuc("bad masks", "Corrupt BMP"); }
          // right shift amt to put high bit in position #7
          rshift = stbi__high_bit(mr)-7; rcount = stbi__bitcount(mr);
          gshift = stbi__high_bit(mg)-7; gcount = stbi__bitcount(mg);
          bshift = stbi__high_bit(mb)-7; bcount = stbi__bitcount(mb);
          ashift = stbi__high_bit(ma)-7; acount = stbi__bitcount(ma);
-         if (rcount > 8 || gcount > 8 || bcount > 8 || acount > 8) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
+         if (rcount > 8 || gcount > 8 || bcount > 8 || acount > 8) { stbi__free_output(out, ri); return stbi__errpuc("bad masks", "Corrupt BMP"); }
       }
       for (j=0; j < (int) s->img_y; ++j) {
+         z = STBI__BMP_ROW(j);
          if (easy) {
             for (i=0; i < (int) s->img_x; ++i) {
                unsigned char a;
@@ -5706,19 +6706,11 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 
    // if alpha channel is all 0s, replace with all 255s
    if (target == 4 && all_a == 0)
-      for (i=4*s->img_x*s->img_y-1; i >= 0; i -= 4)
-         out[i] = 255;
-
-   if (flip_vertically) {
-      stbi_uc t;
-      for (j=0; j < (int) s->img_y>>1; ++j) {
-         stbi_uc *p1 = out +      j     *s->img_x*target;
-         stbi_uc *p2 = out + (s->img_y-1-j)*s->img_x*target;
-         for (i=0; i < (int) s->img_x*target; ++i) {
-            t = p1[i]; p1[i] = p2[i]; p2[i] = t;
-         }
-      }
-   }
+      for (j=0; j < (int) s->img_y; ++j)
+         for (i=0; i < (int) s->img_x; ++i)
+            out[j*row_stride + i*4 + 3] = 255;
+
+   #undef STBI__BMP_ROW
 
    if (req_comp && req_comp != target) {
       out = stbi__convert_format(out, target, req_comp, s->img_x, s->img_y);
@@ -5868,6 +6860,76 @@ static void stbi__tga_read_rgb16(stbi__context *s, stbi_uc* out)
    // so let's treat all 15 and 16bit TGAs as RGB with no alpha.
 }
 
+// stores count copies of a comp-byte pixel; a long run is written from a block of
+// 16 copies so it goes out in wide stores instead of byte by byte
+stbi_inline static void stbi__tga_fill(stbi_uc *dest, const stbi_uc *pixel, int comp, int count)
+{
+   stbi_uc block[16*4];
+   int i, j;
+   if (count < 16) {
+      // short runs are the common case in smooth images; keep the pixel in locals
+      // so the stores don't have to reload it through the aliasing byte pointers
+      stbi_uc p0 = pixel[0], p1 = pixel[1], p2 = pixel[2], p3 = pixel[3];
+      switch (comp) {
+         case 1: for (i=0; i < count; ++i) dest[i] = p0; break;
+         case 2: for (i=0; i < count; ++i, dest += 2) { dest[0] = p0; dest[1] = p1; } break;
+         case 3: for (i=0; i < count; ++i, dest += 3) { dest[0] = p0; dest[1] = p1; dest[2] = p2; } break;
+         default: for (i=0; i < count; ++i, dest += 4) { dest[0] = p0; dest[1] = p1; dest[2] = p2; dest[3] = p3; } break;
+      }
+      return;
+   }
+   if (comp == 1) {
+      memset(dest, pixel[0], count);
+      return;
+   }
+   for (i=0; i < 16; ++i)
+      for (j=0; j < comp; ++j)
+         block[i*comp + j] = pixel[j];
+   for (; count >= 16; count -= 16, dest += 16*comp)
+      memcpy(dest, block, 16*comp);
+   memcpy(dest, block, count*comp);
+}
+
+// RLE true colour or grey data, a whole packet at a time. packets may run across
+// scanlines, so each one is split at the row ends. rows are stride bytes apart
+static void stbi__tga_load_rle(stbi__context *s, stbi_uc *data, int width, int height, int comp, int inverted, size_t stride)
+{
+   int row = 0, col = 0;
+   stbi_uc *line = data + (inverted ? height - 1 : 0) * stride;
+   while (row < height) {
+      int cmd, count;
+      stbi_uc pixel[4] = { 0, 0, 0, 0 };
+      if (s->img_buffer_end - s->img_buffer > comp) {
+         // header and run pixel are both buffered: take them without the per-byte checks
+         cmd = *s->img_buffer++;
+         if (cmd & 128) {
+            int j;
+            for (j=0; j < comp; ++j)
+               pixel[j] = *s->img_buffer++;
+         }
+      } else {
+         cmd = stbi__get8(s);
+         if (cmd & 128)
+            stbi__get_bytes(s, pixel, comp);
+      }
+      count = 1 + (cmd & 127);
+      while (count > 0 && row < height) {
+         int n = width - col < count ? width - col : count;
+         if (cmd & 128)
+            stbi__tga_fill(line + col * comp, pixel, comp, n);
+         else
+            stbi__get_bytes(s, line + col * comp, n * comp);
+         col += n;
+         count -= n;
+         if (col == width) {
+            col = 0;
+            if (++row < height)
+               line = inverted ? line - stride : line + stride;
+         }
+      }
+   }
+}
+
 static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
    //   read in the TGA header stuff
@@ -5889,12 +6951,14 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
    //   image data
    unsigned char *tga_data;
    unsigned char *tga_palette = NULL;
+   size_t tga_stride;
    int i, j;
    unsigned char raw_data[4] = {0};
    int RLE_count = 0;
    int RLE_repeating = 0;
    int read_next_pixel = 1;
-   STBI_NOTUSED(ri);
+   int tga_col = 0;
+   unsigned char *tga_pixel = NULL;
    STBI_NOTUSED(tga_x_origin); // @TODO
    STBI_NOTUSED(tga_y_origin); // @TODO
 
@@ -5908,6 +6972,10 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
       tga_is_RLE = 1;
    }
    tga_inverted = 1 - ((tga_inverted >> 5) & 1);
+   // scanlines are written straight to their final row, so a flipped load only
+   // changes which way the rows are stored
+   ri->vertically_flipped = stbi__vertically_flip_on_load;
+   if (ri->vertically_flipped) tga_inverted = !tga_inverted;
 
    //   If I'm paletted, then I'll use the number of bits from the palette
    if ( tga_indexed ) tga_comp = stbi__tga_get_comp(tga_palette_bits, 0, &tga_rgb16);
@@ -5924,8 +6992,15 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
    if (!stbi__mad3sizes_valid(tga_width, tga_height, tga_comp, 0))
       return stbi__errpuc("too large", "Corrupt TGA");
 
-   tga_data = (unsigned char*)stbi__malloc_mad3(tga_width, tga_height, tga_comp, 0);
-   if (!tga_data) return stbi__errpuc("outofmem", "Out of memory");
+   // stbi_load_into hands over memory to write the rows into when no conversion follows
+   if ((req_comp == 0 || req_comp == tga_comp) && stbi__into_usable(ri, tga_width, tga_height, tga_comp)) {
+      tga_data = ri->output;
+      tga_stride = ri->output_stride;
+   } else {
+      tga_data = (unsigned char*)stbi__malloc_mad3(tga_width, tga_height, tga_comp, 0);
+      if (!tga_data) return stbi__errpuc("outofmem", "Out of memory");
+      tga_stride = (size_t) tga_width * tga_comp;
+   }
 
    // skip to the data's starting position (offset usually = 0)
    stbi__skip(s, tga_offset );
@@ -5933,15 +7008,17 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
    if ( !tga_indexed && !tga_is_RLE && !tga_rgb16 ) {
       for (i=0; i < tga_height; ++i) {
          int row = tga_inverted ? tga_height -i - 1 : i;
-         stbi_uc *tga_row = tga_data + row*tga_width*tga_comp;
+         stbi_uc *tga_row = tga_data + row*tga_stride;
          stbi__getn(s, tga_row, tga_width * tga_comp);
       }
+   } else if ( !tga_indexed && !tga_rgb16 ) {
+      stbi__tga_load_rle(s, tga_data, tga_width, tga_height, tga_comp, tga_inverted, tga_stride);
    } else  {
       //   do I need to load a palette?
       if ( tga_indexed)
       {
          if (tga_palette_len == 0) {  /* you have to have at least one entry! */
-            STBI_FREE(tga_data);
+            stbi__free_output(tga_data, ri);
             return stbi__errpuc("bad palette", "Corrupt TGA");
          }
 
@@ -5950,7 +7027,7 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
          //   load the palette
          tga_palette = (unsigned char*)stbi__malloc_mad2(tga_palette_len, tga_comp, 0);
          if (!tga_palette) {
-            STBI_FREE(tga_data);
+            stbi__free_output(tga_data, ri);
             return stbi__errpuc("outofmem", "Out of memory");
          }
          if (tga_rgb16) {
@@ -5961,7 +7038,7 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
                pal_entry += tga_comp;
             }
          } else if (!stbi__getn(s, tga_palette, tga_palette_len * tga_comp)) {
-               STBI_FREE(tga_data);
+               stbi__free_output(tga_data, ri);
                STBI_FREE(tga_palette);
                return stbi__errpuc("bad palette", "Corrupt TGA");
          }
@@ -5969,6 +7046,13 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
       //   load the data
       for (i=0; i < tga_width * tga_height; ++i)
       {
+         //   start of a scanline: find the row it goes to
+         if ( tga_col == 0 )
+         {
+            int row = i / tga_width;
+            if ( tga_inverted ) row = tga_height - 1 - row;
+            tga_pixel = tga_data + row*tga_stride;
+         }
          //   if I'm in RLE mode, do I need to get a RLE stbi__pngchunk?
          if ( tga_is_RLE )
          {
@@ -6018,28 +7102,13 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
 
          // copy data
          for (j = 0; j < tga_comp; ++j)
-           tga_data[i*tga_comp+j] = raw_data[j];
+           tga_pixel[j] = raw_data[j];
+         tga_pixel += tga_comp;
+         if ( ++tga_col == tga_width ) tga_col = 0;
 
          //   in case we're in RLE mode, keep counting down
          --RLE_count;
       }
-      //   do I need to invert the image?
-      if ( tga_inverted )
-      {
-         for (j = 0; j*2 < tga_height; ++j)
-         {
-            int index1 = j * tga_width * tga_comp;
-            int index2 = (tga_height - 1 - j) * tga_width * tga_comp;
-            for (i = tga_width * tga_comp; i > 0; --i)
-            {
-               unsigned char temp = tga_data[index1];
-               tga_data[index1] = tga_data[index2];
-               tga_data[index2] = temp;
-               ++index1;
-               ++index2;
-            }
-         }
-      }
       //   clear my palette, if I had one
       if ( tga_palette != NULL )
       {
@@ -6050,13 +7119,16 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
    // swap RGB - if the source data was RGB16, it already is in the right order
    if (tga_comp >= 3 && !tga_rgb16)
    {
-      unsigned char* tga_pixel = tga_data;
-      for (i=0; i < tga_width * tga_height; ++i)
+      for (j=0; j < tga_height; ++j)
       {
-         unsigned char temp = tga_pixel[0];
-         tga_pixel[0] = tga_pixel[2];
-         tga_pixel[2] = temp;
-         tga_pixel += tga_comp;
+         unsigned char* tga_pixel = tga_data + j*tga_stride;
+         for (i=0; i < tga_width; ++i)
+         {
+            unsigned char temp = tga_pixel[0];
+            tga_pixel[0] = tga_pixel[2];
+            tga_pixel[2] = temp;
+            tga_pixel += tga_comp;
+         }
       }
    }
 
@@ -6085,6 +7157,8 @@ static int stbi__psd_test(stbi__context *s)
    return r;
 }
 
+// decodes one channel into pixelCount contiguous bytes. 16-bit channels are
+// packed as bytes too, so those pass twice the pixel count
 static int stbi__psd_decode_rle(stbi__context *s, stbi_uc *p, int pixelCount)
 {
    int count, nleft, len;
@@ -6098,31 +7172,134 @@ static int stbi__psd_decode_rle(stbi__context *s, stbi_uc *p, int pixelCount)
          // Copy next len+1 bytes literally.
          len++;
          if (len > nleft) return 0; // corrupt data
+         stbi__get_bytes(s, p + count, len);
          count += len;
-         while (len) {
-            *p = stbi__get8(s);
-            p += 4;
-            len--;
-         }
       } else if (len > 128) {
-         stbi_uc   val;
          // Next -len+1 bytes in the dest are replicated from next source byte.
          // (Interpret len as a negative 8-bit int.)
          len = 257 - len;
          if (len > nleft) return 0; // corrupt data
-         val = stbi__get8(s);
+         memset(p + count, stbi__get8(s), len);
          count += len;
-         while (len) {
-            *p = val;
-            p += 4;
-            len--;
-         }
       }
    }
 
    return 1;
 }
 
+#ifdef STBI__CONVERT_SSE2
+// 16 RGBA pixels from 16 bytes of each channel
+static void stbi__psd_store16px_sse2(stbi_uc *out, __m128i r, __m128i g, __m128i b, __m128i a)
+{
+   __m128i rg_lo = _mm_unpacklo_epi8(r, g), rg_hi = _mm_unpackhi_epi8(r, g);
+   __m128i ba_lo = _mm_unpacklo_epi8(b, a), ba_hi = _mm_unpackhi_epi8(b, a);
+   _mm_storeu_si128((__m128i *) (out     ), _mm_unpacklo_epi16(rg_lo, ba_lo));
+   _mm_storeu_si128((__m128i *) (out + 16), _mm_unpackhi_epi16(rg_lo, ba_lo));
+   _mm_storeu_si128((__m128i *) (out + 32), _mm_unpacklo_epi16(rg_hi, ba_hi));
+   _mm_storeu_si128((__m128i *) (out + 48), _mm_unpackhi_epi16(rg_hi, ba_hi));
+}
+
+// the high bytes of 16 big-endian samples, which come first in memory
+static __m128i stbi__psd_high_bytes_sse2(const stbi_uc *p)
+{
+   __m128i mask = _mm_set1_epi16(0xff);
+   __m128i lo = _mm_and_si128(_mm_loadu_si128((const __m128i *) (p     )), mask);
+   __m128i hi = _mm_and_si128(_mm_loadu_si128((const __m128i *) (p + 16)), mask);
+   return _mm_packus_epi16(lo, hi);
+}
+
+// 8 native-endian samples from 8 big-endian ones
+static __m128i stbi__psd_load_be16_sse2(const stbi_uc *p)
+{
+   __m128i v = _mm_loadu_si128((const __m128i *) p);
+   return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+#endif
+
+// PSD keeps every channel in its own plane; this weaves the four planes into
+// RGBA pixels. 16-bit planes hold big-endian samples, and are either swapped into
+// 16-bit output or cut down to 8 bits by keeping the high byte.
+static void stbi__psd_interleave(stbi_uc *out, stbi_uc **planes, int pixelCount, int bitdepth, int out16)
+{
+   const stbi_uc *r = planes[0], *g = planes[1], *b = planes[2], *a = planes[3];
+   int i = 0;
+
+   if (bitdepth == 8) {
+      #if defined(STBI__CONVERT_SSE2)
+      for (; i + 16 <= pixelCount; i += 16)
+         stbi__psd_store16px_sse2(out + i*4,
+            _mm_loadu_si128((const __m128i *) (r + i)), _mm_loadu_si128((const __m128i *) (g + i)),
+            _mm_loadu_si128((const __m128i *) (b + i)), _mm_loadu_si128((const __m128i *) (a + i)));
+      #elif defined(STBI_NEON)
+      for (; i + 16 <= pixelCount; i += 16) {
+         uint8x16x4_t v;
+         v.val[0] = vld1q_u8(r + i);
+         v.val[1] = vld1q_u8(g + i);
+         v.val[2] = vld1q_u8(b + i);
+         v.val[3] = vld1q_u8(a + i);
+         vst4q_u8(out + i*4, v);
+      }
+      #endif
+      for (; i < pixelCount; ++i) {
+         out[i*4+0] = r[i];
+         out[i*4+1] = g[i];
+         out[i*4+2] = b[i];
+         out[i*4+3] = a[i];
+      }
+   } else if (!out16) {
+      #if defined(STBI__CONVERT_SSE2)
+      for (; i + 16 <= pixelCount; i += 16)
+         stbi__psd_store16px_sse2(out + i*4,
+            stbi__psd_high_bytes_sse2(r + i*2), stbi__psd_high_bytes_sse2(g + i*2),
+            stbi__psd_high_bytes_sse2(b + i*2), stbi__psd_high_bytes_sse2(a + i*2));
+      #elif defined(STBI_NEON)
+      for (; i + 16 <= pixelCount; i += 16) {
+         uint8x16x4_t v;
+         v.val[0] = vld2q_u8(r + i*2).val[0];
+         v.val[1] = vld2q_u8(g + i*2).val[0];
+         v.val[2] = vld2q_u8(b + i*2).val[0];
+         v.val[3] = vld2q_u8(a + i*2).val[0];
+         vst4q_u8(out + i*4, v);
+      }
+      #endif
+      for (; i < pixelCount; ++i) {
+         out[i*4+0] = r[i*2];
+         out[i*4+1] = g[i*2];
+         out[i*4+2] = b[i*2];
+         out[i*4+3] = a[i*2];
+      }
+   } else {
+      stbi__uint16 *o = (stbi__uint16 *) out;
+      #if defined(STBI__CONVERT_SSE2)
+      for (; i + 8 <= pixelCount; i += 8) {
+         __m128i vr = stbi__psd_load_be16_sse2(r + i*2), vg = stbi__psd_load_be16_sse2(g + i*2);
+         __m128i vb = stbi__psd_load_be16_sse2(b + i*2), va = stbi__psd_load_be16_sse2(a + i*2);
+         __m128i rg_lo = _mm_unpacklo_epi16(vr, vg), rg_hi = _mm_unpackhi_epi16(vr, vg);
+         __m128i ba_lo = _mm_unpacklo_epi16(vb, va), ba_hi = _mm_unpackhi_epi16(vb, va);
+         _mm_storeu_si128((__m128i *) (o + i*4     ), _mm_unpacklo_epi32(rg_lo, ba_lo));
+         _mm_storeu_si128((__m128i *) (o + i*4 +  8), _mm_unpackhi_epi32(rg_lo, ba_lo));
+         _mm_storeu_si128((__m128i *) (o + i*4 + 16), _mm_unpacklo_epi32(rg_hi, ba_hi));
+         _mm_storeu_si128((__m128i *) (o + i*4 + 24), _mm_unpackhi_epi32(rg_hi, ba_hi));
+      }
+      #elif defined(STBI_NEON)
+      for (; i + 8 <= pixelCount; i += 8) {
+         uint16x8x4_t v;
+         v.val[0] = vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(r + i*2)));
+         v.val[1] = vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(g + i*2)));
+         v.val[2] = vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(b + i*2)));
+         v.val[3] = vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(a + i*2)));
+         vst4q_u16(o + i*4, v);
+      }
+      #endif
+      for (; i < pixelCount; ++i) {
+         o[i*4+0] = (stbi__uint16) ((r[i*2] << 8) | r[i*2+1]);
+         o[i*4+1] = (stbi__uint16) ((g[i*2] << 8) | g[i*2+1]);
+         o[i*4+2] = (stbi__uint16) ((b[i*2] << 8) | b[i*2+1]);
+         o[i*4+3] = (stbi__uint16) ((a[i*2] << 8) | a[i*2+1]);
+      }
+   }
+}
+
 static void *stbi__psd_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    int pixelCount;
@@ -6130,7 +7307,9 @@ static void *stbi__psd_load(stbi__context *s, int *x, int *y, int *comp, int req
    int channel, i;
    int bitdepth;
    int w,h;
-   stbi_uc *out;
+   int planeBytes, filePlanes, direct, scratchPlanes;
+   stbi_uc *out, *scratch = NULL;
+   stbi_uc *planes[4];
    STBI_NOTUSED(ri);
 
    // Check identifier
@@ -6195,9 +7374,10 @@ static void *stbi__psd_load(stbi__context *s, int *x, int *y, int *comp, int req
    if (!stbi__mad3sizes_valid(4, w, h, 0))
       return stbi__errpuc("too large", "Corrupt PSD");
 
-   // Create the destination image.
+   // Create the destination image. 16-bit files keep their full depth when the
+   // caller asked for 16 bits, raw or RLE.
 
-   if (!compression && bitdepth == 16 && bpc == 16) {
+   if (bitdepth == 16 && bpc == 16) {
       out = (stbi_uc *) stbi__malloc_mad3(8, w, h, 0);
       ri->bits_per_channel = 16;
    } else
@@ -6205,11 +7385,37 @@ static void *stbi__psd_load(stbi__context *s, int *x, int *y, int *comp, int req
 
    if (!out) return stbi__errpuc("outofmem", "Out of memory");
    pixelCount = w*h;
+   planeBytes = pixelCount * (bitdepth / 8);
+   filePlanes = channelCount < 4 ? channelCount : 4;
 
    // Initialize the data to zero.
    //memset( out, 0, pixelCount * 4 );
 
-   // Finally, the image data.
+   // Finally, the image data. Each of the four output channels is gathered as a
+   // whole plane and the planes are interleaved in one pass at the end.
+   // Uncompressed data that's already in memory is used where it lies; RLE data,
+   // streamed data and the channels the file doesn't have get a scratch plane.
+   direct = !compression && !s->io.read &&
+            s->img_buffer_end - s->img_buffer >= (ptrdiff_t) planeBytes * filePlanes;
+   scratchPlanes = 0;
+   for (channel = 0; channel < 4; channel++)
+      if (channel >= channelCount || !direct)
+         ++scratchPlanes;
+   if (scratchPlanes) {
+      scratch = (stbi_uc *) stbi__malloc_mad2(scratchPlanes, planeBytes ? planeBytes : 1, 0);
+      if (!scratch) {
+         STBI_FREE(out);
+         return stbi__errpuc("outofmem", "Out of memory");
+      }
+   }
+   scratchPlanes = 0;
+   for (channel = 0; channel < 4; channel++) {
+      if (channel >= channelCount || !direct)
+         planes[channel] = scratch + (size_t) planeBytes * scratchPlanes++;
+      else
+         planes[channel] = s->img_buffer + (size_t) planeBytes * channel;
+   }
+
    if (compression) {
       // RLE as used by .PSD and .TIFF
       // Loop until you get the number of unpacked bytes you are expecting:
@@ -6218,67 +7424,37 @@ static void *stbi__psd_load(stbi__context *s, int *x, int *y, int *comp, int req
       //     Else if n is between -127 and -1 inclusive, copy the next byte -n+1 times.
       //     Else if n is 128, noop.
       // Endloop
+      // 16-bit channels are packed the same way, as a stream of big-endian bytes.
 
       // The RLE-compressed data is preceded by a 2-byte data count for each row in the data,
       // which we're going to just skip.
       stbi__skip(s, h * channelCount * 2 );
 
       // Read the RLE data by channel.
-      for (channel = 0; channel < 4; channel++) {
-         stbi_uc *p;
-
-         p = out+channel;
-         if (channel >= channelCount) {
-            // Fill this channel with default data.
-            for (i = 0; i < pixelCount; i++, p += 4)
-               *p = (channel == 3 ? 255 : 0);
-         } else {
-            // Read the RLE data.
-            if (!stbi__psd_decode_rle(s, p, pixelCount)) {
-               STBI_FREE(out);
-               return stbi__errpuc("corrupt", "bad RLE data");
-            }
+      for (channel = 0; channel < filePlanes; channel++) {
+         if (!stbi__psd_decode_rle(s, planes[channel], planeBytes)) {
+            STBI_FREE(scratch);
+            STBI_FREE(out);
+            return stbi__errpuc("corrupt", "bad RLE data");
          }
       }
-
    } else {
       // We're at the raw image data.  It's each channel in order (Red, Green, Blue, Alpha, ...)
       // where each channel consists of an 8-bit (or 16-bit) value for each pixel in the image.
-
-      // Read the data by channel.
-      for (channel = 0; channel < 4; channel++) {
-         if (channel >= channelCount) {
-            // Fill this channel with default data.
-            if (bitdepth == 16 && bpc == 16) {
-               stbi__uint16 *q = ((stbi__uint16 *) out) + channel;
-               stbi__uint16 val = channel == 3 ? 65535 : 0;
-               for (i = 0; i < pixelCount; i++, q += 4)
-                  *q = val;
-            } else {
-               stbi_uc *p = out+channel;
-               stbi_uc val = channel == 3 ? 255 : 0;
-               for (i = 0; i < pixelCount; i++, p += 4)
-                  *p = val;
-            }
-         } else {
-            if (ri->bits_per_channel == 16) {    // output bpc
-               stbi__uint16 *q = ((stbi__uint16 *) out) + channel;
-               for (i = 0; i < pixelCount; i++, q += 4)
-                  *q = (stbi__uint16) stbi__get16be(s);
-            } else {
-               stbi_uc *p = out+channel;
-               if (bitdepth == 16) {  // input bpc
-                  for (i = 0; i < pixelCount; i++, p += 4)
-                     *p = (stbi_uc) (stbi__get16be(s) >> 8);
-               } else {
-                  for (i = 0; i < pixelCount; i++, p += 4)
-                     *p = stbi__get8(s);
-               }
-            }
-         }
-      }
+      if (direct)
+         s->img_buffer += (size_t) planeBytes * filePlanes;
+      else
+         for (channel = 0; channel < filePlanes; channel++)
+            stbi__get_bytes(s, planes[channel], planeBytes);
    }
 
+   // Fill the missing channels with default data: opaque alpha, black colour.
+   for (channel = channelCount; channel < 4; channel++)
+      memset(planes[channel], channel == 3 ? 0xff : 0, planeBytes);
+
+   stbi__psd_interleave(out, planes, pixelCount, bitdepth, ri->bits_per_channel == 16);
+   STBI_FREE(scratch);
+
    // remove weird white matte from PSD
    if (channelCount >= 4) {
       if (ri->bits_per_channel == 16) {
@@ -6378,13 +7554,53 @@ static stbi_uc *stbi__readval(stbi__context *s, int channel, stbi_uc *dest)
    return dest;
 }
 
-static void stbi__copyval(int channel,stbi_uc *dest,const stbi_uc *src)
+// stbi__copyval into count pixels, as one masked 32-bit store per pixel
+static void stbi__pic_fill(int channel,stbi_uc *dest,const stbi_uc *src,int count)
 {
+   stbi_uc bytes[4], keep_bytes[4];
+   stbi__uint32 value, keep, d;
    int mask=0x80,i;
 
+   for (i=0;i<4; ++i, mask>>=1) {
+      bytes[i] = (channel&mask) ? src[i] : 0;
+      keep_bytes[i] = (channel&mask) ? 0 : 0xff;
+   }
+   memcpy(&value, bytes, 4);
+   memcpy(&keep, keep_bytes, 4);
+   for (i=0; i<count; ++i, dest+=4) {
+      memcpy(&d, dest, 4);
+      d = (d & keep) | value;
+      memcpy(dest, &d, 4);
+   }
+}
+
+// count pixels of uncompressed data. when the rest of the file is in memory and
+// long enough, no byte can hit the end, so the bytes are copied without the
+// per-byte end-of-file checks stbi__readval has to make
+static int stbi__pic_read_raw(stbi__context *s,int channel,stbi_uc *dest,int count)
+{
+   int offset[4], n=0, mask=0x80, i, j;
+
    for (i=0;i<4; ++i, mask>>=1)
       if (channel&mask)
-         dest[i]=src[i];
+         offset[n++] = i;
+
+   if (!s->io.read && (s->img_buffer_end - s->img_buffer) >= (ptrdiff_t) count*n) {
+      stbi_uc *src = s->img_buffer;
+      if (n == 4)
+         memcpy(dest, src, count*4);
+      else
+         for (i=0; i<count; ++i, dest+=4, src+=n)
+            for (j=0; j<n; ++j)
+               dest[offset[j]] = src[j];
+      s->img_buffer += count*n;
+      return 1;
+   }
+
+   for (i=0; i<count; ++i, dest+=4)
+      if (!stbi__readval(s,channel,dest))
+         return 0;
+   return 1;
 }
 
 static stbi_uc *stbi__pic_load_core(stbi__context *s,int width,int height,int *comp, stbi_uc *result)
@@ -6427,17 +7643,14 @@ static stbi_uc *stbi__pic_load_core(stbi__context *s,int width,int height,int *c
                return stbi__errpuc("bad format","packet has bad compression type");
 
             case 0: {//uncompressed
-               int x;
-
-               for(x=0;x<width;++x, dest+=4)
-                  if (!stbi__readval(s,packet->channel,dest))
-                     return 0;
+               if (!stbi__pic_read_raw(s,packet->channel,dest,width))
+                  return 0;
                break;
             }
 
             case 1://Pure RLE
                {
-                  int left=width, i;
+                  int left=width;
 
                   while (left>0) {
                      stbi_uc count,value[4];
@@ -6450,8 +7663,8 @@ static stbi_uc *stbi__pic_load_core(stbi__context *s,int width,int height,int *c
 
                      if (!stbi__readval(s,packet->channel,value))  return 0;
 
-                     for(i=0; i<count; ++i,dest+=4)
-                        stbi__copyval(packet->channel,dest,value);
+                     stbi__pic_fill(packet->channel,dest,value,count);
+                     dest += count*4;
                      left -= count;
                   }
                }
@@ -6460,7 +7673,7 @@ static stbi_uc *stbi__pic_load_core(stbi__context *s,int width,int height,int *c
             case 2: {//Mixed RLE
                int left=width;
                while (left>0) {
-                  int count = stbi__get8(s), i;
+                  int count = stbi__get8(s);
                   if (stbi__at_eof(s))  return stbi__errpuc("bad file","file too short (mixed read count)");
 
                   if (count >= 128) { // Repeated
@@ -6476,15 +7689,15 @@ static stbi_uc *stbi__pic_load_core(stbi__context *s,int width,int height,int *c
                      if (!stbi__readval(s,packet->channel,value))
                         return 0;
 
-                     for(i=0;i<count;++i, dest += 4)
-                        stbi__copyval(packet->channel,dest,value);
+                     stbi__pic_fill(packet->channel,dest,value,count);
+                     dest += count*4;
                   } else { // Raw
                      ++count;
                      if (count>left) return stbi__errpuc("bad file","scanline overrun");
 
-                     for(i=0;i<count;++i, dest+=4)
-                        if (!stbi__readval(s,packet->channel,dest))
-                           return 0;
+                     if (!stbi__pic_read_raw(s,packet->channel,dest,count))
+                        return 0;
+                     dest += count*4;
                   }
                   left-=count;
                }
@@ -6528,7 +7741,7 @@ static void *stbi__pic_load(stbi__context *s,int *px,int *py,int *comp,int req_c
 
    if (!stbi__pic_load_core(s,x,y,comp, result)) {
       STBI_FREE(result);
-      result=0;
+      return 0;
    }
    *px = x;
    *py = y;
@@ -7165,7 +8378,7 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
    float *hdr_data;
    int len;
    unsigned char count, value;
-   int i, j, k, c1,c2, z;
+   int i, j, k, c1,c2;
    const char *headerToken;
    STBI_NOTUSED(ri);
 
@@ -7256,7 +8469,10 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
             }
          }
 
+         // the scanline is kept planar (all R, then all G, ...) while decoding, so
+         // runs and dumps are block fills and copies
          for (k = 0; k < 4; ++k) {
+            stbi_uc *plane = scanline + k * width;
             int nleft;
             i = 0;
             while ((nleft = width - i) > 0) {
@@ -7266,18 +8482,23 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
                   value = stbi__get8(s);
                   count -= 128;
                   if ((count == 0) || (count > nleft)) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
-                  for (z = 0; z < count; ++z)
-                     scanline[i++ * 4 + k] = value;
+                  memset(plane + i, value, count);
                } else {
                   // Dump
                   if ((count == 0) || (count > nleft)) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
-                  for (z = 0; z < count; ++z)
-                     scanline[i++ * 4 + k] = stbi__get8(s);
+                  stbi__get_bytes(s, plane + i, count);
                }
+               i += count;
             }
          }
-         for (i=0; i < width; ++i)
-            stbi__hdr_convert(hdr_data+(j*width + i)*req_comp, scanline + i*4, req_comp);
+         for (i=0; i < width; ++i) {
+            stbi_uc rgbe[4];
+            rgbe[0] = scanline[i];
+            rgbe[1] = scanline[i + width];
+            rgbe[2] = scanline[i + width*2];
+            rgbe[3] = scanline[i + width*3];
+            stbi__hdr_convert(hdr_data+(j*width + i)*req_comp, rgbe, req_comp);
+         }
       }
       if (scanline)
          STBI_FREE(scanline);
@@ -7503,10 +8724,31 @@ static int      stbi__pnm_test(stbi__context *s)
    return 1;
 }
 
+// PNM stores 16-bit samples big-endian; swap count of them in place
+static void stbi__pnm_swap16(stbi_uc *p, int count)
+{
+   int i = 0;
+   #if defined(STBI__CONVERT_SSE2)
+   for (; i + 8 <= count; i += 8) {
+      __m128i v = _mm_loadu_si128((__m128i *) (p + i*2));
+      _mm_storeu_si128((__m128i *) (p + i*2), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+   }
+   #elif defined(STBI_NEON)
+   for (; i + 8 <= count; i += 8)
+      vst1q_u8(p + i*2, vrev16q_u8(vld1q_u8(p + i*2)));
+   #endif
+   for (; i < count; ++i) {
+      stbi_uc t = p[i*2];
+      p[i*2] = p[i*2+1];
+      p[i*2+1] = t;
+   }
+}
+
 static void *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
    stbi_uc *out;
-   STBI_NOTUSED(ri);
+   int j, row_bytes;
+   size_t stride;
 
    ri->bits_per_channel = stbi__pnm_info(s, (int *)&s->img_x, (int *)&s->img_y, (int *)&s->img_n);
    if (ri->bits_per_channel == 0)
@@ -7522,11 +8764,27 @@ static void *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp, int req
    if (!stbi__mad4sizes_valid(s->img_n, s->img_x, s->img_y, ri->bits_per_channel / 8, 0))
       return stbi__errpuc("too large", "PNM too large");
 
-   out = (stbi_uc *) stbi__malloc_mad4(s->img_n, s->img_x, s->img_y, ri->bits_per_channel / 8, 0);
-   if (!out) return stbi__errpuc("outofmem", "Out of memory");
-   if (!stbi__getn(s, out, s->img_n * s->img_x * s->img_y * (ri->bits_per_channel / 8))) {
-      STBI_FREE(out);
-      return stbi__errpuc("bad PNM", "PNM file truncated");
+   // read each scanline straight into its final row, in the memory stbi_load_into handed
+   // over when no conversion follows
+   row_bytes = s->img_n * s->img_x * (ri->bits_per_channel / 8);
+   if (ri->bits_per_channel == 8 && (req_comp == 0 || req_comp == s->img_n) && stbi__into_usable(ri, s->img_x, s->img_y, s->img_n)) {
+      out = ri->output;
+      stride = ri->output_stride;
+   } else {
+      out = (stbi_uc *) stbi__malloc_mad4(s->img_n, s->img_x, s->img_y, ri->bits_per_channel / 8, 0);
+      if (!out) return stbi__errpuc("outofmem", "Out of memory");
+      stride = row_bytes;
+   }
+   ri->vertically_flipped = stbi__vertically_flip_on_load;
+   for (j=0; j < (int) s->img_y; ++j) {
+      int row = ri->vertically_flipped ? (int) s->img_y - 1 - j : j;
+      if (!stbi__getn(s, out + (size_t) row * stride, row_bytes)) {
+         stbi__free_output(out, ri);
+         return stbi__errpuc("bad PNM", "PNM file truncated");
+      }
+      // swap while the row is still in cache
+      if (ri->bits_per_channel == 16)
+         stbi__pnm_swap16(out + (size_t) row * stride, row_bytes / 2);
    }
 
    if (req_comp && req_comp != s->img_n) {
@@ -7629,72 +8887,94 @@ static int stbi__pnm_is16(stbi__context *s)
 }
 #endif
 
-static int stbi__info_main(stbi__context *s, int *x, int *y, int *comp)
+static int stbi__format_info(stbi__context *s, int format, int *x, int *y, int *comp)
 {
-   #ifndef STBI_NO_JPEG
-   if (stbi__jpeg_info(s, x, y, comp)) return 1;
-   #endif
-
-   #ifndef STBI_NO_PNG
-   if (stbi__png_info(s, x, y, comp))  return 1;
-   #endif
-
-   #ifndef STBI_NO_GIF
-   if (stbi__gif_info(s, x, y, comp))  return 1;
-   #endif
-
-   #ifndef STBI_NO_BMP
-   if (stbi__bmp_info(s, x, y, comp))  return 1;
-   #endif
-
-   #ifndef STBI_NO_PSD
-   if (stbi__psd_info(s, x, y, comp))  return 1;
-   #endif
-
-   #ifndef STBI_NO_PIC
-   if (stbi__pic_info(s, x, y, comp))  return 1;
-   #endif
+   stbi__rewind(s);
+   switch (format) {
+      #ifndef STBI_NO_JPEG
+      case STBI_format_jpeg: return stbi__jpeg_info(s, x, y, comp);
+      #endif
+      #ifndef STBI_NO_PNG
+      case STBI_format_png:  return stbi__png_info(s, x, y, comp);
+      #endif
+      #ifndef STBI_NO_GIF
+      case STBI_format_gif:  return stbi__gif_info(s, x, y, comp);
+      #endif
+      #ifndef STBI_NO_BMP
+      case STBI_format_bmp:  return stbi__bmp_info(s, x, y, comp);
+      #endif
+      #ifndef STBI_NO_PSD
+      case STBI_format_psd:  return stbi__psd_info(s, x, y, comp);
+      #endif
+      #ifndef STBI_NO_PIC
+      case STBI_format_pic:  return stbi__pic_info(s, x, y, comp);
+      #endif
+      #ifndef STBI_NO_PNM
+      case STBI_format_pnm:  return stbi__pnm_info(s, x, y, comp);
+      #endif
+      #ifndef STBI_NO_HDR
+      case STBI_format_hdr:  return stbi__hdr_info(s, x, y, comp);
+      #endif
+      #ifndef STBI_NO_TGA
+      case STBI_format_tga:  return stbi__tga_info(s, x, y, comp);
+      #endif
+      default:               return 0;
+   }
+}
 
-   #ifndef STBI_NO_PNM
-   if (stbi__pnm_info(s, x, y, comp))  return 1;
-   #endif
+// same dispatch as stbi__detect_format
+static int stbi__info_main(stbi__context *s, int *x, int *y, int *comp)
+{
+   static const int probe_order[] = {
+      STBI_format_jpeg, STBI_format_png, STBI_format_gif, STBI_format_bmp, STBI_format_psd,
+      STBI_format_pic, STBI_format_pnm, STBI_format_hdr, STBI_format_tga
+   };
+   int hint = stbi__format_hint, format, i;
 
-   #ifndef STBI_NO_HDR
-   if (stbi__hdr_info(s, x, y, comp))  return 1;
-   #endif
+   if (hint != STBI_format_auto && stbi__format_info(s, hint, x, y, comp)) return 1;
 
-   // test tga last because it's a crappy test!
-   #ifndef STBI_NO_TGA
-   if (stbi__tga_info(s, x, y, comp))
-       return 1;
-   #endif
+   format = stbi__sniff_format(s);
+   if (format == STBI__FORMAT_PROBE) {
+      for (i=0; i < (int) (sizeof(probe_order)/sizeof(probe_order[0])); ++i)
+         if (probe_order[i] != hint && stbi__format_info(s, probe_order[i], x, y, comp))
+            return 1;
+   } else {
+      if (format != hint && stbi__format_info(s, format, x, y, comp)) return 1;
+      // test tga last because it's a crappy test!
+      if (format != STBI_format_tga && hint != STBI_format_tga && stbi__format_info(s, STBI_format_tga, x, y, comp)) return 1;
+   }
    return stbi__err("unknown image type", "Image not of any known type, or corrupt");
 }
 
 static int stbi__is_16_main(stbi__context *s)
 {
+   int format = stbi__sniff_format(s);
+
    #ifndef STBI_NO_PNG
-   if (stbi__png_is16(s))  return 1;
+   if ((format == STBI_format_png || format == STBI__FORMAT_PROBE) && stbi__png_is16(s))  return 1;
    #endif
 
    #ifndef STBI_NO_PSD
-   if (stbi__psd_is16(s))  return 1;
+   if ((format == STBI_format_psd || format == STBI__FORMAT_PROBE) && stbi__psd_is16(s))  return 1;
    #endif
 
    #ifndef STBI_NO_PNM
-   if (stbi__pnm_is16(s))  return 1;
+   if ((format == STBI_format_pnm || format == STBI__FORMAT_PROBE) && stbi__pnm_is16(s))  return 1;
    #endif
+   STBI_NOTUSED(format);
    return 0;
 }
 
 #ifndef STBI_NO_STDIO
 STBIDEF int stbi_info(char const *filename, int *x, int *y, int *comp)
 {
-    FILE *f = stbi__fopen(filename, "rb");
+    stbi__file_source src;
+    stbi__context s;
     int result;
-    if (!f) return stbi__err("can't fopen", "Unable to open file");
-    result = stbi_info_from_file(f, x, y, comp);
-    fclose(f);
+    if (!stbi__open_source(&src, filename, 0)) return stbi__err("can't fopen", "Unable to open file");
+    stbi__start_source(&s, &src);
+    result = stbi__info_main(&s,x,y,comp);
+    stbi__close_source(&src);
     return result;
 }
 
@@ -7711,11 +8991,13 @@ STBIDEF int stbi_info_from_file(FILE *f, int *x, int *y, int *comp)
 
 STBIDEF int stbi_is_16_bit(char const *filename)
 {
-    FILE *f = stbi__fopen(filename, "rb");
+    stbi__file_source src;
+    stbi__context s;
     int result;
-    if (!f) return stbi__err("can't fopen", "Unable to open file");
-    result = stbi_is_16_bit_from_file(f);
-    fclose(f);
+    if (!stbi__open_source(&src, filename, 0)) return stbi__err("can't fopen", "Unable to open file");
+    stbi__start_source(&s, &src);
+    result = stbi__is_16_main(&s);
+    stbi__close_source(&src);
     return result;
 }
 